@@ -2,6 +2,21 @@
 
 #include "AllocTrac.h"
 #include <limits>
+#include <map>
+#include <mutex>
 
-std::atomic<size_t> AllocTrac::totalAlloc = 0;
 size_t AllocTrac::maxAlloc = size_t(3) * 1024 * 1024 * 1024; // 3 GB
+
+std::atomic<size_t>& AllocTrac::deviceTotal(cl_device_id device) {
+  static std::mutex mutex;
+  static std::map<cl_device_id, std::atomic<size_t>> totals;
+  std::lock_guard lock(mutex);
+  return totals[device];
+}
+
+std::atomic<size_t>& AllocTrac::contextTotal(cl_context context) {
+  static std::mutex mutex;
+  static std::map<cl_context, std::atomic<size_t>> totals;
+  std::lock_guard lock(mutex);
+  return totals[context];
+}
@@ -3,6 +3,7 @@
 #pragma once
 
 #include "common.h"
+#include "tinycl.h"
 #include <atomic>
 #include <new>
 #include <string>
@@ -21,35 +22,47 @@ public:
 };
 */
 
+// Tracks the GPU memory allocated on each device. The limit (maxAlloc) applies per device,
+// and is shared by all the exponents running concurrently on that device.
+// Each Gpu has its own context, so the total of a context is the memory of one worker.
 class AllocTrac {
-  static std::atomic<size_t> totalAlloc;  
   static size_t maxAlloc;
+
+  static std::atomic<size_t>& deviceTotal(cl_device_id device);
+  static std::atomic<size_t>& contextTotal(cl_context context);
   
+  std::atomic<size_t>* total{};
+  std::atomic<size_t>* ownTotal{};
   size_t size{};
   
 public:
   AllocTrac() = default;
-  explicit AllocTrac(size_t size) : size(size) {
+  AllocTrac(size_t size, cl_device_id device, cl_context context)
+    : total{&deviceTotal(device)}, ownTotal{&contextTotal(context)}, size(size) {
     if (size) {
-      if (totalAlloc + size >= maxAlloc) {
-        log("Reached GPU maxAlloc limit %.1f GB\n", float(maxAlloc) / (1024 * 1024 * 1024));
-        throw bad_alloc();
-      }
-      totalAlloc += size;
-      // log("alloc %lu total %lu limit %lu\n", size, size_t(totalAlloc), maxAlloc);
+      size_t prev = *total;
+      do {
+        if (prev + size >= maxAlloc) {
+          log("Reached GPU maxAlloc limit %.1f GB\n", float(maxAlloc) / (1024 * 1024 * 1024));
+          throw bad_alloc();
+        }
+      } while (!total->compare_exchange_weak(prev, prev + size));
+      *ownTotal += size;
+      // log("alloc %lu total %lu limit %lu\n", size, size_t(*total), maxAlloc);
     }
   }
   ~AllocTrac() {
     if (size) {
-      totalAlloc -= size;
-      // log("release %lu total %lu limit %lu\n", size, size_t(totalAlloc), maxAlloc);
+      *total -= size;
+      *ownTotal -= size;
+      // log("release %lu total %lu limit %lu\n", size, size_t(*total), maxAlloc);
     }
   }
 
   AllocTrac(const AllocTrac&) = delete;
   void operator=(const AllocTrac&) = delete;
 
-  AllocTrac(AllocTrac&& rhs) : size(rhs.size) { rhs.size = 0; }
+  AllocTrac(AllocTrac&& rhs) : total(rhs.total), ownTotal(rhs.ownTotal), size(rhs.size) { rhs.size = 0; }
   AllocTrac& operator=(AllocTrac&& rhs) {
     AllocTrac tmp{std::move(rhs)};
     swap(*this, tmp);
@@ -58,10 +71,14 @@ public:
 
   friend void swap(AllocTrac& a, AllocTrac& b) noexcept {
     using std::swap;
+    swap(a.total, b.total);
+    swap(a.ownTotal, b.ownTotal);
     swap(a.size, b.size);
   }
 
   static void setMaxAlloc(size_t m) { maxAlloc = m; }
-  static size_t totalAllocBytes() { return totalAlloc; }
-  static size_t availableBytes() { return maxAlloc - totalAlloc; }
+  static size_t maxAllocBytes() { return maxAlloc; }
+  static size_t totalAllocBytes(cl_device_id device) { return deviceTotal(device); }
+  static size_t contextAllocBytes(cl_context context) { return contextTotal(context); }
+  static size_t availableBytes(cl_device_id device) { return maxAlloc - deviceTotal(device); }
 };
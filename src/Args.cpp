@@ -53,25 +53,46 @@ void Args::printHelp() {
 -cpu  <name>       : specify the hardware name.
 -time              : display kernel profiling information.
 -fft <spec>        : specify FFT e.g.: 1152K, 5M, 5.5M, 256:10:1K
+-calibrate all|<spec>,.. : measure the round-off error near the limits of the given FFTs (with the iterations of -iters,
+                     default 20000, per sample exponent), fit the bits-per-word limits of each MiddleMul chain variant,
+                     and write them to the -fftLimits file. Then exit.
+-fftLimits <file>  : the FFT limits written by -calibrate, used instead of the built-in ones. Default '%s'.
 -block <value>     : PRP error-check block size. Must divide 10'000.
 -log <step>        : log every <step> iterations. Multiple of 10'000.
+                     Also fixes the PRP check interval, which otherwise adapts to the measured check cost and error rate.
 -carry long|short  : force carry type. Short carry may be faster, but requires high bits/word.
 -B1                : P-1 B1 bound
 -B2                : P-1 B2 bound
 -rB2               : ratio of B2 to B1. Default %u, used only if B2 is not explicitly set
 -prp <exponent>    : run a single PRP test and exit, ignoring worktodo.txt
--verify <file>     : verify PRP-proof contained in <file>
+-verify <file>[,<file>..] : verify the PRP-proofs contained in the files. The hash chains of several
+                     proofs are computed together, four at a time.
 -proof <power>     : By default a proof of power %u is generated, using 3GB of temporary disk space for a 100M exponent.
                      A lower power reduces disk space requirements but increases the verification cost.
                      A proof of power 9 uses 6GB of disk space for a 100M exponent and enables faster verification.
+                     The power is lowered to what fits in the -tmpDir free space, and the proof plan is logged.
 -autoverify <power> : Self-verify proofs generated with at least this power. Default %u.
+-bgproof           : build and verify the proof in the background while the next test runs on the device.
+-ntt [cpu]         : run the PRP tests (with savefiles and proof) and the proof verifications with the integer NTT,
+                     which has no round-off error, on the device; it is checked on start against the CPU NTT.
+                     "-ntt cpu" runs on the CPU instead, without a device. Slower than the FFT; meant for testing.
+-ff                : run the PRP tests and the proof verifications with the float-float FFT, for devices with a low
+                     FP64 rate; it is checked on start against its CPU reference (ffcheck). Fewer bits per word than FP64.
 -tmpDir <dir>      : specify a folder with plenty of disk space where temporary proof checkpoints will be stored, default '%s'.
 -mprimeDir <dir>   : folder where an instance of Prime95/mprime can be found (for P-1 second-stage)
 -results <file>    : name of results file, default '%s'
+-jsonlog <file>    : also write the log as JSON lines ({"time", "context", "message"}) to <file>
 -iters <N>         : run next PRP test for <N> iterations and exit. Multiple of 10000.
 -maxAlloc <size>   : limit GPU memory usage to size, which is a value with suffix M for MB and G for GB.
                      e.g. -maxAlloc 2048M or -maxAlloc 3.5G
+-memBudget <size>  : the device memory, with suffix M or G, that the instances sharing a device (and -pool directory)
+                     may use together while generating proofs; they queue for it in FIFO order. When the instances
+                     differ, the smallest -memBudget among those generating or waiting applies.
+                     Default 0: one proof generation at a time.
 -save <N>          : specify the number of savefiles to keep (default %u).
+                     The PRP savefiles kept are log-spaced back from the most recent one.
+-saveBudget <size> : limit the PRP savefiles of an exponent to <size>, with suffix M or G (default no limit).
+-saveTier <dir>    : move all but the two most recent PRP savefiles to <dir>, e.g. on a larger and slower disk.
 -noclean           : do not delete data after the test is complete.
 -from <iteration>  : start at the given iteration instead of the most recent saved iteration
 -yield             : enable work-around for Nvidia GPUs busy wait. Do not use on AMD GPUs!
@@ -79,8 +100,14 @@ void Args::printHelp() {
 -use NEW_FFT8,OLD_FFT5,NEW_FFT10: comma separated list of defines, see the #if tests in gpuowl.cl (used for perf tuning)
 -unsafeMath        : use OpenCL -cl-unsafe-math-optimizations (use at your own risk)
 -binary <file>     : specify a file containing the compiled kernels binary
+-devices all|<N>,..: run one worker per device in this process; the workers share worktodo.txt,
+                     and the trig tables of the FFT shapes in use. The kernels are compiled per exponent.
+-workers <N>       : run <N> exponents concurrently on each device, each with its own queue and buffers.
+                     Improves the GPU utilization with small FFTs. -maxAlloc applies to the sum of them.
+                     There is no explicit time-slicing: each worker waits for its block at the block
+                     boundary, and the driver interleaves the kernels of the queues.
 -device <N>        : select a specific device:
-)", B2_B1_ratio, proofPow, proofVerify, tmpDir.c_str(), resultsFile.c_str(), nSavefiles);
+)", fftLimits.c_str(), B2_B1_ratio, proofPow, proofVerify, tmpDir.c_str(), resultsFile.c_str(), nSavefiles);
 
   // Undocumented:
   // -D <value>         : specify the P2 "D" value, one of: 210, 330, 420, 462, 660, 770, 924, 1540, 2310.
@@ -146,6 +173,16 @@ void Args::parse(const string& line) {
         throw "-autoverify <power>";
       }
       proofVerify = stoi(s);
+    } else if (key == "-bgproof") {
+      backgroundProof = true;
+    } else if (key == "-ntt") {
+      if (!s.empty() && s != "cpu") {
+        log("-ntt expects nothing or 'cpu' (found '%s')\n", s.c_str());
+        throw "-ntt [cpu]";
+      }
+      engine = s.empty() ? ENGINE_NTT : ENGINE_NTT_CPU;
+    } else if (key == "-ff") {
+      engine = ENGINE_FF;
     } else if (key == "-tmpDir" || key == "-tmpdir") {
       if (s.empty()) {
         log("-tmpDir needs <dir>\n");
@@ -179,11 +216,23 @@ void Args::parse(const string& line) {
       }
     }
     else if (key == "-results") { resultsFile = s; }
+    else if (key == "-jsonlog") { jsonLog = s; }
     else if (key == "-maxAlloc" || key == "-maxalloc") {
       assert(!s.empty());
       u32 multiple = (s.back() == 'G') ? (1u << 30) : (1u << 20);
       maxAlloc = size_t(stod(s) * multiple + .5);
     }
+    else if (key == "-memBudget" || key == "-membudget") {
+      assert(!s.empty());
+      u32 multiple = (s.back() == 'G') ? (1u << 30) : (1u << 20);
+      memBudget = size_t(stod(s) * multiple + .5);
+    }
+    else if (key == "-saveBudget") {
+      assert(!s.empty());
+      u32 multiple = (s.back() == 'G') ? (1u << 30) : (1u << 20);
+      saveBudget = size_t(stod(s) * multiple + .5);
+    }
+    else if (key == "-saveTier") { saveTier = s; }
     else if (key == "-log") { logStep = stoi(s); assert(logStep && (logStep % 10000 == 0)); }
     else if (key == "-iters") { iters = stoi(s); assert(iters && (iters % 10000 == 0)); }
     else if (key == "-prp" || key == "-PRP") { prpExp = stoll(s); }
@@ -191,12 +240,37 @@ void Args::parse(const string& line) {
     else if (key == "-B2" || key == "-b2") { B2 = stoi(s); }
     else if (key == "-rB2") { B2_B1_ratio = stoi(s); }
     else if (key == "-fft") { fftSpec = s; }
+    else if (key == "-calibrate") { calibrate = s; }
+    else if (key == "-fftLimits") { fftLimits = s; }
     else if (key == "-dump") { dump = s; }
     else if (key == "-user") { user = s; }
     else if (key == "-cpu") { cpu = s; }
     else if (key == "-time") { timeKernels = true; }
     else if (key == "-device" || key == "-d") { device = stoi(s); }
     else if (key == "-uid") { device = getSeqId(s); }
+    else if (key == "-workers") {
+      int n = s.empty() ? 0 : stoi(s);
+      if (n < 1) {
+        log("-workers expects a number >= 1, not '%s'\n", s.c_str());
+        throw "-workers";
+      }
+      workers = n;
+    }
+    else if (key == "-devices") {
+      devices.clear();
+      if (s == "all") {
+        for (u32 i = 0, n = getAllDeviceIDs().size(); i < n; ++i) { devices.push_back(i); }
+      } else {
+        string ss = s;
+        std::replace(ss.begin(), ss.end(), ',', ' ');
+        std::istringstream iss{ss};
+        for (int d; iss >> d;) { devices.push_back(d); }
+      }
+      if (devices.empty()) {
+        log("-devices expects all|<N>,<N>,..\n");
+        throw "-devices without devices";
+      }
+    }
     else if (key == "-dir") { dir = s; }
     else if (key == "-yield") { cudaYield = true; }
     else if (key == "-nospin") { noSpin = true; }
@@ -240,13 +314,23 @@ void Args::parse(const string& line) {
   }
 }
 
-void Args::setDefaults() {
+void Args::setDevice(int id) {
+  device = id;
   uid = getUUID(device);
   log("device %d, unique id '%s'\n", device, uid.c_str());
   
   if (cpu.empty()) {
     cpu = uid.empty() ? getShortInfo(getDevice(device)) + "-" + std::to_string(device) : uid;
+  } else if (!devices.empty()) {
+    cpu += "-" + std::to_string(device);
   }
+}
+
+void Args::setDefaults() {
+  if (workers > 1 && devices.empty()) { devices.push_back(device); }
+
+  // With -devices, each worker selects its device on its own copy of Args. -ntt runs on the CPU.
+  if (devices.empty() && engine != ENGINE_NTT_CPU) { setDevice(device); }
 
   if (!masterDir.empty()) {
     assert(masterDir.is_absolute());
@@ -6,6 +6,7 @@
 
 #include <string>
 #include <set>
+#include <vector>
 #include <filesystem>
 
 namespace fs = std::filesystem;
@@ -15,9 +16,13 @@ public:
   static std::string mergeArgs(int argc, char **argv);
 
   enum {CARRY_AUTO = 0, CARRY_SHORT, CARRY_LONG};
+  enum {ENGINE_FFT = 0, ENGINE_NTT, ENGINE_NTT_CPU, ENGINE_FF};
 
   void parse(const string& line);
   void setDefaults();
+
+  // Selects the device, setting uid and (if not set by the user) cpu accordingly.
+  void setDevice(int device);
   bool uses(const std::string& key) const { return flags.count(key); }
   
   string user;
@@ -31,6 +36,8 @@ public:
   std::set<std::string> flags;
   
   int device = 0;
+  std::vector<int> devices; // -devices: one worker per device in this process
+  u32 workers = 1;           // -workers: exponents running concurrently on each device
   
   bool timeKernels = false;
   bool cudaYield = false;
@@ -42,6 +49,7 @@ public:
   u32 proofVerify = 9;
 
   fs::path resultsFile = "results.txt";
+  fs::path jsonLog;                 // -jsonlog
   fs::path masterDir;
   fs::path tmpDir = ".";
   fs::path proofResultDir = "proof";
@@ -49,11 +57,15 @@ public:
   fs::path mprimeDir = ".";
 
   bool keepProof = false;
+  bool backgroundProof = false; // -bgproof
+  int engine = ENGINE_FFT;      // -ntt [cpu], -ff
 
   int carry = CARRY_AUTO;
   u32 blockSize = 400;
   u32 logStep   = 0;
   string fftSpec;
+  string calibrate;                // -calibrate: FFT specs, or "all"
+  fs::path fftLimits = "fft-limits.txt";
 
   u32 B1 = 2'000'000;
   u32 B2 = 0;
@@ -63,9 +75,12 @@ public:
   u32 prpExp = 0;
   
   size_t maxAlloc = 0;
+  size_t memBudget = 0; // -memBudget: the device bytes shared by the proof generations of the instances
 
   u32 iters = 0;
   u32 nSavefiles = 20;
+  size_t saveBudget = 0; // -saveBudget: bytes of PRP savefiles per exponent
+  fs::path saveTier;     // -saveTier: the directory of the older PRP savefiles
   u32 startFrom = u32(-1);
   
   void printHelp();
@@ -0,0 +1,25 @@
+// Copyright Mihai Preda.
+
+#pragma once
+
+#include <future>
+#include <utility>
+
+// Runs one job at a time on a host thread, e.g. building the proof of the test that just finished
+// while the device moves on to the next one. A new job waits for the previous one to finish.
+class Background {
+  std::future<void> job;
+
+public:
+  ~Background() { wait(); }
+
+  template<typename F> void run(F&& f) {
+    wait();
+    job = std::async(std::launch::async, std::forward<F>(f));
+  }
+
+  // The job is expected to handle its own errors.
+  void wait() {
+    if (job.valid()) { job.get(); }
+  }
+};
@@ -7,6 +7,7 @@
 #include "Context.h"
 #include "Queue.h"
 
+#include <atomic>
 #include <memory>
 #include <string>
 #include <vector>
@@ -14,6 +15,13 @@
 template<typename T>
 class ConstBuffer {
   std::unique_ptr<cl_mem> ptr;
+  // Unique over the life of the process, unlike the cl_mem handle which the driver may reuse after a release.
+  u64 id{newId()};
+
+  static u64 newId() {
+    static std::atomic<u64> next{1};
+    return next++;
+  }
   
 public:
   const size_t size{};
@@ -27,7 +35,7 @@ protected:
     : ptr{makeBuf_(context, kind, size * sizeof(T), ptr)}
     , size(size)
     , name(name)
-    , allocTrac(size * sizeof(T))
+    , allocTrac(size * sizeof(T), getContextDevice(context), context)
   {}
     
 public:
@@ -48,12 +56,14 @@ public:
   ConstBuffer& operator=(ConstBuffer&& rhs) {
     assert(size == rhs.size);
     ptr = std::move(rhs.ptr);
+    id = rhs.id;
     return *this;
   }
   
   virtual ~ConstBuffer() = default;
   
   cl_mem get() const { return ptr.get(); }
+  u64 getId() const { return id; }
   void reset() { ptr.reset(); }
 };
 
@@ -127,3 +137,31 @@ public:
   // async read
   // void operator>>(vector<T>& out) const { readAsync(out); }
 };
+
+// A buffer in host-visible ("pinned") memory. The device writes into it directly, and the host reads it
+// through a mapping, without a copy into pageable memory.
+template<typename T>
+class PinnedBuffer : public Buffer<T> {
+public:
+  PinnedBuffer(QueuePtr queue, std::string_view name, size_t size)
+    : Buffer<T>(queue, name, size, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR) {}
+
+  // The contents mapped into host memory for the life of this object. The device must not use the buffer meanwhile.
+  class Mapped {
+    const PinnedBuffer& buf;
+    T *ptr;
+
+  public:
+    Mapped(const PinnedBuffer& buf, bool forWrite)
+      : buf{buf}
+      , ptr{static_cast<T*>(mapBuf(buf.queue->get(), buf.get(), buf.size * sizeof(T), forWrite))}
+    {}
+
+    Mapped(const Mapped&) = delete;
+    ~Mapped() { unmapBuf(buf.queue->get(), buf.get(), ptr); }
+
+    T *data() const { return ptr; }
+  };
+
+  Mapped map(bool forWrite = false) const { return {*this, forWrite}; }
+};
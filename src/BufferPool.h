@@ -0,0 +1,105 @@
+// Copyright Mihai Preda.
+
+#pragma once
+
+#include "Buffer.h"
+#include "AllocTrac.h"
+#include "log.h"
+
+#include <map>
+#include <memory>
+#include <tuple>
+
+// Transient device buffers (the proof stack, fold(), the P-1 squaring sets) are leased from the Gpu's pool
+// and go back to it when the lease ends, so repeated phases reuse the same cl_mem instead of creating new ones.
+// Free buffers are released when the device gets close to its maxAlloc.
+class BufferPool {
+  template<typename T> using Free = std::multimap<size_t, std::unique_ptr<Buffer<T>>>; // by size
+
+  QueuePtr queue;
+  cl_device_id device;
+  std::tuple<Free<double>, Free<int>> free;
+
+  size_t bytesFree = 0;
+  size_t bytesLeased = 0;
+  size_t highWater = 0;
+
+  // Whether to keep a returned buffer: only while the device is not near its limit.
+  bool keep() const { return AllocTrac::availableBytes(device) >= AllocTrac::maxAllocBytes() / 8; }
+
+  template<typename T> size_t trim(Free<T>& f) {
+    size_t n = 0;
+    for (auto& [size, buf] : f) { n += size * sizeof(T); }
+    f.clear();
+    return n;
+  }
+
+public:
+  template<typename T> class Lease {
+    BufferPool* pool{};
+    std::unique_ptr<Buffer<T>> buf;
+
+  public:
+    Lease(BufferPool* pool, std::unique_ptr<Buffer<T>> buf) : pool{pool}, buf{std::move(buf)} {}
+    Lease(Lease&&) = default;
+    Lease& operator=(Lease&& rhs) {
+      Lease tmp{std::move(*this)};
+      pool = rhs.pool;
+      buf = std::move(rhs.buf);
+      return *this;
+    }
+
+    ~Lease() { if (buf) { pool->giveBack(std::move(buf)); } }
+
+    Buffer<T>& operator*() const { return *buf; }
+    Buffer<T>* operator->() const { return buf.get(); }
+    operator Buffer<T>&() const { return *buf; }
+  };
+
+  BufferPool(QueuePtr queue, cl_device_id device) : queue{queue}, device{device} {}
+
+  ~BufferPool() {
+    assert(!bytesLeased);
+    if (highWater) { log("buffer pool high-water %.1f MB\n", highWater / (1024.0 * 1024)); }
+  }
+
+  template<typename T> Lease<T> take(size_t size, std::string_view name) {
+    size_t bytes = size * sizeof(T);
+    std::unique_ptr<Buffer<T>> buf;
+
+    auto& f = std::get<Free<T>>(free);
+    if (auto it = f.find(size); it != f.end()) {
+      buf = std::move(it->second);
+      f.erase(it);
+      bytesFree -= bytes;
+    } else {
+      if (AllocTrac::availableBytes(device) <= bytes) { trim(); }
+      buf = std::make_unique<Buffer<T>>(queue, name, size);
+    }
+
+    bytesLeased += bytes;
+    highWater = std::max(highWater, bytesLeased + bytesFree);
+    return {this, std::move(buf)};
+  }
+
+  template<typename T> void giveBack(std::unique_ptr<Buffer<T>> buf) {
+    size_t bytes = buf->size * sizeof(T);
+    assert(bytesLeased >= bytes);
+    bytesLeased -= bytes;
+    if (keep()) {
+      std::get<Free<T>>(free).emplace(buf->size, std::move(buf));
+      bytesFree += bytes;
+    }
+  }
+
+  // The number of free buffers of this size, ready to be leased.
+  template<typename T> u32 nFree(size_t size) const { return std::get<Free<T>>(free).count(size); }
+
+  // Releases all the free buffers.
+  void trim() {
+    if (!bytesFree) { return; }
+    size_t released = trim(std::get<Free<double>>(free)) + trim(std::get<Free<int>>(free));
+    assert(released == bytesFree);
+    bytesFree = 0;
+  }
+};
@@ -0,0 +1,69 @@
+// Copyright Mihai Preda.
+
+#include "Calibrate.h"
+#include "Args.h"
+#include "FFTConfig.h"
+#include "Gpu.h"
+#include "GmpUtil.h"
+#include "RoeStats.h"
+#include "common.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace {
+
+vector<FFTConfig> configsToCalibrate(const string& specs) {
+  if (specs == "all") { return FFTConfig::genConfigs(); }
+  vector<FFTConfig> configs;
+  string spec;
+  for (std::istringstream in{specs}; std::getline(in, spec, ',');) { configs.push_back(FFTConfig::fromSpec(spec)); }
+  return configs;
+}
+
+}
+
+void calibrate(const Args& args) {
+  u32 iters = args.iters ? args.iters : 20000;
+
+  for (const FFTConfig& config : configsToCalibrate(args.calibrate)) {
+    u32 fftSize = config.fftSize();
+    // The current limits give the sample exponents, close to the expected new limits.
+    auto current = config.bpwLimits();
+    std::array<double, FFTConfig::N_LEVELS> limits;
+
+    for (u32 level = 0; level < FFTConfig::N_LEVELS; ++level) {
+      auto [mmChain, mm2Chain, ultraTrig] = FFTConfig::chainsForLevel(config.middle, level);
+      Args levelArgs = args;
+      levelArgs.fftSpec = config.spec();
+      for (auto it = levelArgs.flags.begin(); it != levelArgs.flags.end();) {
+        string label = it->substr(0, it->find('='));
+        it = (label == "MM_CHAIN" || label == "MM2_CHAIN" || label == "ULTRA_TRIG") ? levelArgs.flags.erase(it) : next(it);
+      }
+      levelArgs.flags.insert({"ROE1", "ROE2",
+                              "MM_CHAIN=" + to_string(mmChain), "MM2_CHAIN=" + to_string(mm2Chain),
+                              "ULTRA_TRIG=" + to_string(ultraTrig)});
+
+      vector<pair<double, RoeStats>> samples;
+      for (double delta : {-0.3, -0.15, 0.0, 0.15}) {
+        u32 E = nextPrime(u32((current[level] + delta) * fftSize));
+        RoeStats roe = Gpu::make(E, levelArgs)->sampleRoe(iters);
+        log("%s level %u: %u (%.3f bpw) ROE N=%u, mean %f, SD %f, max %f\n",
+            config.spec().c_str(), level, E, double(E) / fftSize, roe.N, roe.mean(), roe.sd(), roe.max);
+        if (roe.N < 2 || roe.sd() == 0) {
+          log("No round-off data for %u\n", E);
+          throw "calibrate: no ROE";
+        }
+        samples.push_back({double(E) / fftSize, roe});
+      }
+
+      // A longer chain should never lower the limit.
+      limits[level] = RoeStats::fitLimit(samples, fftSize, FFTConfig::MIN_BPW, 20, FFTConfig::TARGET_PERR);
+      if (level) { limits[level] = max(limits[level], limits[level - 1]); }
+      log("%s level %u: limit %.3f bpw (was %.3f)\n", config.spec().c_str(), level, limits[level], current[level]);
+    }
+
+    FFTConfig::saveLimits(args.fftLimits, config, limits);
+    log("%s: max exponent %u (was %u)\n", config.spec().c_str(), config.maxExp(), u32(current.back() * fftSize));
+  }
+}
@@ -0,0 +1,9 @@
+// Copyright Mihai Preda.
+
+#pragma once
+
+class Args;
+
+// -calibrate: fits the bits-per-word limit of each MiddleMul chain level of the given FFTs from the round-off error
+// of short runs, and saves them to the -fftLimits file (see FFTConfig::loadLimits()).
+void calibrate(const Args& args);
@@ -0,0 +1,172 @@
+// Copyright Mihai Preda.
+
+#include "Engine.h"
+#include "Args.h"
+#include "Gpu.h"
+#include "GmpUtil.h"
+#include "Ntt.h"
+#include "NttGpu.h"
+#include "FFGpu.h"
+#include "Proof.h"
+#include "Saver.h"
+#include "Signal.h"
+#include "Task.h"
+#include "log.h"
+#include "timeutil.h"
+
+#include <cassert>
+#include <cinttypes>
+
+namespace engine {
+
+template<typename Engine> Words expMul(Engine *engine, const Words& A, u64 h, const Words& B) {
+  if (h == 0) { return B; }
+  auto a = engine->toRes(A);
+  auto r = engine->copyRes(a);
+  for (int i = 62 - __builtin_clzll(h); i >= 0; --i) {
+    engine->squareRes(r);
+    if ((h >> i) & 1) { engine->mulRes(r, a); }
+  }
+  engine->mulRes(r, engine->toRes(B));
+  return engine->fromRes(r);
+}
+
+template<typename Engine> Words expMul2(Engine *engine, const Words& A, u64 h, const Words& B) {
+  auto r = engine->toRes(expMul(engine, A, h, B));
+  engine->mulRes(r, engine->toRes(B));
+  return engine->fromRes(r);
+}
+
+template<typename Engine> Words expExp2(Engine *engine, const Words& A, u32 n) {
+  u32 logStep = 10000;
+  auto r = engine->toRes(A);
+  Timer timer;
+  for (u32 k = 1; k <= n; ++k) {
+    engine->squareRes(r);
+    if (k % logStep == 0) {
+      engine->fromRes(r); // waits for the device
+      log("%u / %u, %.0f us/it\n", k, n, timer.reset() / logStep * 1'000'000);
+    }
+  }
+  return engine->fromRes(r);
+}
+
+template<typename Engine> PRPResult isPrimePRP(Engine *engine, const Args& args, const Task& task) {
+  const u32 E = engine->E;
+  Saver saver{E, args.nSavefiles, args.startFrom, args.mprimeDir, args.saveBudget, args.saveTier};
+  Signal signal;
+  const auto three = engine->toRes(makeWords(E, 3));
+  const u32 kEnd = E;
+
+  u32 nErrors = 0;
+  u32 startK = 0;
+  u32 power = -1;
+
+ reload:
+  // The savefile has the check C of iteration k, without the data of k: data == 3 * C^(2^blockSize - 1).
+  PRPState loaded = saver.loadPRP(args.blockSize);
+  const u32 blockSize = loaded.blockSize;
+  auto check = engine->toRes(loaded.check);
+  auto data = engine->copyRes(check);
+  for (u32 i = 1; i < blockSize; ++i) {
+    engine->squareRes(data);
+    engine->mulRes(data, check);
+  }
+  engine->mulRes(data, three);
+  u64 loadedRes = res64(engine->fromRes(data));
+  if (loadedRes != loaded.res64) {
+    log("EE %9u on-load: %016" PRIx64 " vs. %016" PRIx64 "\n", loaded.k, loadedRes, loaded.res64);
+    throw "error on load";
+  }
+  log("OK %9u on-load: blockSize %u, %016" PRIx64 "\n", loaded.k, blockSize, loaded.res64);
+  u32 k = loaded.k;
+  nErrors = max(nErrors, loaded.nErrors);
+  if (!startK) { startK = k; }
+
+  const u32 checkStep = blockSize * blockSize;
+  const u32 kEndEnd = roundUp(kEnd, blockSize);
+  assert(k < kEnd);
+
+  if (power == u32(-1)) { power = ProofSet::plan(args.tmpDir, E, args.proofPow, startK, 0, 0).power; }
+  ProofSet proofSet{args.tmpDir, E, power, task.knownFactors};
+  u32 persistK = proofSet.next(k);
+
+  bool isPrime = false;
+  u64 finalRes64 = 0;
+  bool skipNextCheckUpdate = false;
+  Timer timer;
+
+  while (true) {
+    if (skipNextCheckUpdate) {
+      skipNextCheckUpdate = false;
+    } else if (k % blockSize == 0) {
+      engine->mulRes(check, data);
+    }
+    engine->squareRes(data);
+    ++k;
+
+    if (k == persistK) {
+      proofSet.save(k, engine->fromRes(data));
+      persistK = proofSet.next(k);
+    }
+
+    if (k == kEnd) {
+      Words words = engine->fromRes(data);
+      isPrime = Gpu::equals9(words);
+      Gpu::doDiv9(E, words);
+      finalRes64 = residue(words);
+      if (!task.knownFactors.empty()) { std::tie(isPrime, finalRes64) = cofactorPRP(E, words, task.knownFactors); }
+      log("%s %8d / %d, %s\n", isPrime ? "PP" : "CC", kEnd, E, hex(finalRes64).c_str());
+    }
+
+    bool doStop = k % blockSize == 0 && (signal.stopRequested() || (args.iters && k - startK >= args.iters));
+    if (!doStop && k % checkStep && k < kEndEnd) {
+      if (k % 10000 == 0) {
+        u64 res = res64(engine->fromRes(data));
+        log("%9u %016" PRIx64 " %.0f us/it\n", k, res, timer.reset() / 10000 * 1'000'000);
+      }
+      continue;
+    }
+
+    // Gerbicz: check^(2^blockSize) * 3 == check * data.
+    Words saved = engine->fromRes(check);
+    auto aux = engine->copyRes(check);
+    for (u32 i = 0; i < blockSize; ++i) { engine->squareRes(aux); }
+    engine->mulRes(aux, three);
+    engine->mulRes(check, data);
+    Words dataWords = engine->fromRes(data);
+    bool ok = (engine->fromRes(aux) == engine->fromRes(check));
+    log("%s %9u %016" PRIx64 "%s\n", ok ? "OK" : "EE", k, res64(dataWords),
+        nErrors ? (" "s + to_string(nErrors) + " errors"s).c_str() : "");
+
+    if (!ok) {
+      if (++nErrors > 2) { throw "too many errors"; }
+      goto reload;
+    }
+    skipNextCheckUpdate = true;
+    if (k < kEnd) { saver.savePRP(PRPState{k, blockSize, res64(dataWords), saved, nErrors}); }
+
+    if (k >= kEndEnd) {
+      optional<ProofInfo> proof;
+      if (power) {
+        proof = proofSet.computeProof(engine).publish(engine, args);
+        if (!proof) { throw "bad proof generation"; }
+      }
+      return {"", isPrime, finalRes64, nErrors, proof};
+    }
+    if (doStop) { throw "stop requested"; }
+  }
+}
+
+#define INSTANTIATE(Engine) \
+  template Words expMul(Engine *, const Words&, u64, const Words&); \
+  template Words expMul2(Engine *, const Words&, u64, const Words&); \
+  template Words expExp2(Engine *, const Words&, u32); \
+  template PRPResult isPrimePRP(Engine *, const Args&, const Task&);
+
+INSTANTIATE(Ntt)
+INSTANTIATE(NttGpu)
+INSTANTIATE(FFGpu)
+#undef INSTANTIATE
+
+}
@@ -0,0 +1,33 @@
+// Copyright Mihai Preda.
+
+#pragma once
+
+#include "common.h"
+
+struct PRPResult;
+class Args;
+class Task;
+
+// The PRP test, and the exponentiations of the proof, of the engines other than Gpu: Ntt, NttGpu and FFGpu.
+// They are written against the engine's residues, "Res", which stay in its own representation (e.g. on the device)
+// between the points where the Words are needed:
+//   Res toRes(const Words&); Words fromRes(const Res&); Res copyRes(const Res&);
+//   void squareRes(Res& a);            // a := a^2
+//   void mulRes(Res& a, const Res& b); // a := a * b
+// and the exponent E.
+namespace engine {
+
+// return A^h * B
+template<typename Engine> Words expMul(Engine *engine, const Words& A, u64 h, const Words& B);
+
+// return A^h * B^2
+template<typename Engine> Words expMul2(Engine *engine, const Words& A, u64 h, const Words& B);
+
+// return A^(2^n)
+template<typename Engine> Words expExp2(Engine *engine, const Words& A, u32 n);
+
+// PRP test of 2^E - 1 from 3, with the Gerbicz check of Gpu::isPrimePRP() every blockSize^2 iterations, the same
+// savefiles, and the same proof.
+template<typename Engine> PRPResult isPrimePRP(Engine *engine, const Args& args, const Task& task);
+
+}
@@ -0,0 +1,200 @@
+// Copyright Mihai Preda.
+
+#include "FFGpu.h"
+#include "Engine.h"
+#include "Args.h"
+#include "FFTConfig.h"
+#include "Gpu.h"
+#include "state.h"
+#include "log.h"
+#include "timeutil.h"
+
+#include <cassert>
+#include <cstring>
+#include <random>
+
+extern const char *FF_SOURCE;
+
+namespace {
+
+// Words carried in sequence by one item of ffCarryA and ffCarryB.
+constexpr u32 CHUNK = 32;
+
+u32 log2Ceil(u32 x) {
+  u32 n = 0;
+  while ((1u << n) < x) { ++n; }
+  return n;
+}
+
+vector<Cx<FF>> conjugate(const vector<Cx<FF>>& v) {
+  vector<Cx<FF>> ret;
+  for (const Cx<FF>& x : v) { ret.push_back(conj(x)); }
+  return ret;
+}
+
+// The inverse weights with the 1/H of the inverse transform, exact as H is a power of two.
+vector<FF> scaledIWeights(const Dwt<FF>& ref, u32 H) {
+  vector<FF> ret;
+  for (FF w : ref.iWeights()) { ret.push_back(scale(w, 1.0f / H)); }
+  return ret;
+}
+
+vector<i64> toI64(const vector<i32>& v) { return {v.begin(), v.end()}; }
+
+cl_program compileFF(const Args& args, cl_context context, cl_device_id id, u32 E, u32 N) {
+  auto define = [](const string& label, u32 value) { return label + '=' + to_string(value) + 'u'; };
+  vector<string> defines{
+    define("EXP", E),
+    define("NWORDS", N),
+    define("H", N / 2),
+    define("STEP", step(N, E)),
+    define("CHUNK", CHUNK),
+    define("NCHUNKS", N / CHUNK),
+  };
+  string clArgs = args.dump.empty() ? ""s : (" -save-temps="s + args.dump + "/ff");
+  cl_program program = compile(context, id, FF_SOURCE, clArgs, defines);
+  if (!program) { throw "OpenCL compilation"; }
+  return program;
+}
+
+}
+
+u32 FFGpu::fftSize(u32 E) {
+  // At least two chunks, and words of at least 2 bits.
+  u32 N = 2 * CHUNK;
+  while (E > FFTConfig::getMaxExpFF(N)) { N *= 2; }
+  if (E < 2 * N) { throw "FF: exponent too small"; }
+  return N;
+}
+
+FFGpu::FFGpu(u32 E, const Args& args) :
+  N{fftSize(E)},
+  ref{E, N},
+  E{E},
+  device{getDevice(args.device)},
+  context{device},
+  program{compileFF(args, context.get(), device, E, N)},
+  queue{Queue::make(context, args.timeKernels, args.cudaYield)},
+
+#define LOAD_WS(name, workSize) name{program.get(), queue, device, #name, roundUp(workSize, 64)}
+  LOAD_WS(ffIn, N / 2),
+  LOAD_WS(ffStage, N / 4),
+  LOAD_WS(ffSquare, N / 2),
+  LOAD_WS(ffMul, N / 2),
+  LOAD_WS(ffCarryA, N / CHUNK),
+  LOAD_WS(ffCarryB, N / CHUNK),
+#undef LOAD_WS
+
+  bufWeights{context, "ffWeights", ref.weights()},
+  bufIWeights{context, "ffIWeights", scaledIWeights(ref, N / 2)},
+  bufRoots{context, "ffRoots", ref.rootsH()},
+  bufIRoots{context, "ffIRoots", conjugate(ref.rootsH())},
+  bufRootsN{context, "ffRootsN", ref.rootsN()},
+  bufA{queue, "ffA", N / 2},
+  bufB{queue, "ffB", N / 2},
+  bufC{queue, "ffC", N / 2},
+  bufCarry{queue, "ffCarry", N / CHUNK},
+  bufRoe{queue, "ffRoe", 1}
+{
+  bufRoe.zero();
+
+  // The device products must be those of the CPU Dwt<FF>, from the same words: a square, then a multiplication of it.
+  Timer timer;
+  std::mt19937 rng{E};
+  auto randomWords = [&]() {
+    Words w((E - 1) / 32 + 1);
+    for (u32& x : w) { x = rng(); }
+    if (E % 32) { w.back() &= (1u << (E % 32)) - 1; }
+    return w;
+  };
+  Words y = randomWords();
+  Res a = toRes(randomWords());
+  vector<i64> x = toI64(a.read());
+  ref.square(x);
+  squareRes(a);
+  vector<i32> x2 = a.read();
+  bool ok = fromRes(a) == compactBits(vector<int>{x.begin(), x.end()}, E);
+  if (ok) {
+    x = toI64(x2);
+    ref.mul(x, toI64(expandBits(y, N, E)));
+    mulRes(a, toRes(y));
+    ok = fromRes(a) == compactBits(vector<int>{x.begin(), x.end()}, E);
+  }
+  if (!ok) {
+    log("FF device products differ from the CPU Dwt\n");
+    throw "FF device check";
+  }
+  maxRoe = 0;
+  log("FF %u words (%.2f bits/word) on the device, checked against the CPU in %.1fs\n",
+      N, double(E) / N, timer.reset());
+}
+
+Buffer<Cx<FF>>& FFGpu::transform(Buffer<Cx<FF>>& x, Buffer<Cx<FF>>& tmp, const ConstBuffer<Cx<FF>>& roots) {
+  Buffer<Cx<FF>> *in = &x, *out = &tmp;
+  for (u32 t = 0, logH = log2Ceil(N / 2); t < logH; ++t) {
+    ffStage(*out, *in, roots, t);
+    std::swap(in, out);
+  }
+  return *in;
+}
+
+float FFGpu::readRoe() {
+  u32 bits = bufRoe.read()[0];
+  bufRoe.zero();
+  float roe;
+  memcpy(&roe, &bits, sizeof(roe));
+  return roe;
+}
+
+FFGpu::Res FFGpu::toRes(const Words& words) {
+  Res a{queue, "ffRes", N};
+  a.write(expandBits(words, N, E));
+  return a;
+}
+
+Words FFGpu::fromRes(const Res& a) {
+  Words words = compactBits(a.read(), E);
+  float roe = readRoe();
+  if (roe > maxRoe) {
+    maxRoe = roe;
+    if (roe > 0.25f) { log("FF max ROE %.3f\n", roe); }
+  }
+  return words;
+}
+
+FFGpu::Res FFGpu::copyRes(const Res& a) {
+  Res b{queue, "ffRes", N};
+  b << a;
+  return b;
+}
+
+void FFGpu::squareRes(Res& a) {
+  ffIn(bufA, a, bufWeights);
+  Buffer<Cx<FF>>& x = transform(bufA, bufB, bufRoots);
+  Buffer<Cx<FF>>& y = &x == &bufA ? bufB : bufA;
+  ffSquare(y, x, bufRootsN);
+  Buffer<Cx<FF>>& z = transform(y, x, bufIRoots);
+  ffCarryA(a, bufCarry, bufRoe, z, bufIWeights);
+  ffCarryB(a, bufCarry);
+}
+
+void FFGpu::mulRes(Res& a, const Res& b) {
+  ffIn(bufC, b, bufWeights);
+  Buffer<Cx<FF>>& yb = transform(bufC, bufB, bufRoots);
+  Buffer<Cx<FF>>& tmp = &yb == &bufC ? bufB : bufC;
+  ffIn(bufA, a, bufWeights);
+  Buffer<Cx<FF>>& x = transform(bufA, tmp, bufRoots);
+  Buffer<Cx<FF>>& y = &x == &bufA ? tmp : bufA;
+  ffMul(y, x, yb, bufRootsN);
+  Buffer<Cx<FF>>& z = transform(y, x, bufIRoots);
+  ffCarryA(a, bufCarry, bufRoe, z, bufIWeights);
+  ffCarryB(a, bufCarry);
+}
+
+Words FFGpu::expMul(const Words& A, u64 h, const Words& B) { return engine::expMul(this, A, h, B); }
+
+Words FFGpu::expMul2(const Words& A, u64 h, const Words& B) { return engine::expMul2(this, A, h, B); }
+
+Words FFGpu::expExp2(const Words& A, u32 n) { return engine::expExp2(this, A, n); }
+
+PRPResult FFGpu::isPrimePRP(const Args& args, const Task& task) { return engine::isPrimePRP(this, args, task); }
@@ -0,0 +1,75 @@
+// Copyright Mihai Preda.
+
+#pragma once
+
+#include "Buffer.h"
+#include "Context.h"
+#include "Queue.h"
+
+#include "common.h"
+#include "kernel.h"
+#include "dwt.h"
+
+struct PRPResult;
+class Args;
+class Task;
+
+// The float-float ("FF") squaring on the device (ff.cl), for GPUs with a low FP64 rate: N balanced words in the
+// irrational-base DWT of the FP64 path, with a FF transform of N/2 complex points. The CPU Dwt<FF> (dwt.h) is its
+// reference, which it checks itself against on construction. N is the smallest power of two within the FF limits
+// of FFTConfig::getMaxExpFF().
+class FFGpu {
+  const u32 N;
+  Dwt<FF> ref;
+
+public:
+  const u32 E;
+
+private:
+  cl_device_id device;
+  Context context;
+  Holder<cl_program> program;
+  QueuePtr queue;
+
+  Kernel ffIn, ffStage, ffSquare, ffMul, ffCarryA, ffCarryB;
+
+  ConstBuffer<FF> bufWeights, bufIWeights;
+  ConstBuffer<Cx<FF>> bufRoots, bufIRoots, bufRootsN;
+  Buffer<Cx<FF>> bufA, bufB, bufC;
+  Buffer<i64> bufCarry;
+  HostAccessBuffer<u32> bufRoe;
+  float maxRoe = 0;
+
+  // Transforms "x" with "tmp", leaving the result in the one returned.
+  Buffer<Cx<FF>>& transform(Buffer<Cx<FF>>& x, Buffer<Cx<FF>>& tmp, const ConstBuffer<Cx<FF>>& roots);
+
+  // The max round-off error since the last call.
+  float readRoe();
+
+public:
+  // The FFT size (words) of the FF engine for E.
+  static u32 fftSize(u32 E);
+
+  FFGpu(u32 E, const Args& args);
+
+  u32 getFFTSize() const { return N; }
+
+  // The residues of the engine interface (Engine.h), as the balanced words.
+  using Res = HostAccessBuffer<i32>;
+  Res toRes(const Words& words);
+  Words fromRes(const Res& a);
+  Res copyRes(const Res& a);
+  void squareRes(Res& a);
+  void mulRes(Res& a, const Res& b);
+
+  // return A^h * B
+  Words expMul(const Words& A, u64 h, const Words& B);
+
+  // return A^h * B^2
+  Words expMul2(const Words& A, u64 h, const Words& B);
+
+  // return A^(2^n)
+  Words expExp2(const Words& A, u32 n);
+
+  PRPResult isPrimePRP(const Args& args, const Task& task);
+};
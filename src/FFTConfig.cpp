@@ -1,6 +1,7 @@
 // Copyright (C) Mihai Preda.
 
 #include "FFTConfig.h"
+#include "File.h"
 #include "common.h"
 
 #include <cmath>
@@ -8,6 +9,7 @@
 #include <vector>
 #include <algorithm>
 #include <string>
+#include <map>
 
 using namespace std;
 
@@ -56,28 +58,95 @@ static double chain_savings[16][7] = {
   {0.0962, 0.1925, 0.0924, 0.0280, 0.0327, 0.0113, 0.0176+0.0058},	// MIDDLE=14
   {0.1045, 0.2090, 0.0897, 0.0413, 0.0358, 0.0094, 0.0176+0.0154}};	// MIDDLE=15
 
-tuple<u32,u32,bool> FFTConfig::getChainLengths(u32 fftSize, u32 exponent, u32 middle) {
-  i32 i;
-  u32 maxExp = getMaxExp(fftSize, middle);
-  double max_bits_per_word = double(maxExp) / double(fftSize);
-  double bits_per_word = double(exponent) / double(fftSize);
-  for (i = 6; i >= 0; i--) {
-    // log("bits %d %f %f\n", i, bits_per_word, max_bits_per_word);
-    max_bits_per_word -= chain_savings[middle][i];
-    if (bits_per_word >= max_bits_per_word) { break; }
-  }
-  
-  auto [mm_chain, mm2_chain] = vector<pair<u32,u32>>{{0, 0}, {0, 1}, {1, 1}, {1, 2}, {2, 2}, {2, 3}, {3, 3}, {3, 3}}[i + 1];
+tuple<u32,u32,bool> FFTConfig::chainsForLevel(u32 middle, u32 level) {
+  assert(level < N_LEVELS);
+  auto [mm_chain, mm2_chain] = vector<pair<u32,u32>>{{0, 0}, {0, 1}, {1, 1}, {1, 2}, {2, 2}, {2, 3}, {3, 3}, {3, 3}}[level];
   if (middle <= 6 && mm2_chain == 3) { mm2_chain = 2; } // For MIDDLE=3-6, mm2_chain=2 is better than mm2_chain=3
   if ((middle == 5 || middle == 7) && mm_chain == 3) { mm_chain = 2; } // For MIDDLE=5,7, mm_chain=2 is better than mm_chain=3
 
-  bool ultra_trig = (i == 7);
+  bool ultra_trig = (level == N_LEVELS - 1);
 
   return {mm_chain, mm2_chain, ultra_trig};
 }
 
 namespace {
 
+// The limits from -calibrate, by (width, middle, height). Loaded at start-up, before any Gpu is created.
+map<tuple<u32, u32, u32>, array<double, FFTConfig::N_LEVELS>>& limitsTable() {
+  static map<tuple<u32, u32, u32>, array<double, FFTConfig::N_LEVELS>> table;
+  return table;
+}
+
+string limitsLine(const FFTConfig& config, const array<double, FFTConfig::N_LEVELS>& limits) {
+  string line = config.spec();
+  for (double x : limits) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), " %.3f", x);
+    line += buf;
+  }
+  return line + '\n';
+}
+
+}
+
+array<double, FFTConfig::N_LEVELS> FFTConfig::bpwLimits() const {
+  if (auto it = limitsTable().find({width, middle, height}); it != limitsTable().end()) { return it->second; }
+
+  array<double, N_LEVELS> limits;
+  u32 size = fftSize();
+  limits[N_LEVELS - 1] = double(getMaxExp(size, middle)) / size;
+  for (int i = N_LEVELS - 2; i >= 0; --i) { limits[i] = limits[i + 1] - chain_savings[middle][i]; }
+  return limits;
+}
+
+u32 FFTConfig::chainLevel(u32 exponent) const {
+  auto limits = bpwLimits();
+  double bpw = double(exponent) / fftSize();
+  u32 level = 0;
+  while (level < N_LEVELS - 1 && bpw >= limits[level]) { ++level; }
+  return level;
+}
+
+void FFTConfig::loadLimits(const fs::path& path) {
+  File fi = File::openRead(path);
+  if (!fi) { return; }
+
+  u32 n = 0;
+  for (string line = fi.readLine(); !line.empty(); line = fi.readLine()) {
+    char spec[64];
+    array<double, N_LEVELS> x;
+    if (sscanf(line.c_str(), "%63s %lf %lf %lf %lf %lf %lf %lf %lf",
+               spec, &x[0], &x[1], &x[2], &x[3], &x[4], &x[5], &x[6], &x[7]) != 1 + N_LEVELS
+        || string(spec).find(':') == string::npos) {
+      log("%s: ignoring line '%s'\n", fi.name.c_str(), rstripNewline(line).c_str());
+      continue;
+    }
+    FFTConfig c = fromSpec(spec);
+    limitsTable()[{c.width, c.middle, c.height}] = x;
+    ++n;
+  }
+  log("Loaded the limits of %u FFTs from '%s'\n", n, fi.name.c_str());
+}
+
+void FFTConfig::saveLimits(const fs::path& path, const FFTConfig& config, const array<double, N_LEVELS>& limits) {
+  // Keep the lines of the other FFTs.
+  string text;
+  if (File fi = File::openRead(path)) {
+    string prefix = config.spec() + ' ';
+    for (string line = fi.readLine(); !line.empty(); line = fi.readLine()) {
+      if (line.rfind(prefix, 0) != 0) { text += line; }
+    }
+  }
+  text += limitsLine(config, limits);
+
+  fs::path tmp = path + ".new";
+  File::openWrite(tmp).write(text);
+  fs::rename(tmp, path);
+  limitsTable()[{config.width, config.middle, config.height}] = limits;
+}
+
+namespace {
+
 u32 parseInt(const string& s) {
   if (s.empty()) { return 1; }
   char c = s.back();
@@ -4,10 +4,12 @@
 
 #include "common.h"
 
+#include <array>
 #include <string>
 #include <tuple>
 #include <vector>
 #include <cmath>
+#include <filesystem>
 
 // Format 'n' with a K or M suffix if multiple of 1024 or 1024*1024
 string numberK(u32 n);
@@ -15,6 +17,12 @@ string numberK(u32 n);
 struct FFTConfig {
   static constexpr const float MIN_BPW = 6;
 
+  // The MiddleMul chain "levels", from no chains (0) to MM_CHAIN=3 MM2_CHAIN=3 ULTRA_TRIG (7); see chainsForLevel().
+  static constexpr const u32 N_LEVELS = 8;
+
+  // The pErr targeted by the max exponent of a FFT and by the chain crossovers.
+  static constexpr const double TARGET_PERR = 0.002;
+
   // On 2020-03-30, I examined the middle=10 FFTs from 1.25M to 80M.
   // On this date, exponent 95460001 had an average roundoff error of 0.2441.
   // This should be periodically tested to make sure rocm optimizer hasn't made accuracy worse.
@@ -52,10 +60,20 @@ struct FFTConfig {
                 middle == 14 ? fftSize * (18.4451 - 0.279 * log2(fftSize / (7.0 * 1024 * 1024))) :
 			       fftSize * (18.3804 - 0.279 * log2(fftSize / (7.5 * 1024 * 1024))); }
   
+  // The float-float FFT of FFGpu (ff.cl), at or below the limits of its CPU reference at the TARGET_PERR,
+  // "ffcheck limits 1024 4096 16384 65536": 19.846, 19.401, 18.694, 18.083 bpw; about 2.1 bpw below FP64.
+  static u32 getMaxExpFF(u32 fftSize) { return fftSize * (19.84 - 0.30 * log2(fftSize / 1024.0)); }
+
   static u32 getMaxCarry32(u32 fftSize, u32 exponent);
   static std::vector<FFTConfig> genConfigs();
 
-  static tuple<u32, u32, bool> getChainLengths(u32 fftSize, u32 exponent, u32 middle);
+  // MM_CHAIN, MM2_CHAIN, ULTRA_TRIG
+  static tuple<u32, u32, bool> chainsForLevel(u32 middle, u32 level);
+
+  // The bits-per-word limits measured by -calibrate, replacing getMaxExp() and chain_savings for the FFTs they cover.
+  // Lines of "<width>:<middle>:<height>" followed by the N_LEVELS limits.
+  static void loadLimits(const fs::path& path);
+  static void saveLimits(const fs::path& path, const FFTConfig& config, const std::array<double, N_LEVELS>& limits);
 
   // FFTConfig(u32 w, u32 m, u32 h) : width(w), middle(m), height(h) {}
   static FFTConfig fromSpec(const string& spec);
@@ -65,6 +83,12 @@ struct FFTConfig {
   u32 height = 0;
     
   u32 fftSize() const { return width * height * middle * 2; }
-  u32 maxExp() const { return getMaxExp(fftSize(), middle); }
+  u32 maxExp() const { return u32(bpwLimits()[N_LEVELS - 1] * fftSize() + 0.5); }
+
+  // The max bits-per-word at each chain level, from the loaded limits if present or else from the hard-coded fits.
+  std::array<double, N_LEVELS> bpwLimits() const;
+
+  // The lowest chain level that is accurate enough for this exponent.
+  u32 chainLevel(u32 exponent) const;
   std::string spec() const { return numberK(width) + ':' + numberK(middle) + ':' + numberK(height); }
 };
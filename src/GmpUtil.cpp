@@ -89,9 +89,52 @@ vector<bool> powerSmoothBE(u32 exp, u32 B1) { return bitsBE(powerSmooth(exp, B1)
 
 vector<bool> powerSmoothLE(u32 exp, u32 B1, u32 blockSize) { return bitsLE(powerSmooth(exp, B1), blockSize); }
 
-int jacobi(u32 exp, const std::vector<u32>& words) {
+namespace {
+
+mpz_class product(const vector<string>& factors) {
+  mpz_class p{1};
+  for (const string& f : factors) { p *= mpz_class{f}; }
+  return p;
+}
+
+}
+
+bool areFactors(u32 exp, const vector<string>& factors) {
+  mpz_class m = (mpz_class{1} << exp) - 1;
+  for (const string& f : factors) {
+    mpz_class factor;
+    if (f.empty() || f.find_first_not_of("0123456789") != string::npos || factor.set_str(f, 10)
+        || factor <= 1 || factor >= m || !mpz_divisible_p(m.get_mpz_t(), factor.get_mpz_t())) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::pair<bool, u64> cofactorPRP(u32 exp, const std::vector<u32>& type1, const vector<string>& factors) {
+  mpz_class F = product(factors);
+  mpz_class C = ((mpz_class{1} << exp) - 1) / F;
+  mpz_class r = mpz(type1) % C;
+
+  mpz_class expected;
+  mpz_class base{3};
+  mpz_class e = F - 1;
+  mpz_powm(expected.get_mpz_t(), base.get_mpz_t(), e.get_mpz_t(), C.get_mpz_t());
+
+  mpz_class low = r & ((mpz_class{1} << 64) - 1);
+  u64 res64 = (u64(mpz_class{low >> 32}.get_ui()) << 32) | mpz_class{low & 0xffffffffu}.get_ui();
+  return {r == expected, res64};
+}
+
+int jacobi(u32 exp, const std::vector<u32>& words, u32 sub) {
   assert(!words.empty());
-  mpz_class w = mpz(words);
+  mpz_class w = mpz(words) - sub;
   mpz_class m = (mpz_class{1} << exp) - 1;
   return mpz_jacobi(w.get_mpz_t(), m.get_mpz_t());
 }
+
+u32 nextPrime(u32 x) {
+  mpz_class p{x};
+  mpz_nextprime(p.get_mpz_t(), p.get_mpz_t());
+  return p.get_ui();
+}
@@ -20,8 +20,16 @@ vector<bool> powerSmoothLE(u32 exp, u32 B1, u32 blockSize = 1);
 // Bitlen of powerSmooth
 u32 powerSmoothBits(u32 exp, u32 B1);
 
-// Returns jacobi-symbol(words, 2**exp - 1)
-int jacobi(u32 exp, const std::vector<u32>& words);
+// Returns jacobi-symbol(words - sub, 2**exp - 1)
+int jacobi(u32 exp, const std::vector<u32>& words, u32 sub = 0);
+
+// True if each of the decimal "factors" is a proper factor of 2**exp - 1.
+bool areFactors(u32 exp, const vector<string>& factors);
+
+// PRP of the cofactor C = (2**exp - 1) / product(factors), from the type-1 residue 3^(2**exp - 2) mod 2**exp - 1.
+// C is a base-3 Fermat PRP iff (type1 mod C) == 3^(F - 1) mod C, where F = product(factors).
+// Returns the PRP status and the res64 of the type-5 residue (type1 mod C).
+std::pair<bool, u64> cofactorPRP(u32 exp, const std::vector<u32>& type1, const vector<string>& factors);
 
 inline mpz_class mpz64(u64 h) {
   mpz_class ret{u32(h >> 32)};
@@ -34,3 +42,6 @@ inline mpz_class mpz64(u64 h) {
 vector<u32> factorize(const string& str, u32 exponent, u32 B1, u32 B2);
 
 double log2(const string& str);
+
+// The smallest prime greater than x.
+u32 nextPrime(u32 x);
@@ -12,6 +12,8 @@
 #include "Queue.h"
 #include "Task.h"
 #include "Memlock.h"
+#include "Lookahead.h"
+#include "Trig.h"
 
 #define _USE_MATH_DEFINES
 #include <cmath>
@@ -24,6 +26,8 @@
 #include <limits>
 #include <iomanip>
 #include <array>
+#include <map>
+#include <mutex>
 
 #ifndef M_PIl
 #define M_PIl 3.141592653589793238462643383279502884L
@@ -40,38 +44,8 @@ extern const char *CL_SOURCE;
 
 using float3 = tuple<float, float, float>;
 
-struct Weights {
-  vector<double> threadWeightsIF;  
-  vector<double> carryWeightsIF;
-  vector<u32> bitsCF;
-  vector<u32> bitsC;
-};
-
 namespace {
 
-// Returns the primitive root of unity of order N, to the power k.
-
-template<typename T>
-pair<T, T> root1(u32 N, u32 k) {
-  assert(k < N);
-  if (k >= N/2) {
-    auto [c, s] = root1<T>(N, k - N/2);
-    return {-c, -s};
-  } else if (k > N/4) {
-    auto [c, s] = root1<T>(N, N/2 - k);
-    return {-c, s};
-  } else if (k > N/8) {
-    auto [c, s] = root1<T>(N, N/4 - k);
-    return {-s, -c};
-  } else {
-    assert(!(N&7));
-    assert(k <= N/8);
-    N /= 2;
-    auto angle = - M_PIl * k / N;
-    return {cosl(angle), sinl(angle)};
-  }
-}
-
 double2 *smallTrigBlock(u32 W, u32 H, double2 *p) {
   for (u32 line = 1; line < H; ++line) {
     for (u32 col = 0; col < W; ++col) {
@@ -81,7 +55,7 @@ double2 *smallTrigBlock(u32 W, u32 H, double2 *p) {
   return p;
 }
 
-ConstBuffer<double2> genSmallTrig(const Context& context, u32 size, u32 radix) {
+vector<double2> genSmallTrig(u32 size, u32 radix) {
   vector<double2> tab;
 
   // smallTrigBlock(size / radix, 2, tab.data());
@@ -98,10 +72,10 @@ ConstBuffer<double2> genSmallTrig(const Context& context, u32 size, u32 radix) {
   for (u32 w = radix; w < size; w *= radix) { p = smallTrigBlock(w, std::min(radix, size / w), p); }
   assert(p - tab.data() == size);
   */
-  return {context, "smallTrig", tab};
+  return tab;
 }
 
-ConstBuffer<double2> genMiddleTrig(const Context& context, u32 smallH, u32 middle) {
+vector<double2> genMiddleTrig(u32 smallH, u32 middle) {
   vector<double2> tab;
   if (middle == 1) {
     tab.resize(1);
@@ -111,25 +85,6 @@ ConstBuffer<double2> genMiddleTrig(const Context& context, u32 smallH, u32 middl
     auto *p = smallTrigBlock(smallH, middle, tab.data());
     assert(p - tab.data() == size);
   }
-  return {context, "middleTrig", tab};
-}
-
-template<typename T>
-vector<pair<T, T>> makeTrig(u32 n) {
-  assert(n % 8 == 0);
-  vector<pair<T, T>> tab;
-  tab.reserve(n/8 + 1);
-  for (u32 k = 0; k <= n/8; ++k) { tab.push_back(root1<T>(n, k)); }
-  return tab;
-}
-
-template<typename T>
-vector<pair<T, T>> makeTinyTrig(u32 W, u32 hN) {
-  vector<pair<T, T>> tab;
-  for (u32 k = 0; k <= W/2; ++k) {
-    auto[c, s] = root1<f128>(hN, k);
-    tab.push_back({c - 1, s});
-  }
   return tab;
 }
 
@@ -260,6 +215,36 @@ struct Define {
   operator string() const { return str; }
 };
 
+// The trig tables depend only on the FFT shape, so they are shared between the Gpus of this process
+// (e.g. the per-device workers, or the next task when the prepared one did not match).
+TrigTables sharedTrig(u32 W, u32 SMALL_H, u32 MIDDLE, u32 nW, u32 nH) {
+  static std::mutex mutex;
+  static map<tuple<u32, u32, u32, u32, u32>, std::shared_future<TrigTables>> cache;
+
+  auto key = tuple{W, SMALL_H, MIDDLE, nW, nH};
+  std::promise<TrigTables> promise;
+  std::shared_future<TrigTables> tables;
+  {
+    std::lock_guard lock(mutex);
+    if (auto it = cache.find(key); it != cache.end()) {
+      tables = it->second;
+    } else {
+      if (cache.size() >= 4) { cache.erase(cache.begin()); }
+      cache.emplace(key, promise.get_future().share());
+    }
+  }
+  // Possibly wait for the generation started by another thread.
+  if (tables.valid()) { return tables.get(); }
+
+  u32 BIG_H = SMALL_H * MIDDLE;
+  u32 hN = W * BIG_H;
+  TrigTables trig{genSmallTrig(W, nW), genSmallTrig(SMALL_H, nH), genMiddleTrig(SMALL_H, MIDDLE),
+                  makeTrig<double>(2 * SMALL_H), makeTrig<double>(BIG_H), makeTrig<double>(hN),
+                  makeTinyTrig<double>(W, hN)};
+  promise.set_value(trig);
+  return trig;
+}
+
 cl_program compile(const Args& args, cl_context context, cl_device_id id, u32 N, u32 E, u32 WIDTH, u32 SMALL_HEIGHT, u32 MIDDLE, u32 nW) {
   string clArgs = args.dump.empty() ? ""s : (" -save-temps="s + args.dump + "/" + numberK(N));
   if (!args.safeMath) { clArgs += " -cl-unsafe-math-optimizations"; }
@@ -277,11 +262,15 @@ cl_program compile(const Args& args, cl_context context, cl_device_id id, u32 N,
   if (FFTConfig::getMaxCarry32(N, E) > 0x6C00) { defines.push_back({"CARRY64", 1}); }
 
   // If we are near the maximum exponent for this FFT, then we may need to set some chain #defines
-  // to reduce the round off errors.
-  auto [mm_chain, mm2_chain, ultra_trig] = FFTConfig::getChainLengths(N, E, MIDDLE);
-  if (mm_chain) { defines.push_back({"MM_CHAIN", mm_chain}); }
-  if (mm2_chain) { defines.push_back({"MM2_CHAIN", mm2_chain}); }
-  if (ultra_trig) { defines.push_back({"ULTRA_TRIG", 1}); }
+  // to reduce the round off errors. A chain set with -use (e.g. by -calibrate) takes precedence.
+  auto isSet = [&args](const string& label) {
+    return std::any_of(args.flags.begin(), args.flags.end(), [&label](const string& f) { return f.substr(0, f.find('=')) == label; });
+  };
+  u32 level = FFTConfig{WIDTH, MIDDLE, SMALL_HEIGHT}.chainLevel(E);
+  auto [mm_chain, mm2_chain, ultra_trig] = FFTConfig::chainsForLevel(MIDDLE, level);
+  if (mm_chain && !isSet("MM_CHAIN")) { defines.push_back({"MM_CHAIN", mm_chain}); }
+  if (mm2_chain && !isSet("MM2_CHAIN")) { defines.push_back({"MM2_CHAIN", mm2_chain}); }
+  if (ultra_trig && !isSet("ULTRA_TRIG")) { defines.push_back({"ULTRA_TRIG", 1}); }
 
   defines.push_back({"WEIGHT_STEP", double(weight(N, E, SMALL_HEIGHT * MIDDLE, 0, 0, 1) - 1)});
   defines.push_back({"IWEIGHT_STEP", double(invWeight(N, E, SMALL_HEIGHT * MIDDLE, 0, 0, 1) - 1)});
@@ -326,29 +315,25 @@ cl_program compile(const Args& args, cl_context context, cl_device_id id, u32 N,
 
 }
 
-Gpu::Gpu(const Args& args, u32 E, u32 W, u32 BIG_H, u32 SMALL_H, u32 nW, u32 nH,
-         cl_device_id device, bool timeKernels, bool useLongCarry)
-  : Gpu{args, E, W, BIG_H, SMALL_H, nW, nH, device, timeKernels, useLongCarry, genWeights(E, W, BIG_H, nW)}
-{}
-
 using float2 = pair<float, float>;
 
 #define ROE_SIZE 111000
+// Words per chunk in the device compaction kernels, must match gpuowl.cl
+#define COMPACT_CHUNK 64
 
-Gpu::Gpu(const Args& args, u32 E, u32 W, u32 BIG_H, u32 SMALL_H, u32 nW, u32 nH,
-         cl_device_id device, bool timeKernels, bool useLongCarry, Weights&& weights) :
-  E(E),
-  N(W * BIG_H * 2),
+Gpu::Gpu(const Args& args, GpuSetup&& setup) :
+  E(setup.E),
+  N(setup.W * setup.BIG_H * 2),
   hN(N / 2),
-  nW(nW),
-  nH(nH),
+  nW(setup.nW),
+  nH(setup.nH),
   bufSize(N * sizeof(double)),
-  WIDTH(W),
-  useLongCarry(useLongCarry),
-  timeKernels(timeKernels),
-  device(device),
-  context{device},
-  program(compile(args, context.get(), device, N, E, W, SMALL_H, BIG_H / SMALL_H, nW)),
+  WIDTH(setup.W),
+  useLongCarry(setup.useLongCarry),
+  timeKernels(args.timeKernels),
+  device(setup.device),
+  context{std::move(setup.context)},
+  program{std::move(setup.program)},
   queue(Queue::make(context, timeKernels, args.cudaYield)),
 
   // Specifies size in number of workgroups
@@ -356,56 +341,69 @@ Gpu::Gpu(const Args& args, u32 E, u32 W, u32 BIG_H, u32 SMALL_H, u32 nW, u32 nH,
   // Specifies size in "work size": workSize == nGroups * groupSize
 #define LOAD_WS(name, workSize) name{program.get(), queue, device, #name, workSize}
   
-  LOAD(kernCarryFused,    BIG_H + 1),
-  LOAD(kernCarryFusedMul, BIG_H + 1),
-  LOAD(fftP, BIG_H),
-  LOAD(fftW,   BIG_H),
-  LOAD(fftHin,  hN / SMALL_H),
-  LOAD(fftHout, hN / SMALL_H),
-  LOAD_WS(fftMiddleIn,  hN / (BIG_H / SMALL_H)),
-  LOAD_WS(fftMiddleOut, hN / (BIG_H / SMALL_H)),
+  LOAD(kernCarryFused,    setup.BIG_H + 1),
+  LOAD(kernCarryFusedMul, setup.BIG_H + 1),
+  LOAD(kernCarryFusedLL,  setup.BIG_H + 1),
+  LOAD(fftP, setup.BIG_H),
+  LOAD(fftW,   setup.BIG_H),
+  LOAD(fftHin,  hN / setup.SMALL_H),
+  LOAD(fftHout, hN / setup.SMALL_H),
+  LOAD_WS(fftMiddleIn,  hN / (setup.BIG_H / setup.SMALL_H)),
+  LOAD_WS(fftMiddleOut, hN / (setup.BIG_H / setup.SMALL_H)),
   LOAD_WS(kernCarryA,  hN / CARRY_LEN),
   LOAD_WS(kernCarryM,  hN / CARRY_LEN),
+  LOAD_WS(kernCarryLL, hN / CARRY_LEN),
   LOAD_WS(carryB,  hN / CARRY_LEN),
-  LOAD(transposeW,   (W/64) * (BIG_H/64)),
-  LOAD(transposeH,   (W/64) * (BIG_H/64)),
-  LOAD(transposeIn,  (W/64) * (BIG_H/64)),
-  LOAD(transposeOut, (W/64) * (BIG_H/64)),
-  LOAD(kernelMultiply,      hN / SMALL_H),
-  LOAD(kernelMultiplyDelta, hN / SMALL_H),
-  LOAD(tailFusedSquare,   hN / SMALL_H / 2),
-  LOAD(tailFusedMulDelta, hN / SMALL_H / 2),
-  LOAD(tailFusedMulLow,   hN / SMALL_H / 2),
-  LOAD(tailFusedMul,      hN / SMALL_H / 2),
-  LOAD(tailSquareLow,     hN / SMALL_H / 2),
-  LOAD(tailMulLowLow,     hN / SMALL_H / 2),
+  LOAD(transposeW,   (setup.W/64) * (setup.BIG_H/64)),
+  LOAD(transposeH,   (setup.W/64) * (setup.BIG_H/64)),
+  LOAD(transposeIn,  (setup.W/64) * (setup.BIG_H/64)),
+  LOAD(transposeOut, (setup.W/64) * (setup.BIG_H/64)),
+  LOAD(kernelMultiply,      hN / setup.SMALL_H),
+  LOAD(kernelMultiplyDelta, hN / setup.SMALL_H),
+  LOAD(tailFusedSquare,   hN / setup.SMALL_H / 2),
+  LOAD(tailFusedMulDelta, hN / setup.SMALL_H / 2),
+  LOAD(tailFusedMulLow,   hN / setup.SMALL_H / 2),
+  LOAD(tailFusedMul,      hN / setup.SMALL_H / 2),
+  LOAD(tailSquareLow,     hN / setup.SMALL_H / 2),
+  LOAD(tailMulLowLow,     hN / setup.SMALL_H / 2),
   LOAD(readResidue, 1),
   LOAD(isNotZero, 256),
   LOAD(isEqual, 256),
   LOAD(sum64, 256),
+  LOAD(compactCarry, (N / COMPACT_CHUNK + 63) / 64),
+  LOAD(compactScan, 1),
+  LOAD(compactPack, (N / COMPACT_CHUNK + 63) / 64),
+  LOAD(roeHist, 16),
 #undef LOAD_WS
 #undef LOAD
 
-  bufTrigW{genSmallTrig(context, W, nW)},
-  bufTrigH{genSmallTrig(context, SMALL_H, nH)},
-  bufTrigM{genMiddleTrig(context, SMALL_H, BIG_H / SMALL_H)},
-  bufBits{context, "bits", weights.bitsCF},
-  bufBitsC{context, "bitsC", weights.bitsC},
+  bufTrigW{context, "smallTrig", setup.trig.smallW},
+  bufTrigH{context, "smallTrig", setup.trig.smallH},
+  bufTrigM{context, "middleTrig", setup.trig.middle},
+  bufBits{context, "bits", setup.weights.bitsCF},
+  bufBitsC{context, "bitsC", setup.weights.bitsC},
   bufData{queue, "data", N},
   bufAux{queue, "aux", N},
+  bufStage{queue, "stage", N},
   bufCheck{queue, "check", N},
   bufBase{queue, "base", N},
   bufCarry{queue, "carry", N / 2},
-  bufReady{queue, "ready", BIG_H},
+  bufReady{queue, "ready", setup.BIG_H},
   bufCarryMax{queue, "carryMax", 8},
   bufCarryMulMax{queue, "carryMulMax", 8},
   bufSmallOut{queue, "smallOut", 256},
   bufSumOut{queue, "sumOut", 1},
+  bufChunkBorrow{queue, "chunkBorrow", 2 * (N / COMPACT_CHUNK)},
+  bufBorrowIn{queue, "borrowIn", N / COMPACT_CHUNK},
+  bufWrapBorrow{queue, "wrapBorrow", 1},
+  bufPacked{queue, "packed", ((E - 1) / 32 + 2) / 2 * 2}, // even, for sum64
   bufROE{queue, "ROE", ROE_SIZE},
   roePos{0},
+  bufRoeHist{queue, "roeHist", RoeStats::NBINS + 1},
   buf1{queue, "buf1", N},
   buf2{queue, "buf2", N},
   buf3{queue, "buf3", N},
+  pool{queue, device},
   usesROE1{args.uses("ROE1")},
   usesROE2{args.uses("ROE2")},
   args{args}
@@ -414,6 +412,7 @@ Gpu::Gpu(const Args& args, u32 E, u32 W, u32 BIG_H, u32 SMALL_H, u32 nW, u32 nH,
   
   kernCarryFused.setFixedArgs(   3, bufCarry, bufReady, bufTrigW, bufBits, bufROE, bufCarryMax);
   kernCarryFusedMul.setFixedArgs(3, bufCarry, bufReady, bufTrigW, bufBits, bufROE, bufCarryMulMax);
+  kernCarryFusedLL.setFixedArgs( 3, bufCarry, bufReady, bufTrigW, bufBits, bufROE, bufCarryMax);
   fftP.setFixedArgs(2, bufTrigW);
   fftW.setFixedArgs(2, bufTrigW);
   fftHin.setFixedArgs(2, bufTrigH);
@@ -423,6 +422,7 @@ Gpu::Gpu(const Args& args, u32 E, u32 W, u32 BIG_H, u32 SMALL_H, u32 nW, u32 nH,
     
   kernCarryA.setFixedArgs(3, bufCarry, bufBitsC, bufROE, bufCarryMax);
   kernCarryM.setFixedArgs(3, bufCarry, bufBitsC, bufROE, bufCarryMulMax);
+  kernCarryLL.setFixedArgs(3, bufCarry, bufBitsC, bufROE, bufCarryMax);
   carryB.setFixedArgs(1, bufCarry, bufBitsC);
 
   tailFusedMulDelta.setFixedArgs(4, bufTrigH, bufTrigH);
@@ -440,8 +440,8 @@ Gpu::Gpu(const Args& args, u32 E, u32 W, u32 BIG_H, u32 SMALL_H, u32 nW, u32 nH,
   vector<float2> readTrigSH, readTrigBH, readTrigN;
   {
     HostAccessBuffer<float2>
-      bufSH{queue, "readTrig", SMALL_H/4 + 1},
-      bufBH{queue, "readTrigBH", BIG_H/8 + 1},
+      bufSH{queue, "readTrig", setup.SMALL_H/4 + 1},
+      bufBH{queue, "readTrigBH", setup.BIG_H/8 + 1},
       bufN{queue, "readTrigN", hN/8+1};
         
     Kernel{program.get(), queue, device, 32, "readHwTrig"}(bufSH, bufBH, bufN);
@@ -449,28 +449,39 @@ Gpu::Gpu(const Args& args, u32 E, u32 W, u32 BIG_H, u32 SMALL_H, u32 nW, u32 nH,
     readTrigBH = bufBH.read();
     readTrigN = bufN.read();
 
-    Kernel{program.get(), queue, device, 32, "writeGlobals"}(ConstBuffer{context, "dp1", makeTrig<double>(2 * SMALL_H)},
-                                                             ConstBuffer{context, "dp2", makeTrig<double>(BIG_H)},
-                                                             ConstBuffer{context, "dp3", makeTrig<double>(hN)},
-                                                             ConstBuffer{context, "dp4", makeTinyTrig<double>(W, hN)},
+    Kernel{program.get(), queue, device, 32, "writeGlobals"}(ConstBuffer{context, "dp1", setup.trig.dp1},
+                                                             ConstBuffer{context, "dp2", setup.trig.dp2},
+                                                             ConstBuffer{context, "dp3", setup.trig.dp3},
+                                                             ConstBuffer{context, "dp4", setup.trig.dp4},
 
-                                                             ConstBuffer{context, "w2", weights.threadWeightsIF},
-                                                             ConstBuffer{context, "w3", weights.carryWeightsIF}
+                                                             ConstBuffer{context, "w2", setup.weights.threadWeightsIF},
+                                                             ConstBuffer{context, "w3", setup.weights.carryWeightsIF}
                                                              );
   }
 
   bufROE.zero();
+  bufRoeHist.zero();
   finish();
   
   program.reset();
 }
 
-vector<Buffer<i32>> Gpu::makeBufVector(u32 size) {
-  vector<Buffer<i32>> r;
-  for (u32 i = 0; i < size; ++i) { r.emplace_back(queue, "vector", N); }
+vector<BufferPool::Lease<i32>> Gpu::makeBufVector(u32 size) {
+  vector<BufferPool::Lease<i32>> r;
+  for (u32 i = 0; i < size; ++i) { r.push_back(pool.take<i32>(N, "vector")); }
   return r;
 }
 
+u32 Gpu::maxBuffers() {
+  // maxAlloc may exceed the card (the default is 3GB), and other processes may be using it.
+  size_t used = AllocTrac::totalAllocBytes(device);
+  size_t limit = std::min<u64>(AllocTrac::maxAllocBytes(), getTotalMem(device));
+  size_t avail = limit > used ? limit - used : 0;
+  if (hasFreeMemInfo(device)) { avail = std::min<u64>(avail, getFreeMem(device)); }
+  // AllocTrac refuses an allocation that would reach the limit exactly.
+  return pool.nFree<i32>(N) + (avail ? (avail - 1) / (N * sizeof(i32)) : 0);
+}
+
 static FFTConfig getFFTConfig(u32 E, string fftSpec) {
   if (fftSpec.empty()) {
     vector<FFTConfig> configs = FFTConfig::genConfigs();
@@ -491,8 +502,10 @@ Words Gpu::fold(vector<Buffer<int>>& bufs) {
 
   for (int retry = 0; retry < 2; ++retry) {
     {
-      Buffer<double> A{queue, "A", N};
-      Buffer<double> B{queue, "B", N};
+      auto leaseA = pool.take<double>(N, "A");
+      auto leaseB = pool.take<double>(N, "B");
+      Buffer<double>& A = *leaseA;
+      Buffer<double>& B = *leaseB;
       {
         Buffer<int>& last = bufs.back();
         fftP(buf3, last);
@@ -531,7 +544,8 @@ Words Gpu::fold(vector<Buffer<int>>& bufs) {
       }
     }
 
-    Buffer<int> C{queue, "C", N};
+    auto leaseC = pool.take<int>(N, "C");
+    Buffer<int>& C = *leaseC;
     carryA(C, buf3);
     carryB(C);
     Words folded = readAndCompress(C);
@@ -541,32 +555,40 @@ Words Gpu::fold(vector<Buffer<int>>& bufs) {
   return {};
 }
 
-ROEInfo norm(const vector<float>& v) {
-  double acc = 0;
-  float m = 0;
-  for (float x : v) {
-    assert(x >= 0 && x <= 0.5f);
-    m = max(m, x);
-    acc += x * x;
-  }
-  float n = v.empty() ? 0.0f : (sqrtf(float(acc) / u32(v.size())));
-  return {u32(v.size()), m, n};
+namespace {
+
+template<typename To, typename From> To pun(From x) {
+  static_assert(sizeof(To) == sizeof(From));
+  union {
+    From from;
+    To to;
+  } u;
+  u.from = x;
+  return u.to;
+}
+
+template<typename T> float asFloat(T x) { return pun<float>(x); }
+
 }
 
 ROEInfo Gpu::readROE() {
   assert(roePos <= ROE_SIZE);
-  if (roePos) {
-    vector<float> roe = bufROE.read(roePos);
-    assert(roe.size() == roePos);
-    bufROE.zero(roePos);
-    roePos = 0;
-    return norm(roe);
-  } else {
-    return {};
-  }
+  if (!roePos) { return {}; }
+
+  roeHist(bufRoeHist, bufROE, roePos);
+  vector<u32> hist = bufRoeHist.read(RoeStats::NBINS + 1);
+  bufRoeHist.zero();
+  bufROE.zero(roePos);
+  roePos = 0;
+
+  float m = asFloat(hist.back());
+  hist.pop_back();
+  RoeStats window = RoeStats::fromHist(hist, m);
+  roeStats += window;
+  return {window.N, window.max, float(window.rms())};
 }
 
-unique_ptr<Gpu> Gpu::make(u32 E, const Args &args) {
+GpuSetup Gpu::prepare(u32 E, const Args &args) {
   FFTConfig config = getFFTConfig(E, args.fftSpec);
   u32 WIDTH        = config.width;
   u32 SMALL_HEIGHT = config.height;
@@ -595,24 +617,93 @@ unique_ptr<Gpu> Gpu::make(u32 E, const Args &args) {
 
   if (useLongCarry) { log("using long carry kernels\n"); }
 
-  bool timeKernels = args.timeKernels;
+  cl_device_id device = getDevice(args.device);
+  Context context{device};
+  Holder<cl_program> program{compile(args, context.get(), device, N, E, WIDTH, SMALL_HEIGHT, MIDDLE, nW)};
+  
+  return {E, WIDTH, SMALL_HEIGHT * MIDDLE, SMALL_HEIGHT, nW, nH, useLongCarry, device,
+          std::move(context), std::move(program), genWeights(E, WIDTH, SMALL_HEIGHT * MIDDLE, nW),
+          sharedTrig(WIDTH, SMALL_HEIGHT, MIDDLE, nW, nH)};
+}
 
-  return make_unique<Gpu>(args, E, WIDTH, SMALL_HEIGHT * MIDDLE, SMALL_HEIGHT, nW, nH,
-                          getDevice(args.device), timeKernels, useLongCarry);
+unique_ptr<Gpu> Gpu::make(GpuSetup&& setup, const Args &args) {
+  return make_unique<Gpu>(args, std::move(setup));
 }
 
+// The residue is packed into E bits on the device, so only about E/8 bytes are read back instead of 4N.
 vector<u32> Gpu::readAndCompress(ConstBuffer<int>& buf)  {
+  if (!compactOnDevice) { return readAndCompressHost(buf); }
+
+  for (int nRetry = 0; nRetry < 3; ++nRetry) {
+    transposeOut(bufAux, buf);
+    compactCarry(bufChunkBorrow, bufAux);
+    compactScan(bufBorrowIn, bufWrapBorrow, bufChunkBorrow);
+    bufPacked.zero();
+    compactPack(bufPacked, bufAux, bufBorrowIn);
+    sum64(bufSumOut, u32(bufPacked.size * sizeof(u32)), bufPacked);
+
+    vector<u64> expectedVect(1);
+    bufSumOut.readAsync(expectedVect);
+    vector<int> wrapBorrow(1);
+    bufWrapBorrow.readAsync(wrapBorrow);
+    vector<u32> packed = bufPacked.read();
+    u64 expectedSum = expectedVect[0];
+
+    u64 sum = 0;
+    bool allZero = !wrapBorrow[0];
+    for (auto it = packed.begin(), end = packed.end(); it < end; it += 2) {
+      u64 v = *it | (u64(*(it + 1)) << 32);
+      sum += v;
+      allZero &= !v;
+    }
+
+    if (sum != expectedSum || (allZero && nRetry == 0)) {
+      log("GPU -> Host read #%d failed (check %x vs %x)\n", nRetry, unsigned(sum), unsigned(expectedSum));
+      continue;
+    }
+
+    if (allZero) {
+      log("Read ZERO\n");
+      return {};
+    }
+
+    packed.resize((E - 1) / 32 + 1);
+    for (int p = 0, borrow = wrapBorrow[0]; borrow; ++p) {
+      i64 v = i64(packed[p]) + borrow;
+      packed[p] = v & 0xffffffff;
+      borrow = v >> 32;
+    }
+
+    if (!compactChecked) {
+      compactChecked = true;
+      vector<int> raw = readOut(buf);
+      vector<u32> expected = compactBits(raw, E);
+      if (packed != expected) {
+        bool refOK = compactBitsChunked(raw.data(), N, E, COMPACT_CHUNK) == expected;
+        log("Device compaction mismatch (CPU reference %s), using host compaction\n", refOK ? "OK" : "mismatch too");
+        compactOnDevice = false;
+        return expected;
+      }
+    }
+    return packed;
+  }
+  throw "Persistent read errors: GPU->Host";
+}
+
+vector<u32> Gpu::readAndCompressHost(ConstBuffer<int>& buf)  {
   for (int nRetry = 0; nRetry < 3; ++nRetry) {
     sum64(bufSumOut, u32(buf.size * sizeof(int)), buf);
     
     vector<u64> expectedVect(1);
     bufSumOut.readAsync(expectedVect);
-    vector<int> data = readOut(buf);
+    transposeOut(bufStage, buf);
+    auto mapped = bufStage.map();
+    const int *data = mapped.data();
     u64 expectedSum = expectedVect[0];
     
     u64 sum = 0;
     bool allZero = true;
-    for (auto it = data.begin(), end = data.end(); it < end; it += 2) {
+    for (const int *it = data, *end = data + N; it < end; it += 2) {
       u64 v = u32(*it) | (u64(*(it + 1)) << 32);
       sum += v;
       allZero &= !v;
@@ -625,7 +716,7 @@ vector<u32> Gpu::readAndCompress(ConstBuffer<int>& buf)  {
         log("Read ZERO\n");
         return {};
       } else {
-        return compactBits(std::move(data),  E);
+        return compactBits(data, N, E);
       }
     }
   }
@@ -748,15 +839,20 @@ void Gpu::tailMulDelta(Buffer<double>& out, Buffer<double>& in, Buffer<double>&
 }
 
 vector<int> Gpu::readOut(ConstBuffer<int> &buf) {
-  transposeOut(bufAux, buf);
-  return bufAux.read();
+  transposeOut(bufStage, buf);
+  auto mapped = bufStage.map();
+  return {mapped.data(), mapped.data() + N};
 }
 
 void Gpu::writeIn(Buffer<int>& buf, const vector<u32>& words) { writeIn(buf, expandBits(words, N, E)); }
 
 void Gpu::writeIn(Buffer<int>& buf, const vector<i32>& words) {
-  bufAux.write(words);
-  transposeIn(buf, bufAux);
+  assert(words.size() == N);
+  {
+    auto mapped = bufStage.map(true);
+    std::copy(words.begin(), words.end(), mapped.data());
+  }
+  transposeIn(buf, bufStage);
 }
 
 namespace {
@@ -780,8 +876,7 @@ public:
 void spin() {
   static size_t spinPos = 0;
   const char spinner[] = "-\\|/";
-  printf("\r%c", spinner[spinPos]);
-  fflush(stdout);
+  logSpin(spinner[spinPos]);
   if (++spinPos >= sizeof(spinner) - 1) { spinPos = 0; }
 }
 
@@ -903,7 +998,7 @@ void Gpu::doCarry(Buffer<double>& out, Buffer<double>& in) {
   }
 }
 
-void Gpu::coreStep(Buffer<int>& out, Buffer<int>& in, bool leadIn, bool leadOut, bool mul3) {
+void Gpu::coreStep(Buffer<int>& out, Buffer<int>& in, bool leadIn, bool leadOut, bool mul3, bool sub2) {
   if (leadIn) {
     fftP(buf2, in);
     tW(buf1, buf2);    
@@ -915,11 +1010,11 @@ void Gpu::coreStep(Buffer<int>& out, Buffer<int>& in, bool leadIn, bool leadOut,
 
   if (leadOut) {
     fftW(buf2, buf1);
-    if (mul3) { carryM(out, buf2); } else { carryA(out, buf2); }
+    if (mul3) { carryM(out, buf2); } else if (sub2) { carryLL(out, buf2); } else { carryA(out, buf2); }
     carryB(out);
   } else {
     assert(!useLongCarry);
-    if (mul3) { carryFusedMul(buf2, buf1); } else { carryFused(buf2, buf1); }
+    if (mul3) { carryFusedMul(buf2, buf1); } else if (sub2) { carryFusedLL(buf2, buf1); } else { carryFused(buf2, buf1); }
     tW(buf1, buf2);
   }
 }
@@ -935,6 +1030,19 @@ u32 Gpu::modSqLoop(Buffer<int>& io, u32 from, u32 to) {
   return to;
 }
 
+RoeStats Gpu::sampleRoe(u32 iters) {
+  writeData(makeWords(E, 3));
+  // The first few dozen squarings, while the residue grows to full size, are not representative.
+  modSqLoop(bufData, 0, 1000);
+  readROE();
+  roeStats = {};
+  for (u32 k = 0; k < iters; k = min(k + 10000, iters)) {
+    modSqLoop(bufData, k, min(k + 10000, iters));
+    readROE();
+  }
+  return roeStats;
+}
+
 u32 Gpu::modSqLoopMul3(Buffer<int>& out, Buffer<int>& in, u32 from, u32 to) {
   assert(from < to);
   bool leadIn = true;
@@ -946,6 +1054,18 @@ u32 Gpu::modSqLoopMul3(Buffer<int>& out, Buffer<int>& in, u32 from, u32 to) {
   return to;
 }
 
+// Lucas-Lehmer iterations: io := io^2 - 2
+u32 Gpu::modSqLoopLL(Buffer<int>& io, u32 from, u32 to) {
+  assert(from <= to);
+  bool leadIn = true;
+  for (u32 k = from; k < to; ++k) {
+    bool leadOut = useLongCarry || (k == to - 1);
+    coreStep(io, io, leadIn, leadOut, false, true);
+    leadIn = leadOut;
+  }
+  return to;
+}
+
 bool Gpu::equalNotZero(Buffer<int>& buf1, Buffer<int>& buf2) {
   bufSmallOut.zero(1);
   u32 sizeBytes = N * sizeof(int);
@@ -995,6 +1115,10 @@ static void doBigLog(u32 E, u32 k, u64 res, bool checkOK, float secsPerIt, float
       (nErrors ? " "s + to_string(nErrors) + " errors"s : ""s).c_str(), buf);
 }
 
+static void logRoundoff(u32 E, const RoeStats& s) {
+  log("Roundoff: N=%u, mean %f, SD %f, max %f (pErr %f%%)\n", s.N, s.mean(), s.sd(), s.max, s.pErr(E) * 100);
+}
+
 bool Gpu::equals9(const Words& a) {
   if (a[0] != 9) { return false; }
   for (auto it = next(a.begin()); it != a.end(); ++it) { if (*it) { return false; }}
@@ -1040,86 +1164,40 @@ u32 checkStepForErrors(u32 argsCheckStep, u32 nErrors) {
   }
 }
 
-template<typename To, typename From> To pun(From x) {
-  static_assert(sizeof(To) == sizeof(From));
-  union {
-    From from;
-    To to;
-  } u;
-  u.from = x;
-  return u.to;
-}
-
-template<typename T> float asFloat(T x) { return pun<float>(x); }
-
-}
-
-#if 0
-void Gpu::printRoundoff(u32 E) {
-  u32 roundN = bufRoundoff.read(1)[0];
-  // fprintf(stderr, "roundN %u\n", roundN);
-
-  vector<u32> carry;
-  vector<u32> carryMul;
-  bufCarryMax.readAsync(carry, 4);
-  bufCarryMulMax.readAsync(carryMul, 4);
-  
-  vector<u32> roundVect;
-  bufRoundoff.readAsync(roundVect, roundN, 8);
-    
-  vector<u32> zero{0, 0, 0, 0};
-  bufRoundoff.write(zero);
-  bufCarryMax.write(zero);
-  bufCarryMulMax.write(zero);
-
-  if (!roundN) { return; }
-  if (roundN < 2000) { return; }
-  
-#if DUMP_STATS
-  {
-    File fo = File::openAppend("roundoff.txt");
-    if (fo) { for (u32 x : roundVect) { fprintf(fo.get(), "%f\n", asFloat(x)); } }
-  }
-#endif
+// Picks the PRP check interval L (which is also the savefile interval) that minimizes the expected cost per iteration
+//   (C + S) / L + rate * L * t
+// with C, S the measured check and save times, t the time per iteration, and rate the errors per iteration
+// (an error loses the whole interval). The minimum is at L = sqrt((C + S) / (rate * t)).
+// The rate is estimated from the errors of this exponent so far, with a prior of 1e-8 errors/iteration
+// weighted as 1e7 iterations.
+class CheckPlanner {
+  float secsPerIt = 0;
+  float secsCheckSave = 0;
+  u32 lastStep = 0;
 
-  double sum = 0;
-  for (u32 x : roundVect) { sum += asFloat(x); }
-  double avg = sum / roundN;
-  double variance = 0;
-  double m = 0;
-  for (u32 u : roundVect) {
-    double x = asFloat(u);
-    m = max(m, x);
-    double d = x - avg;
-    variance += d * d;
+public:
+  void update(float itSecs, float checkSaveSecs) {
+    // Smooth out the noise in the individual measurements.
+    secsPerIt = secsPerIt ? (secsPerIt + itSecs) / 2 : itSecs;
+    secsCheckSave = secsCheckSave ? (secsCheckSave + checkSaveSecs) / 2 : checkSaveSecs;
   }
-  
-  variance /= roundN;
-  double sdev = sqrt(variance);
-  
-  double gamma = 0.577215665; // Euler-Mascheroni
-  double z = (0.5 - avg) / sdev;
 
-  // See Gumbel distribution https://en.wikipedia.org/wiki/Gumbel_distribution
-  double p = -expm1(-exp(-z * (M_PI / sqrt(6))) * (E * exp(-gamma))); 
-  
-  log("Roundoff: N=%u, mean %f, SD %f, CV %f, max %f, z %.1f (pErr %f%%)\n",
-      roundN, avg, sdev, sdev / avg, m, z, p * 100);
+  u32 checkStep(u32 argsCheckStep, u32 k, u32 nErrors) {
+    if (argsCheckStep || !secsPerIt) { return checkStepForErrors(argsCheckStep, nErrors); }
 
-  // #if 0
-  u32 carryN = carry[3];
-  u32 carryAvg = carryN ? *(u64*)&carry[0] / carryN : 0;
-  u32 carryMax = carry[2];
-  
-  u32 carryMulN = carryMul[3];
-  u32 carryMulAvg = carryMulN ? *(u64*)&carryMul[0] / carryMulN : 0;
-  u32 carryMulMax = carryMul[2];
+    double rate = (nErrors + 0.1) / (double(k) + 1e7);
+    double best = sqrt(secsCheckSave / (rate * secsPerIt));
+    u32 step = u32(std::clamp(best, 20'000.0, 1'000'000.0) / 10'000 + 0.5) * 10'000;
+    if (step != lastStep) {
+      log("check interval %u (check+save %.2fs, %.0f us/it, %.1e errors/it)\n",
+          step, secsCheckSave, secsPerIt * 1'000'000, rate);
+      lastStep = step;
+    }
+    return step;
+  }
+};
 
-  log("Carry: N=%u, max %x, avg %x; CarryM: N=%u, max %x, avg %x\n",
-      carryN, carryMax, carryAvg, carryMulN, carryMulMax, carryMulAvg);
-  // #endif
 }
-#endif
 
 void Gpu::accumulate(Buffer<int>& acc, Buffer<double>& data, Buffer<double>& tmp1, Buffer<double>& tmp2) {
   fftP(tmp1, acc);
@@ -1157,15 +1235,19 @@ void Gpu::multiplyLowLow(Buffer<double>& io, const Buffer<double>& in, Buffer<do
 struct SquaringSet {  
   std::string name;
   u32 N;
-  Buffer<double> A, B, C;
+  BufferPool::Lease<double> leaseA, leaseB, leaseC;
+  Buffer<double> &A, &B, &C;
   Gpu& gpu;
 
   SquaringSet(Gpu& gpu, u32 N, string_view name)
     : name(name)
     , N(N)
-    , A{gpu.queue, this->name + ":A", N}
-    , B{gpu.queue, this->name + ":B", N}
-    , C{gpu.queue, this->name + ":C", N}
+    , leaseA{gpu.pool.take<double>(N, this->name + ":A")}
+    , leaseB{gpu.pool.take<double>(N, this->name + ":B")}
+    , leaseC{gpu.pool.take<double>(N, this->name + ":C")}
+    , A{*leaseA}
+    , B{*leaseB}
+    , C{*leaseC}
     , gpu(gpu)
   {}
    
@@ -1218,25 +1300,17 @@ template<typename Future> bool wait(const Future& f) {
 
 // ----
 
-fs::path Gpu::saveProof(const Args& args, const ProofSet& proofSet) {
-  Memlock memlock{args.masterDir, u32(args.device)};
+ProofInfo Gpu::saveProof(const Args& args, const ProofSet& proofSet, u32 nBufs) {
+  // The device memory of this worker while computeProof() holds its stack: what AllocTrac counts for its context
+  // now (not the other workers on the device), plus the stack buffers the pool does not have yet.
+  u32 nNew = nBufs - std::min(nBufs, pool.nFree<i32>(N));
+  size_t bytes = AllocTrac::contextAllocBytes(context.get()) + nNew * size_t(N) * sizeof(i32);
+  Memlock memlock{args.masterDir, u32(args.device), bytes, args.memBudget};
   
   for (int retry = 0; retry < 2; ++retry) {
-    Proof proof = proofSet.computeProof(this);
-    fs::path tmpFile = proof.file(args.proofToVerifyDir);
-    proof.save(tmpFile);
-            
-    fs::path proofFile = proof.file(args.proofResultDir);            
-    bool doVerify = proofSet.power >= args.proofVerify;
-    bool ok = !doVerify || Proof::load(tmpFile).verify(this);
-    if (doVerify) { log("Proof '%s' verification %s\n", tmpFile.string().c_str(), ok ? "OK" : "FAILED"); }
-    if (ok) {
-      error_code noThrow;
-      fs::remove(proofFile, noThrow);
-      fs::rename(tmpFile, proofFile);
-      log("Proof '%s' generated\n", proofFile.string().c_str());
-      return proofFile;
-    }
+    Proof proof = proofSet.computeProof(this, nBufs);
+    pool.trim(); // The proof stack is not needed for verification.
+    if (auto info = proof.publish(this, args)) { return *info; }
   }
   throw "bad proof generation";
 }
@@ -1479,15 +1553,16 @@ bool Gpu::pm1Retry(const Args &args, const Task& task, u32 nErr) {
   return DONE;
 }
 
-PRPResult Gpu::isPrimePRP(const Args &args, const Task& task) {
+PRPResult Gpu::isPrimePRP(const Args &args, const Task& task, Lookahead* lookahead) {
   u32 E = task.exponent;
   u32 k = 0, blockSize = 0;
   u32 nErrors = 0;
   
   u32 power = -1;
+  u32 proofBufs = 0;
   u32 startK = 0;
 
-  Saver saver{E, args.nSavefiles, args.startFrom, args.mprimeDir};
+  Saver saver{E, args.nSavefiles, args.startFrom, args.mprimeDir, args.saveBudget, args.saveTier};
   Signal signal;
 
   // Used to detect a repetitive failure, which is more likely to indicate a software rather than a HW problem.
@@ -1495,9 +1570,27 @@ PRPResult Gpu::isPrimePRP(const Args &args, const Task& task) {
 
   // Number of sequential errors (with no success in between). If this ever gets high enough, stop.
   int nSeqErrors = 0;
+
+  CheckPlanner planner;
   
  reload:
-  {
+  if (auto emergency = saver.loadEmergency()) {
+    // Resume exactly where SIGTERM stopped, possibly within a block; the next check verifies it.
+    writeData(emergency->data);
+    writeCheck(emergency->check);
+    u64 res = dataResidue();
+    if (res != emergency->res64) {
+      log("EE %9u on-load of the emergency checkpoint: %016" PRIx64 " vs. %016" PRIx64 "\n", emergency->k, res, emergency->res64);
+      saver.deleteEmergency();
+      goto reload;
+    }
+    log("OK %9u on-load of the emergency checkpoint, unverified until the next check\n", emergency->k);
+    k = emergency->k;
+    blockSize = emergency->blockSize;
+    if (nErrors == 0) { nErrors = emergency->nErrors; }
+    readROE();
+    roeStats = saver.loadPRP(args.blockSize).roe;
+  } else {
     PRPState loaded = saver.loadPRP(args.blockSize);    
     writeState(loaded.check, loaded.blockSize, buf1, buf2, buf3);
     
@@ -1518,19 +1611,25 @@ PRPResult Gpu::isPrimePRP(const Args &args, const Task& task) {
     blockSize = loaded.blockSize;
     if (nErrors == 0) { nErrors = loaded.nErrors; }
     assert(nErrors >= loaded.nErrors);
+
+    // Drop the ROE of the iterations that are redone.
+    readROE();
+    roeStats = loaded.roe;
   }
 
   assert(blockSize > 0 && 10000 % blockSize == 0);
   
-  u32 checkStep = checkStepForErrors(args.logStep, nErrors);
+  u32 checkStep = planner.checkStep(args.logStep, k, nErrors);
   assert(checkStep % 10000 == 0);
 
   if (!startK) { startK = k; }
 
   if (power == u32(-1)) {
-    power = ProofSet::effectivePower(args.tmpDir, E, args.proofPow, startK);
+    ProofPlan plan = ProofSet::plan(args.tmpDir, E, args.proofPow, startK, N, maxBuffers());
+    power = plan.power;
+    proofBufs = plan.nBufs;
     if (!power) {
-      log("Proof disabled because of missing checkpoints\n");
+      log("Proof disabled because of missing checkpoints or tmpDir space\n");
     } else if (power != args.proofPow) {
       log("Proof using power %u (vs %u) for %u\n", power, args.proofPow, E);
     } else {
@@ -1538,7 +1637,7 @@ PRPResult Gpu::isPrimePRP(const Args &args, const Task& task) {
     }
   }
   
-  ProofSet proofSet{args.tmpDir, E, power};
+  ProofSet proofSet{args.tmpDir, E, power, task.knownFactors};
 
   bool isPrime = false;
   IterationTimer iterationTimer{startK};
@@ -1562,7 +1661,7 @@ PRPResult Gpu::isPrimePRP(const Args &args, const Task& task) {
   u32 persistK = proofSet.next(k);
   bool leadIn = true;
 
-  assert(k % blockSize == 0);
+  // k is within a block only when resuming from an emergency checkpoint.
   assert(checkStep % blockSize == 0);
 
   while (true) {
@@ -1581,12 +1680,17 @@ PRPResult Gpu::isPrimePRP(const Args &args, const Task& task) {
     ++k; // !! early inc
 
     bool doStop = false;
+    bool forceCheck = false;
+    // Beyond kEnd the final residue would be lost, so there the stop waits for the check.
+    bool doUrgentStop = k < kEnd && signal.urgentStopRequested();
 
     if (k % blockSize == 0) {
       doStop = signal.stopRequested() || (args.iters && k - startK >= args.iters);
+      forceCheck = signal.takeCheckpointRequest();
+      if (forceCheck) { log("Checkpoint requested at %u\n", k); }
     }
 
-    bool leadOut = doStop || (k % 10000 == 0) || (k % blockSize == 0 && k >= kEndEnd) || k == persistK || k == kEnd || useLongCarry;
+    bool leadOut = doStop || doUrgentStop || forceCheck || (k % 10000 == 0) || (k % blockSize == 0 && k >= kEndEnd) || k == persistK || k == kEnd || useLongCarry;
 
     coreStep(bufData, bufData, leadIn, leadOut, false);
     leadIn = leadOut;    
@@ -1607,6 +1711,10 @@ PRPResult Gpu::isPrimePRP(const Args &args, const Task& task) {
       isPrime = equals9(words);
       doDiv9(E, words);
       finalRes64 = residue(words);
+      if (!task.knownFactors.empty()) {
+        // PRP-CF: the type-5 residue and the PRP status are those of the cofactor.
+        std::tie(isPrime, finalRes64) = cofactorPRP(E, words, task.knownFactors);
+      }
       log("%s %8d / %d, %s\n", isPrime ? "PP" : "CC", kEnd, E, hex(finalRes64).c_str());
     }
 
@@ -1616,7 +1724,23 @@ PRPResult Gpu::isPrimePRP(const Args &args, const Task& task) {
     }
 
     u64 res = dataResidue(); // implies finish()
-    bool doCheck = !res || doStop || (k % checkStep == 0) || (k >= kEndEnd) || (k - startK == 2 * blockSize);
+
+    if (doUrgentStop) {
+      // Preempted: no time for the check. Save the data and the check as they are, the first check on resume verifies them.
+      Words data = readData();
+      Words check = readCheck();
+      if (data.empty() || check.empty()) {
+        log("Data error ZERO, no emergency checkpoint at %u\n", k);
+      } else {
+        saver.saveEmergency(PRPEmergencyState{k, blockSize, res, data, check, nErrors});
+        log("Emergency checkpoint at %u (%016" PRIx64 "), stopping\n", k, res);
+      }
+      throw "stop requested";
+    }
+
+    // The early check is at the first block boundary at least one full block after the start.
+    bool earlyCheck = k % blockSize == 0 && k - startK > blockSize && k - startK <= 2 * blockSize;
+    bool doCheck = !res || doStop || forceCheck || (k % checkStep == 0) || (k >= kEndEnd) || earlyCheck;
       
     if (k % 10000 == 0 && !doCheck) {
       auto roeInfo = readROE();
@@ -1636,7 +1760,8 @@ PRPResult Gpu::isPrimePRP(const Args &args, const Task& task) {
     }
             
     if (doCheck) {
-      // if (printStats) { printRoundoff(E); }
+      readROE();
+      if (printStats) { logRoundoff(E, roeStats); }
 
       float secsPerIt = iterationTimer.reset(k);
 
@@ -1652,15 +1777,26 @@ PRPResult Gpu::isPrimePRP(const Args &args, const Task& task) {
         lastFailedRes64.reset();
         skipNextCheckUpdate = true;
 
-        if (k < kEnd) { saver.savePRP(PRPState{k, blockSize, res, check, nErrors}); }
+        if (k < kEnd) { saver.savePRP(PRPState{k, blockSize, res, check, nErrors, roeStats}); }
 
         float secsSave = iterationTimer.reset(k);
           
         doBigLog(E, k, res, ok, secsPerIt, secsCheck, secsSave, kEndEnd, nErrors);
+
+        // The early check right after start-up does not give a representative time per iteration.
+        if (k - startK > 2 * blockSize) {
+          planner.update(secsPerIt, secsCheck + secsSave);
+          checkStep = planner.checkStep(args.logStep, k, nErrors);
+        }
+
+        // Within the last check interval: prepare the next task while we finish this one and build the proof.
+        if (lookahead && k + checkStep >= kEnd) { lookahead->start(task); }
           
         if (k >= kEndEnd) {
-          fs::path proofFile = saveProof(args, proofSet);
-          return {"", isPrime, finalRes64, nErrors, proofFile.string()};          
+          if (roeStats.N) { logRoundoff(E, roeStats); }
+          // The proof residues stay on disk; the caller builds the proof while the next test runs.
+          if (args.backgroundProof && power) { return {"", isPrime, finalRes64, nErrors, {}, power, proofBufs, roeStats}; }
+          return {"", isPrime, finalRes64, nErrors, saveProof(args, proofSet, proofBufs), 0, 0, roeStats};          
         }        
       } else {
         doBigLog(E, k, res, ok, secsPerIt, secsCheck, 0, kEndEnd, nErrors);
@@ -1674,6 +1810,8 @@ PRPResult Gpu::isPrimePRP(const Args &args, const Task& task) {
           throw "consistent error";
         }
         lastFailedRes64 = res;
+        // An emergency checkpoint not verified yet can't be trusted anymore.
+        saver.deleteEmergency();
         if (!doStop) { goto reload; }
       }
         
@@ -1688,3 +1826,118 @@ PRPResult Gpu::isPrimePRP(const Args &args, const Task& task) {
     }
   }
 }
+
+PRPResult Gpu::isPrimeLL(const Args &args, const Task& task, Lookahead* lookahead) {
+  u32 E = task.exponent;
+  u32 nErrors = 0;
+  u32 startK = 0;
+
+  Saver saver{E, args.nSavefiles, args.startFrom, args.mprimeDir};
+  Signal signal;
+
+  // s(0) = 4, s(k+1) = s(k)^2 - 2. M(E) is prime iff s(E-2) == 0.
+  const u32 kEnd = E - 2;
+
+  // For k >= 1, jacobi(s(k) - 2, M(E)) == -1, and an error breaks this with probability 1/2.
+  // The check is done on the CPU in the background while the GPU continues. Only checked states are saved,
+  // and a failed check rolls back to the most recent saved state.
+  std::future<bool> jacobiOK;
+  LLState pending;
+
+  // Number of sequential errors (with no success in between). If this ever gets high enough, stop.
+  int nSeqErrors = 0;
+
+  auto settle = [&]() {
+    if (!jacobiOK.valid()) { return true; }
+    Timer timer;
+    bool ok = jacobiOK.get();
+    log("%s %9u Jacobi check %s (waited %.2fs)\n", ok ? "OK" : "EE", pending.k, ok ? "passed" : "failed", timer.reset());
+    if (ok) {
+      nSeqErrors = 0;
+      saver.saveLL(pending);
+    } else if (++nSeqErrors > 2) {
+      log("%d sequential errors, will stop.\n", nSeqErrors);
+      throw "too many errors";
+    }
+    return ok;
+  };
+
+ reload:
+  LLState loaded = saver.loadLL();
+  writeData(loaded.data);
+  u32 k = loaded.k;
+  nErrors = max(nErrors, loaded.nErrors);
+  if (!startK) { startK = k; }
+  log("%9u on-load: %016" PRIx64 "\n", k, residue(loaded.data));
+
+  u32 blockSize = args.blockSize;
+  u32 jacobiStep = 5 * checkStepForErrors(args.logStep, nErrors);
+  IterationTimer iterationTimer{k};
+
+  while (true) {
+    assert(k < kEnd);
+    u32 kNext = min(roundUp(k + 1, blockSize), kEnd);
+    modSqLoopLL(bufData, k, kNext);
+    k = kNext;
+
+    bool doStop = signal.stopRequested() || (args.iters && k - startK >= args.iters);
+    bool doJacobi = doStop || (k % jacobiStep == 0) || (k == kEnd);
+
+    if (!doJacobi && k % 10000) {
+      finish();
+      continue;
+    }
+
+    u64 res = dataResidue(); // implies finish()
+    float secsPerIt = iterationTimer.reset(k);
+    auto roeInfo = readROE();
+    if (roeInfo.N) {
+      log("%9u %s %4.0f; ROE=%.3f %.4f %u\n", k, hex(res).c_str(), secsPerIt * 1'000'000, roeInfo.max, roeInfo.norm, roeInfo.N);
+    } else {
+      log("%9u %s %4.0f; ETA %s\n", k, hex(res).c_str(), secsPerIt * 1'000'000, getETA(k, kEnd, secsPerIt).c_str());
+    }
+
+    if (!doJacobi) { continue; }
+
+    if (doStop) {
+      log("Stopping, please wait..\n");
+      signal.release();
+    }
+
+    // The previous state must pass its check before this one is queued.
+    if (!settle()) {
+      ++nErrors;
+      goto reload;
+    }
+
+    if (lookahead && k + jacobiStep >= kEnd) { lookahead->start(task); }
+
+    Words data = readData();
+    bool isZero = data.empty();
+    if (isZero) {
+      if (k < kEnd) {
+        log("Data error ZERO\n");
+        ++nErrors;
+        goto reload;
+      }
+      data = Words((E - 1) / 32 + 1);
+    }
+
+    pending = LLState{k, data, nErrors};
+    jacobiOK = std::async(std::launch::async, [E, data = std::move(data)]() { return jacobi(E, data, 2) == -1; });
+
+    if (doStop || k == kEnd) {
+      if (!settle()) {
+        ++nErrors;
+        goto reload;
+      }
+
+      if (doStop) { throw "stop requested"; }
+
+      bool isPrime = isZero;
+      u64 finalRes64 = residue(pending.data);
+      log("%s %8d / %d, %s\n", isPrime ? "PP" : "CC", kEnd, E, hex(finalRes64).c_str());
+      return {"", isPrime, finalRes64, nErrors, {}};
+    }
+  }
+}
@@ -3,11 +3,14 @@
 #pragma once
 
 #include "Buffer.h"
+#include "BufferPool.h"
 #include "Context.h"
 #include "Queue.h"
 
 #include "common.h"
 #include "kernel.h"
+#include "Proof.h"
+#include "RoeStats.h"
 
 #include <vector>
 #include <string>
@@ -25,6 +28,7 @@ class Args;
 class Saver;
 class Signal;
 class ProofSet;
+class Lookahead;
 
 using double2 = pair<double, double>;
 using float2 = pair<float, float>;
@@ -38,7 +42,10 @@ struct PRPResult {
   bool isPrime{};
   u64 res64 = 0;
   u32 nErrors = 0;
-  fs::path proofPath{};
+  optional<ProofInfo> proof{};
+  u32 proofPower = 0; // non-zero when the proof is still to be built (-bgproof)
+  u32 proofBufs = 0;  // and its planned stack buffers
+  RoeStats roe{};
 };
 
 struct Reload {
@@ -50,6 +57,32 @@ struct ROEInfo {
   float norm;
 };
 
+struct Weights {
+  vector<double> threadWeightsIF;
+  vector<double> carryWeightsIF;
+  vector<u32> bitsCF;
+  vector<u32> bitsC;
+};
+
+// The trig tables of an FFT shape, generated on the host.
+struct TrigTables {
+  vector<double2> smallW, smallH, middle;
+  vector<double2> dp1, dp2, dp3, dp4; // for writeGlobals
+};
+
+// The host-side part of building a Gpu: FFT selection, OpenCL program compilation, weights and trig generation.
+// It does not allocate any device memory, so it can be done in the background while another Gpu is running.
+struct GpuSetup {
+  u32 E;
+  u32 W, BIG_H, SMALL_H, nW, nH;
+  bool useLongCarry;
+  cl_device_id device;
+  Context context;
+  Holder<cl_program> program;
+  Weights weights;
+  TrigTables trig;
+};
+
 class Gpu {
   friend struct SquaringSet;
   u32 E;
@@ -67,6 +100,7 @@ class Gpu {
   
   Kernel kernCarryFused;
   Kernel kernCarryFusedMul;
+  Kernel kernCarryFusedLL;
   Kernel fftP;
   Kernel fftW;
   Kernel fftHin;
@@ -76,6 +110,7 @@ class Gpu {
   
   Kernel kernCarryA;
   Kernel kernCarryM;
+  Kernel kernCarryLL;
   Kernel carryB;
   
   Kernel transposeW, transposeH;
@@ -94,6 +129,10 @@ class Gpu {
   Kernel isNotZero;
   Kernel isEqual;
   Kernel sum64;
+  Kernel compactCarry;
+  Kernel compactScan;
+  Kernel compactPack;
+  Kernel roeHist;
   
   // Kernel testKernel;
 
@@ -107,7 +146,8 @@ class Gpu {
 
   // "integer word" buffers. These are "small buffers": N x int.
   HostAccessBuffer<int> bufData;   // Main int buffer with the words.
-  HostAccessBuffer<int> bufAux;    // Auxiliary int buffer, used in transposing data in/out and in check.
+  HostAccessBuffer<int> bufAux;    // Auxiliary int buffer, used in check.
+  PinnedBuffer<int> bufStage;      // Host-visible buffer for transposing data in/out.
   Buffer<int> bufCheck;  // Buffers used with the error check.
   Buffer<int> bufBase;   // used in P-1 error check.
 
@@ -122,16 +162,32 @@ class Gpu {
   HostAccessBuffer<int> bufSmallOut;
   HostAccessBuffer<u64> bufSumOut;
 
+  // Residue compaction on the device, see readAndCompress().
+  Buffer<int> bufChunkBorrow;
+  Buffer<int> bufBorrowIn;
+  HostAccessBuffer<int> bufWrapBorrow;
+  HostAccessBuffer<u32> bufPacked;
+  bool compactOnDevice = true; // cleared if the device result does not match compactBits()
+  bool compactChecked = false; // the first device result is checked against compactBits()
+
   // The round-off error ("ROE"), one float element per iteration.
   HostAccessBuffer<float> bufROE;
 
   // The next position to write in the ROE buffer.
   u32 roePos;
 
+  // The ROE histogram of one window (RoeStats::NBINS bins and the max), and the totals over the test.
+  HostAccessBuffer<u32> bufRoeHist;
+  RoeStats roeStats;
+
   // Auxilliary big buffers
   Buffer<double> buf1;
   Buffer<double> buf2;
   Buffer<double> buf3;
+
+  // Transient buffers, see makeBufVector() and fold().
+  BufferPool pool;
+
   bool usesROE1;
   bool usesROE2;
   
@@ -142,11 +198,12 @@ class Gpu {
   void tailSquare(Buffer<double>& out, Buffer<double>& in) { tailFusedSquare(out, in); }
   
   vector<int> readOut(ConstBuffer<int> &buf);
-  void writeIn(Buffer<int>& buf, const vector<i32> &words);
+  vector<u32> readAndCompressHost(ConstBuffer<int>& buf);
 
-  void coreStep(Buffer<int>& out, Buffer<int>& in, bool leadIn, bool leadOut, bool mul3);
+  void coreStep(Buffer<int>& out, Buffer<int>& in, bool leadIn, bool leadOut, bool mul3, bool sub2 = false);
   u32 modSqLoop(Buffer<int>& io, u32 from, u32 to);
   u32 modSqLoopMul3(Buffer<int>& out, Buffer<int>& in, u32 from, u32 to);
+  u32 modSqLoopLL(Buffer<int>& io, u32 from, u32 to);
 
   bool equalNotZero(Buffer<int>& bufCheck, Buffer<int>& bufAux);
   u64 bufResidue(Buffer<int>& buf);
@@ -166,12 +223,6 @@ class Gpu {
   void writeState(const vector<u32> &check, u32 blockSize, Buffer<double>&, Buffer<double>&, Buffer<double>&);
   void tailMulDelta(Buffer<double>& out, Buffer<double>& in, Buffer<double>& bufA, Buffer<double>& bufB);
   void tailMul(Buffer<double>& out, Buffer<double>& in, Buffer<double>& inTmp);
-  
-
-  Gpu(const Args& args, u32 E, u32 W, u32 BIG_H, u32 SMALL_H, u32 nW, u32 nH,
-      cl_device_id device, bool timeKernels, bool useLongCarry, struct Weights&& weights);
-
-  void printRoundoff(u32 E);
 
   // does either carrryFused() or the expanded version depending on useLongCarry
   void doCarry(Buffer<double>& out, Buffer<double>& in);
@@ -183,9 +234,7 @@ class Gpu {
   // data := data * data;
   void square(Buffer<int>& data, Buffer<double>& tmp1, Buffer<double>& tmp2);
   
-  u32 maxBuffers();
-
-  fs::path saveProof(const Args& args, const ProofSet& proofSet);
+  // Bins the ROE since the last read into roeStats, and returns the stats of this window.
   ROEInfo readROE();
   
 public:
@@ -196,6 +245,8 @@ public:
   void carryM(Buffer<int>& a, Buffer<double>& b) { kernCarryM(usesROE2 ? roePos++ : roePos, a, b); }
   void carryFused(Buffer<double>& a, Buffer<double>& b) { kernCarryFused(usesROE1 ? roePos++ : roePos, a, b); }
   void carryFusedMul(Buffer<double>& a, Buffer<double>& b) { kernCarryFusedMul(usesROE1 ? roePos++ : roePos, a, b); }
+  void carryLL(Buffer<int>& a, Buffer<double>& b) { kernCarryLL(usesROE2 ? roePos++ : roePos, a, b); }
+  void carryFusedLL(Buffer<double>& a, Buffer<double>& b) { kernCarryFusedLL(usesROE1 ? roePos++ : roePos, a, b); }
 
   Words fold(vector<Buffer<int>>& bufs);
   
@@ -210,19 +261,25 @@ public:
   void accumulate(Buffer<int>& acc, Buffer<double>& data, Buffer<double>& tmp1, Buffer<double>& tmp2);
 
   
-  static unique_ptr<Gpu> make(u32 E, const Args &args);
+  static GpuSetup prepare(u32 E, const Args &args);
+  static unique_ptr<Gpu> make(GpuSetup&& setup, const Args &args);
+  static unique_ptr<Gpu> make(u32 E, const Args &args) { return make(prepare(E, args), args); }
   static void doDiv9(u32 E, Words& words);
   static bool equals9(const Words& words);
   
-  Gpu(const Args& args, u32 E, u32 W, u32 BIG_H, u32 SMALL_H, u32 nW, u32 nH,
-      cl_device_id device, bool timeKernels, bool useLongCarry);
+  Gpu(const Args& args, GpuSetup&& setup);
 
   vector<u32> readAndCompress(ConstBuffer<int>& buf);
   void writeIn(Buffer<int>& buf, const vector<u32> &words);
+  // "words" already expanded (see expandBits())
+  void writeIn(Buffer<int>& buf, const vector<i32> &words);
   void writeData(const vector<u32> &v) { writeIn(bufData, v); }
   void writeCheck(const vector<u32> &v) { writeIn(bufCheck, v); }
   
   u64 dataResidue()  { return bufResidue(bufData); }
+
+  // Squarings starting from 3, without checks or savefiles, for -calibrate. Needs "-use ROE1,ROE2".
+  RoeStats sampleRoe(u32 iters);
   u64 checkResidue() { return bufResidue(bufCheck); }
     
   bool doCheck(u32 blockSize, Buffer<double>&, Buffer<double>&, Buffer<double>&);
@@ -232,7 +289,14 @@ public:
   vector<u32> readCheck();
   vector<u32> readData();
 
-  PRPResult isPrimePRP(const Args& args, const Task& task);
+  // Builds (and maybe verifies) the proof from the residues saved in proofSet.
+  // nBufs: the proof stack buffers planned by ProofSet::plan().
+  ProofInfo saveProof(const Args& args, const ProofSet& proofSet, u32 nBufs);
+
+  PRPResult isPrimePRP(const Args& args, const Task& task, Lookahead* lookahead = nullptr);
+
+  // Lucas-Lehmer test with Jacobi-symbol error check.
+  PRPResult isPrimeLL(const Args& args, const Task& task, Lookahead* lookahead = nullptr);
 
   void pm1Block(vector<bool> bits, bool update);
   bool pm1Check(vector<bool> sumBits, u32 blockSize);
@@ -262,5 +326,8 @@ public:
   
   // return A^(2^n)
   Words expExp2(const Words& A, u32 n);
-  vector<Buffer<i32>> makeBufVector(u32 size);
+  vector<BufferPool::Lease<i32>> makeBufVector(u32 size);
+
+  // How many more N-word buffers fit in this device's maxAlloc budget, and in its free memory.
+  u32 maxBuffers();
 };
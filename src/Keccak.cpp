@@ -0,0 +1,328 @@
+// Copyright Mihai Preda.
+
+#include "Keccak.h"
+
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define KECCAK_AVX2 1
+#include <immintrin.h>
+#else
+#define KECCAK_AVX2 0
+#endif
+
+namespace {
+
+const constexpr u64 RC[24] = {
+  0x0000000000000001ULL, 0x0000000000008082ULL, 0x800000000000808aULL, 0x8000000080008000ULL,
+  0x000000000000808bULL, 0x0000000080000001ULL, 0x8000000080008081ULL, 0x8000000000008009ULL,
+  0x000000000000008aULL, 0x0000000000000088ULL, 0x0000000080008009ULL, 0x000000008000000aULL,
+  0x000000008000808bULL, 0x800000000000008bULL, 0x8000000000008089ULL, 0x8000000000008003ULL,
+  0x8000000000008002ULL, 0x8000000000000080ULL, 0x000000000000800aULL, 0x800000008000000aULL,
+  0x8000000080008081ULL, 0x8000000000008080ULL, 0x0000000080000001ULL, 0x8000000080008008ULL,
+};
+
+inline u64 rol(u64 x, u32 n) { return (x << n) | (x >> (64 - n)); }
+
+u64 loadLE(const u8* p) {
+  u64 x;
+  memcpy(&x, p, sizeof(x));
+  return x;
+}
+
+// Absorbs the tail (less than a block) of a message with the SHA3 padding into "block".
+void padBlock(u8 block[Keccak256::RATE], const u8* tail, u32 size) {
+  assert(size < Keccak256::RATE);
+  memset(block, 0, Keccak256::RATE);
+  memcpy(block, tail, size);
+  block[size] ^= 0x06;
+  block[Keccak256::RATE - 1] ^= 0x80;
+}
+
+// One round from "a" into "e": theta, rho and pi, then chi and iota, one output row at a time so that only five
+// lanes are temporaries. The lanes COMPLEMENTED are kept inverted, which turns most of the NOTs of chi into ORs.
+inline void keccakRound(const u64* a, u64* e, u64 rc) {
+  u64 c0 = a[0] ^ a[5] ^ a[10] ^ a[15] ^ a[20];
+  u64 c1 = a[1] ^ a[6] ^ a[11] ^ a[16] ^ a[21];
+  u64 c2 = a[2] ^ a[7] ^ a[12] ^ a[17] ^ a[22];
+  u64 c3 = a[3] ^ a[8] ^ a[13] ^ a[18] ^ a[23];
+  u64 c4 = a[4] ^ a[9] ^ a[14] ^ a[19] ^ a[24];
+  u64 d0 = c4 ^ rol(c1, 1);
+  u64 d1 = c0 ^ rol(c2, 1);
+  u64 d2 = c1 ^ rol(c3, 1);
+  u64 d3 = c2 ^ rol(c4, 1);
+  u64 d4 = c3 ^ rol(c0, 1);
+  u64 b0, b1, b2, b3, b4;
+
+  b0 = a[0] ^ d0;
+  b1 = rol(a[6] ^ d1, 44);
+  b2 = rol(a[12] ^ d2, 43);
+  b3 = rol(a[18] ^ d3, 21);
+  b4 = rol(a[24] ^ d4, 14);
+  e[0] = b0 ^ (b1 | b2) ^ rc;
+  e[1] = b1 ^ (~b2 | b3);
+  e[2] = b2 ^ (b3 & b4);
+  e[3] = b3 ^ (b4 | b0);
+  e[4] = b4 ^ (b0 & b1);
+
+  b0 = rol(a[3] ^ d3, 28);
+  b1 = rol(a[9] ^ d4, 20);
+  b2 = rol(a[10] ^ d0, 3);
+  b3 = rol(a[16] ^ d1, 45);
+  b4 = rol(a[22] ^ d2, 61);
+  e[5] = b0 ^ (b1 | b2);
+  e[6] = b1 ^ (b2 & b3);
+  e[7] = b2 ^ (b3 | ~b4);
+  e[8] = b3 ^ (b4 | b0);
+  e[9] = b4 ^ (b0 & b1);
+
+  b0 = rol(a[1] ^ d1, 1);
+  b1 = rol(a[7] ^ d2, 6);
+  b2 = rol(a[13] ^ d3, 25);
+  b3 = rol(a[19] ^ d4, 8);
+  b4 = rol(a[20] ^ d0, 18);
+  e[10] = b0 ^ (b1 | b2);
+  e[11] = b1 ^ (b2 & b3);
+  e[12] = b2 ^ (~b3 & b4);
+  e[13] = ~b3 ^ (b4 | b0);
+  e[14] = b4 ^ (b0 & b1);
+
+  b0 = rol(a[4] ^ d4, 27);
+  b1 = rol(a[5] ^ d0, 36);
+  b2 = rol(a[11] ^ d1, 10);
+  b3 = rol(a[17] ^ d2, 15);
+  b4 = rol(a[23] ^ d3, 56);
+  e[15] = b0 ^ (b1 & b2);
+  e[16] = b1 ^ (b2 | b3);
+  e[17] = b2 ^ (~b3 | b4);
+  e[18] = ~b3 ^ (b4 & b0);
+  e[19] = b4 ^ (b0 | b1);
+
+  b0 = rol(a[2] ^ d2, 62);
+  b1 = rol(a[8] ^ d3, 55);
+  b2 = rol(a[14] ^ d4, 39);
+  b3 = rol(a[15] ^ d0, 41);
+  b4 = rol(a[21] ^ d1, 2);
+  e[20] = b0 ^ (~b1 & b2);
+  e[21] = ~b1 ^ (b2 | b3);
+  e[22] = b2 ^ (b3 & b4);
+  e[23] = b3 ^ (b4 | b0);
+  e[24] = b4 ^ (b0 & b1);
+}
+
+const constexpr u32 COMPLEMENTED[] = {1, 2, 8, 12, 17, 20};
+
+}
+
+// Two rounds per iteration, ping-ponging between two arrays of locals so no lanes are copied between rounds.
+void keccakF1600(u64 s[25]) {
+  u64 a[25], e[25];
+  memcpy(a, s, sizeof(a));
+  for (u32 i : COMPLEMENTED) { a[i] = ~a[i]; }
+  for (u32 round = 0; round < 24; round += 2) {
+    keccakRound(a, e, RC[round]);
+    keccakRound(e, a, RC[round + 1]);
+  }
+  for (u32 i : COMPLEMENTED) { a[i] = ~a[i]; }
+  memcpy(s, a, sizeof(a));
+}
+
+void Keccak256::update(const void* data, u32 size) {
+  const u8* p = reinterpret_cast<const u8*>(data);
+  while (size) {
+    if (nLoaded == 0 && size >= RATE) {
+      // Whole blocks, the common case.
+      for (; size >= RATE; p += RATE, size -= RATE) {
+        for (u32 i = 0; i < RATE / 8; ++i) { state[i] ^= loadLE(p + 8 * i); }
+        keccakF1600(state);
+      }
+      continue;
+    }
+    if (nLoaded % 8 == 0 && size >= 8) {
+      while (size >= 8 && nLoaded < RATE) {
+        state[nLoaded / 8] ^= loadLE(p);
+        p += 8;
+        size -= 8;
+        nLoaded += 8;
+      }
+    } else {
+      state[nLoaded / 8] ^= u64(*p++) << (8 * (nLoaded % 8));
+      --size;
+      ++nLoaded;
+    }
+    if (nLoaded == RATE) {
+      keccakF1600(state);
+      nLoaded = 0;
+    }
+  }
+}
+
+array<u64, 4> Keccak256::finish() && {
+  state[nLoaded / 8] ^= u64(0x06) << (8 * (nLoaded % 8));
+  state[(RATE - 1) / 8] ^= u64(0x80) << (8 * ((RATE - 1) % 8));
+  keccakF1600(state);
+  return {state[0], state[1], state[2], state[3]};
+}
+
+#if KECCAK_AVX2
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+namespace {
+
+inline __m256i rol(__m256i x, int n) { return _mm256_or_si256(_mm256_slli_epi64(x, n), _mm256_srli_epi64(x, 64 - n)); }
+
+// Four independent Keccak-f[1600] states, one per 64-bit lane of each vector.
+void keccakF1600x4(__m256i s[25]) {
+  __m256i a0 = s[0], a1 = s[1], a2 = s[2], a3 = s[3], a4 = s[4], a5 = s[5], a6 = s[6], a7 = s[7], a8 = s[8],
+          a9 = s[9], a10 = s[10], a11 = s[11], a12 = s[12], a13 = s[13], a14 = s[14], a15 = s[15], a16 =
+          s[16], a17 = s[17], a18 = s[18], a19 = s[19], a20 = s[20], a21 = s[21], a22 = s[22], a23 = s[23],
+          a24 = s[24];
+  __m256i C0, C1, C2, C3, C4, D0, D1, D2, D3, D4;
+  __m256i b0, b1, b2, b3, b4, b5, b6, b7, b8, b9, b10, b11, b12, b13, b14, b15, b16, b17, b18, b19, b20, b21, b22, b23, b24;
+
+  for (u32 round = 0; round < 24; ++round) {
+    C0 = _mm256_xor_si256(_mm256_xor_si256(_mm256_xor_si256(_mm256_xor_si256(a0, a5), a10), a15), a20);
+    C1 = _mm256_xor_si256(_mm256_xor_si256(_mm256_xor_si256(_mm256_xor_si256(a1, a6), a11), a16), a21);
+    C2 = _mm256_xor_si256(_mm256_xor_si256(_mm256_xor_si256(_mm256_xor_si256(a2, a7), a12), a17), a22);
+    C3 = _mm256_xor_si256(_mm256_xor_si256(_mm256_xor_si256(_mm256_xor_si256(a3, a8), a13), a18), a23);
+    C4 = _mm256_xor_si256(_mm256_xor_si256(_mm256_xor_si256(_mm256_xor_si256(a4, a9), a14), a19), a24);
+    D0 = _mm256_xor_si256(C4, rol(C1, 1));
+    D1 = _mm256_xor_si256(C0, rol(C2, 1));
+    D2 = _mm256_xor_si256(C1, rol(C3, 1));
+    D3 = _mm256_xor_si256(C2, rol(C4, 1));
+    D4 = _mm256_xor_si256(C3, rol(C0, 1));
+    b0 = _mm256_xor_si256(a0, D0);
+    b16 = rol(_mm256_xor_si256(a5, D0), 36);
+    b7 = rol(_mm256_xor_si256(a10, D0), 3);
+    b23 = rol(_mm256_xor_si256(a15, D0), 41);
+    b14 = rol(_mm256_xor_si256(a20, D0), 18);
+    b10 = rol(_mm256_xor_si256(a1, D1), 1);
+    b1 = rol(_mm256_xor_si256(a6, D1), 44);
+    b17 = rol(_mm256_xor_si256(a11, D1), 10);
+    b8 = rol(_mm256_xor_si256(a16, D1), 45);
+    b24 = rol(_mm256_xor_si256(a21, D1), 2);
+    b20 = rol(_mm256_xor_si256(a2, D2), 62);
+    b11 = rol(_mm256_xor_si256(a7, D2), 6);
+    b2 = rol(_mm256_xor_si256(a12, D2), 43);
+    b18 = rol(_mm256_xor_si256(a17, D2), 15);
+    b9 = rol(_mm256_xor_si256(a22, D2), 61);
+    b5 = rol(_mm256_xor_si256(a3, D3), 28);
+    b21 = rol(_mm256_xor_si256(a8, D3), 55);
+    b12 = rol(_mm256_xor_si256(a13, D3), 25);
+    b3 = rol(_mm256_xor_si256(a18, D3), 21);
+    b19 = rol(_mm256_xor_si256(a23, D3), 56);
+    b15 = rol(_mm256_xor_si256(a4, D4), 27);
+    b6 = rol(_mm256_xor_si256(a9, D4), 20);
+    b22 = rol(_mm256_xor_si256(a14, D4), 39);
+    b13 = rol(_mm256_xor_si256(a19, D4), 8);
+    b4 = rol(_mm256_xor_si256(a24, D4), 14);
+    a0 = _mm256_xor_si256(b0, _mm256_andnot_si256(b1, b2));
+    a1 = _mm256_xor_si256(b1, _mm256_andnot_si256(b2, b3));
+    a2 = _mm256_xor_si256(b2, _mm256_andnot_si256(b3, b4));
+    a3 = _mm256_xor_si256(b3, _mm256_andnot_si256(b4, b0));
+    a4 = _mm256_xor_si256(b4, _mm256_andnot_si256(b0, b1));
+    a5 = _mm256_xor_si256(b5, _mm256_andnot_si256(b6, b7));
+    a6 = _mm256_xor_si256(b6, _mm256_andnot_si256(b7, b8));
+    a7 = _mm256_xor_si256(b7, _mm256_andnot_si256(b8, b9));
+    a8 = _mm256_xor_si256(b8, _mm256_andnot_si256(b9, b5));
+    a9 = _mm256_xor_si256(b9, _mm256_andnot_si256(b5, b6));
+    a10 = _mm256_xor_si256(b10, _mm256_andnot_si256(b11, b12));
+    a11 = _mm256_xor_si256(b11, _mm256_andnot_si256(b12, b13));
+    a12 = _mm256_xor_si256(b12, _mm256_andnot_si256(b13, b14));
+    a13 = _mm256_xor_si256(b13, _mm256_andnot_si256(b14, b10));
+    a14 = _mm256_xor_si256(b14, _mm256_andnot_si256(b10, b11));
+    a15 = _mm256_xor_si256(b15, _mm256_andnot_si256(b16, b17));
+    a16 = _mm256_xor_si256(b16, _mm256_andnot_si256(b17, b18));
+    a17 = _mm256_xor_si256(b17, _mm256_andnot_si256(b18, b19));
+    a18 = _mm256_xor_si256(b18, _mm256_andnot_si256(b19, b15));
+    a19 = _mm256_xor_si256(b19, _mm256_andnot_si256(b15, b16));
+    a20 = _mm256_xor_si256(b20, _mm256_andnot_si256(b21, b22));
+    a21 = _mm256_xor_si256(b21, _mm256_andnot_si256(b22, b23));
+    a22 = _mm256_xor_si256(b22, _mm256_andnot_si256(b23, b24));
+    a23 = _mm256_xor_si256(b23, _mm256_andnot_si256(b24, b20));
+    a24 = _mm256_xor_si256(b24, _mm256_andnot_si256(b20, b21));
+    a0 = _mm256_xor_si256(a0, _mm256_set1_epi64x(RC[round]));
+  }
+
+  s[0] = a0; s[1] = a1; s[2] = a2; s[3] = a3; s[4] = a4;
+  s[5] = a5; s[6] = a6; s[7] = a7; s[8] = a8; s[9] = a9;
+  s[10] = a10; s[11] = a11; s[12] = a12; s[13] = a13; s[14] = a14;
+  s[15] = a15; s[16] = a16; s[17] = a17; s[18] = a18; s[19] = a19;
+  s[20] = a20; s[21] = a21; s[22] = a22; s[23] = a23; s[24] = a24;
+}
+
+void absorbx4(__m256i s[25], const u8* const blocks[4]) {
+  for (u32 i = 0; i < Keccak256::RATE / 8; ++i) {
+    __m256i x = _mm256_set_epi64x(loadLE(blocks[3] + 8 * i), loadLE(blocks[2] + 8 * i), loadLE(blocks[1] + 8 * i), loadLE(blocks[0] + 8 * i));
+    s[i] = _mm256_xor_si256(s[i], x);
+  }
+  keccakF1600x4(s);
+}
+
+// The lanes take part in every permutation; after its last (padded) block a lane absorbs zero blocks, and its
+// digest was taken right after that last block.
+array<array<u64, 4>, 4> sha3x4AVX2(const void* const data[4], const size_t size[4]) {
+  __m256i s[25];
+  for (__m256i& x : s) { x = _mm256_setzero_si256(); }
+
+  size_t nFull[4];
+  u8 tails[4][Keccak256::RATE];
+  for (int j = 0; j < 4; ++j) {
+    nFull[j] = size[j] / Keccak256::RATE;
+    padBlock(tails[j], reinterpret_cast<const u8*>(data[j]) + nFull[j] * Keccak256::RATE, size[j] % Keccak256::RATE);
+  }
+  static const u8 zeros[Keccak256::RATE]{};
+
+  array<array<u64, 4>, 4> ret;
+  for (size_t b = 0, end = *std::max_element(nFull, nFull + 4); b <= end; ++b) {
+    const u8* blocks[4];
+    for (int j = 0; j < 4; ++j) {
+      blocks[j] = b < nFull[j] ? reinterpret_cast<const u8*>(data[j]) + b * Keccak256::RATE : b == nFull[j] ? tails[j] : zeros;
+    }
+    absorbx4(s, blocks);
+
+    alignas(32) u64 out[4][4];
+    for (int i = 0; i < 4; ++i) { _mm256_store_si256(reinterpret_cast<__m256i*>(out[i]), s[i]); }
+    for (int j = 0; j < 4; ++j) {
+      if (b == nFull[j]) { ret[j] = {out[0][j], out[1][j], out[2][j], out[3][j]}; }
+    }
+  }
+  return ret;
+}
+
+}
+
+#pragma GCC pop_options
+
+bool keccakHasAVX2() {
+  static const bool has = __builtin_cpu_supports("avx2");
+  return has;
+}
+
+#else
+
+bool keccakHasAVX2() { return false; }
+
+#endif
+
+array<array<u64, 4>, 4> sha3x4(const void* const data[4], const size_t size[4]) {
+#if KECCAK_AVX2
+  if (keccakHasAVX2()) { return sha3x4AVX2(data, size); }
+#endif
+  array<array<u64, 4>, 4> ret;
+  for (int j = 0; j < 4; ++j) {
+    Keccak256 h;
+    const u8* p = reinterpret_cast<const u8*>(data[j]);
+    for (size_t done = 0; done < size[j];) {
+      u32 n = u32(std::min<size_t>(size[j] - done, 1u << 30));
+      h.update(p + done, n);
+      done += n;
+    }
+    ret[j] = std::move(h).finish();
+  }
+  return ret;
+}
@@ -0,0 +1,30 @@
+// Copyright Mihai Preda.
+
+#pragma once
+
+#include "common.h"
+
+#include <array>
+
+// Keccak-f[1600] on 25 64-bit lanes.
+void keccakF1600(u64 state[25]);
+
+// SHA3-256 over keccakF1600(). Gives the same digests as sha3.cpp (SHA3Init(256), SHA3Update, SHA3Final),
+// absorbing whole 64-bit lanes instead of bytes.
+class Keccak256 {
+public:
+  static const constexpr u32 RATE = 136; // bytes per block
+
+  void update(const void* data, u32 size);
+  array<u64, 4> finish() &&;
+
+private:
+  u64 state[25]{};
+  u32 nLoaded = 0; // bytes absorbed into the current block
+};
+
+// The SHA3-256 digests of four messages, hashed together; best when the sizes are about the same.
+// Uses the AVX2 4-way Keccak when the CPU supports it.
+array<array<u64, 4>, 4> sha3x4(const void* const data[4], const size_t size[4]);
+
+bool keccakHasAVX2();
@@ -0,0 +1,35 @@
+// Copyright Mihai Preda.
+
+#include "Lookahead.h"
+#include "Worktodo.h"
+#include "Task.h"
+#include "Args.h"
+#include "log.h"
+
+void Lookahead::start(const Task& current) {
+  if (setup.valid()) { return; }
+  
+  optional<Task> next = Worktodo::peekNext(args, current);
+  if (!next || next->kind == Task::VERIFY) { return; }
+  
+  nextE = next->exponent;
+  log("preparing %u in the background\n", nextE);
+  setup = std::async(std::launch::async, [this, E = nextE]() {
+    LogContext context{to_string(E)};
+    return Gpu::prepare(E, args);
+  });
+}
+
+unique_ptr<Gpu> Lookahead::makeGpu(u32 E) {
+  if (setup.valid()) {
+    bool match = (E == nextE);
+    nextE = 0;
+    try {
+      GpuSetup s = setup.get();
+      if (match) { return Gpu::make(std::move(s), args); }
+    } catch (...) {
+      // Failed in the background; the exception, if still relevant, is raised again below.
+    }
+  }
+  return Gpu::make(E, args);
+}
@@ -0,0 +1,30 @@
+// Copyright Mihai Preda.
+
+#pragma once
+
+#include "Gpu.h"
+#include "common.h"
+
+#include <future>
+#include <memory>
+
+class Args;
+struct Task;
+
+// Prepares, on a host thread, the Gpu for the task that follows the current one:
+// the worktodo line is parsed, the OpenCL program compiled and the weights and trig tables generated
+// while the device is still busy with the tail of the current task.
+class Lookahead {
+  const Args& args;
+  u32 nextE = 0;
+  std::future<GpuSetup> setup;
+
+public:
+  explicit Lookahead(const Args& args) : args{args} {}
+
+  // Start preparing for the task following "current". Only the first call per task has an effect.
+  void start(const Task& current);
+
+  // Returns a Gpu for exponent E, using the prepared setup if it matches.
+  unique_ptr<Gpu> makeGpu(u32 E);
+};
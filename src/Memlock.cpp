@@ -5,9 +5,24 @@
 #include "common.h"
 #include "Signal.h"
 
+#include <atomic>
 #include <thread>
 #include <chrono>
 
+#if !(defined(_WIN32) || defined(__WIN32__))
+#define HAS_SHM 1
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <ctime>
+#include <cerrno>
+#else
+#define HAS_SHM 0
+#endif
+
 namespace {
 
 error_code& noThrow() {
@@ -15,9 +30,66 @@ error_code& noThrow() {
   return dummy;
 }
 
+float MB(size_t bytes) { return bytes / (1024.0f * 1024); }
+
 }
 
-Memlock::Memlock(fs::path base, u32 device) : lock{base / ("memlock-"s + to_string(device))} {
+#if HAS_SHM
+
+struct Memlock::Shared {
+  static constexpr u32 MAGIC = 0x6d656d32; // "mem2"
+  static constexpr u32 MAX_HOLDERS = 64;
+
+  struct Holder {
+    pid_t pid;       // 0 for a free entry
+    bool granted;
+    u64 ticket;      // the FIFO order
+    u64 bytes;
+    u64 budget;      // the budget this holder was started with
+  };
+
+  std::atomic<u32> magic;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  u64 nextTicket;
+  Holder holders[MAX_HOLDERS];
+
+  // Maps the segment, creating and initializing it if needed. Null on failure.
+  static Shared *open(const string& name);
+
+  void lock() {
+    // A holder of the mutex died; the entries stay consistent enough, as the dead are reaped anyway.
+    if (pthread_mutex_lock(&mutex) == EOWNERDEAD) { pthread_mutex_consistent(&mutex); }
+  }
+
+  void unlock() { pthread_mutex_unlock(&mutex); }
+
+  // Frees the entries of the processes that are gone. Returns whether there were any.
+  bool reapDead();
+
+  // The smallest budget among the live holders, so it goes back up when the holder with the smallest leaves.
+  u64 budget() const {
+    u64 b = u64(-1);
+    for (const Holder& h : holders) { if (h.pid) { b = std::min(b, h.budget); } }
+    return b;
+  }
+};
+
+#endif
+
+Memlock::Memlock(fs::path base, u32 device, size_t bytes, size_t budget)
+  : lock{base / ("memlock-"s + to_string(device))}, bytes{bytes} {
+#if HAS_SHM
+  // crc32, unlike std::hash, is the same in every build, so that different gpuowl binaries share the broker.
+  string path = fs::absolute(lock).string();
+  string name = "/gpuowl-mem-"s + hex(crc32(path.data(), path.size()));
+  if (acquireShared(name, budget)) { return; }
+  log("Memory broker '%s' not available, using the memory lock directory\n", name.c_str());
+#endif
+  acquireDir();
+}
+
+void Memlock::acquireDir() {
   if (!fs::create_directory(lock, noThrow())) {
     log("Waiting for memory lock '%s'\n", lock.string().c_str());
     Signal signal;
@@ -26,11 +98,167 @@ Memlock::Memlock(fs::path base, u32 device) : lock{base / ("memlock-"s + to_stri
       if (signal.stopRequested()) { throw "stop requested"; }
     } while (!fs::create_directory(lock, noThrow()));
   }
-  
+
   log("Acquired memory lock '%s'\n", lock.string().c_str());
 }
 
+#if HAS_SHM
+
+namespace {
+
+bool isAlive(pid_t pid) { return kill(pid, 0) == 0 || errno != ESRCH; }
+
+}
+
+Memlock::Shared *Memlock::Shared::open(const string& name) {
+  bool created = true;
+  int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0 && errno == EEXIST) {
+    created = false;
+    fd = shm_open(name.c_str(), O_RDWR, 0600);
+  }
+  if (fd < 0) { return nullptr; }
+  if (created && ftruncate(fd, sizeof(Shared))) {
+    close(fd);
+    shm_unlink(name.c_str());
+    return nullptr;
+  }
+
+  // The creator may not have sized the segment yet.
+  struct stat st{};
+  for (int i = 0; i < 1000 && !fstat(fd, &st) && st.st_size < off_t(sizeof(Shared)); ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  void *p = st.st_size < off_t(sizeof(Shared)) && !created ? MAP_FAILED
+    : mmap(nullptr, sizeof(Shared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) { return nullptr; }
+  Shared *s = static_cast<Shared *>(p);
+
+  if (created) {
+    pthread_mutexattr_t ma;
+    pthread_mutexattr_init(&ma);
+    pthread_mutexattr_setpshared(&ma, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&ma, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&s->mutex, &ma);
+    pthread_mutexattr_destroy(&ma);
+
+    pthread_condattr_t ca;
+    pthread_condattr_init(&ca);
+    pthread_condattr_setpshared(&ca, PTHREAD_PROCESS_SHARED);
+    pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+    pthread_cond_init(&s->cond, &ca);
+    pthread_condattr_destroy(&ca);
+
+    s->magic.store(Shared::MAGIC, std::memory_order_release);
+  } else {
+    // Wait for the creator to initialize it; if it died doing so the segment is unusable.
+    for (int i = 0; i < 1000 && s->magic.load(std::memory_order_acquire) != Shared::MAGIC; ++i) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if (s->magic.load(std::memory_order_acquire) != Shared::MAGIC) {
+      munmap(s, sizeof(Shared));
+      return nullptr;
+    }
+  }
+  return s;
+}
+
+bool Memlock::Shared::reapDead() {
+  bool any = false;
+  for (Holder& h : holders) {
+    if (h.pid && !isAlive(h.pid)) {
+      log("Memory broker: reclaiming %.0f MB from exited process %d\n", MB(h.bytes), int(h.pid));
+      h.pid = 0;
+      any = true;
+    }
+  }
+  return any;
+}
+
+bool Memlock::acquireShared(const string& name, size_t budget) {
+  shared = Shared::open(name);
+  if (!shared) { return false; }
+  Shared *s = shared;
+
+  s->lock();
+  s->reapDead();
+
+  u32 n = 0;
+  while (n < Shared::MAX_HOLDERS && s->holders[n].pid) { ++n; }
+  if (n == Shared::MAX_HOLDERS) {
+    s->unlock();
+    munmap(s, sizeof(Shared));
+    shared = nullptr;
+    return false;
+  }
+  slot = n;
+  Shared::Holder& me = s->holders[slot];
+  me = {getpid(), false, s->nextTicket++, bytes, budget};
+
+  // Granted when first in line, and when it fits next to the granted ones or there are none.
+  auto grantable = [s, &me]() {
+    u64 used = 0;
+    for (const Shared::Holder& h : s->holders) {
+      if (!h.pid) { continue; }
+      if (h.granted) {
+        used += h.bytes;
+      } else if (h.ticket < me.ticket) {
+        return false;
+      }
+    }
+    return used == 0 || used + me.bytes <= s->budget();
+  };
+
+  if (!grantable()) {
+    u32 ahead = 0;
+    for (const Shared::Holder& h : s->holders) { ahead += h.pid && (h.granted || h.ticket < me.ticket); }
+    log("Waiting for %.0f MB of device memory (budget %.0f MB) behind %u holders\n", MB(bytes), MB(s->budget()), ahead);
+    Signal signal;
+    while (true) {
+      // The timeout polls for a stop request and for holders that died without releasing.
+      timespec t{};
+      clock_gettime(CLOCK_MONOTONIC, &t);
+      t.tv_sec += 1;
+      if (pthread_cond_timedwait(&s->cond, &s->mutex, &t) == EOWNERDEAD) { pthread_mutex_consistent(&s->mutex); }
+      if (s->reapDead()) { pthread_cond_broadcast(&s->cond); }
+      if (grantable()) { break; }
+      if (signal.stopRequested()) {
+        me.pid = 0;
+        pthread_cond_broadcast(&s->cond);
+        s->unlock();
+        munmap(s, sizeof(Shared));
+        shared = nullptr;
+        throw "stop requested";
+      }
+    }
+  }
+  me.granted = true;
+  // The next in line may fit too.
+  pthread_cond_broadcast(&s->cond);
+  s->unlock();
+  log("Acquired %.0f MB of device memory from broker '%s'\n", MB(bytes), name.c_str());
+  return true;
+}
+
+#else
+
+bool Memlock::acquireShared(const string&, size_t) { return false; }
+
+#endif
+
 Memlock::~Memlock() {
+#if HAS_SHM
+  if (shared) {
+    shared->lock();
+    shared->holders[slot].pid = 0;
+    pthread_cond_broadcast(&shared->cond);
+    shared->unlock();
+    munmap(shared, sizeof(Shared));
+    log("Released %.0f MB of device memory\n", MB(bytes));
+    return;
+  }
+#endif
   fs::remove(lock, noThrow());
   log("Released memory lock '%s'\n", lock.string().c_str());
 }
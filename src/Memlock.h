@@ -7,10 +7,28 @@
 
 namespace fs = std::filesystem;
 
+// Arbitrates the device memory of the memory-hungry phases (proof generation) between the instances sharing a
+// device. Each holder declares how many bytes it needs; the requests are granted in FIFO order, as long as the
+// granted total fits the budget (a request larger than the budget is granted alone). A release wakes the waiters
+// at once. The state is a POSIX shared memory segment with a process-shared robust mutex, so the grants of a
+// process that died are reclaimed. Without shared memory, falls back to a lock directory polled every 5 seconds.
 class Memlock {
-  fs::path lock;
-  
+  struct Shared;
+
+  fs::path lock;         // the directory fallback
+  Shared *shared{};
+  u32 slot{};
+  size_t bytes;
+
+  bool acquireShared(const string& name, size_t budget);
+  void acquireDir();
+
 public:
-  Memlock(fs::path base, u32 device);
+  // budget: the device bytes available to the phases, or 0 to allow only one holder at a time.
+  // The smallest budget among the instances holding or waiting applies.
+  Memlock(fs::path base, u32 device, size_t bytes, size_t budget);
   ~Memlock();
+
+  Memlock(const Memlock&) = delete;
+  void operator=(const Memlock&) = delete;
 };
@@ -0,0 +1,239 @@
+// Copyright Mihai Preda.
+
+#include "Ntt.h"
+#include "Engine.h"
+#include "Gpu.h"
+#include "log.h"
+
+#include <cassert>
+
+namespace {
+
+constexpr u32 P1 = Ntt::P1, G1 = Ntt::G1;
+constexpr u32 P2 = Ntt::P2, G2 = Ntt::G2;
+constexpr u32 MAX_L = 1u << 26; // the largest power of two dividing both P1 - 1 and P2 - 1
+constexpr u32 INV_P1 = Ntt::INV_P1;
+
+u32 mulMod(u32 a, u32 b, u32 p) { return u64(a) * b % p; }
+
+u32 powMod(u32 a, u64 e, u32 p) {
+  u32 r = 1;
+  for (; e; e >>= 1, a = mulMod(a, a, p)) { if (e & 1) { r = mulMod(r, a, p); } }
+  return r;
+}
+
+u32 log2Ceil(u64 x) {
+  u32 n = 0;
+  while ((u64(1) << n) < x) { ++n; }
+  return n;
+}
+
+// The largest digit size for which the convolution sums, at most nDigits * (2^bits - 1)^2, stay below 2^61 < P1 * P2.
+u32 digitBits(u32 E) {
+  for (u32 bits = 24; bits > 1; --bits) {
+    u32 nDigits = (E - 1) / bits + 1;
+    if (log2Ceil(nDigits) + 2 * bits <= 61) { return bits; }
+  }
+  return 1;
+}
+
+// "n" bits of "words" starting at bit "from", zero beyond the end.
+u32 bitsAt(const Words& words, u32 from, u32 n) {
+  assert(n <= 32);
+  u32 i = from / 32, shift = from % 32;
+  u64 w = i < words.size() ? words[i] : 0;
+  if (i + 1 < words.size()) { w |= u64(words[i + 1]) << 32; }
+  w >>= shift;
+  return n == 32 ? u32(w) : u32(w & ((1u << n) - 1));
+}
+
+// a := a + b mod 2^E - 1, both below 2^E; the result is below 2^E.
+void addMod(u32 E, Words& a, const Words& b) {
+  u32 topBits = E % 32 ? E % 32 : 32;
+  u64 carry = 0;
+  while (true) {
+    for (u32 i = 0; i < a.size(); ++i) {
+      u64 s = u64(a[i]) + (i < b.size() ? b[i] : 0) + carry;
+      a[i] = u32(s);
+      carry = s >> 32;
+    }
+    // The carry out of bit E wraps around to bit 0, as 2^E == 1.
+    if (topBits < 32) {
+      carry += a.back() >> topBits;
+      a.back() &= (1u << topBits) - 1;
+    }
+    if (!carry) { break; }
+    for (u32 i = 0; i < a.size() && carry; ++i) {
+      u64 s = u64(a[i]) + carry;
+      a[i] = u32(s);
+      carry = s >> 32;
+    }
+    if (topBits < 32) {
+      carry = a.back() >> topBits;
+      a.back() &= (1u << topBits) - 1;
+    }
+    if (!carry) { break; }
+  }
+}
+
+// 2^E - 1 is zero.
+void canonical(u32 E, Words& a) {
+  u32 topBits = E % 32 ? E % 32 : 32;
+  for (u32 i = 0; i + 1 < a.size(); ++i) { if (a[i] != ~0u) { return; } }
+  if (a.back() == (topBits == 32 ? ~0u : (1u << topBits) - 1)) { std::fill(a.begin(), a.end(), 0); }
+}
+
+}
+
+Ntt::Prime::Prime(u32 p, u32 generator, u32 L) : p{p}, iL{powMod(L, p - 2, p)} {
+  u32 w = powMod(generator, (p - 1) / L, p);
+  u32 iw = powMod(w, p - 2, p);
+  for (u32 k = 0, x = 1, ix = 1; k < L / 2; ++k, x = mulMod(x, w, p), ix = mulMod(ix, iw, p)) {
+    roots.push_back(x);
+    iRoots.push_back(ix);
+  }
+}
+
+// In-place on bit-reversed input; the inverse includes the 1/L scaling.
+void Ntt::Prime::transform(vector<u32>& v, bool inverse) const {
+  u32 L = v.size();
+  const vector<u32>& w = inverse ? iRoots : roots;
+  for (u32 len = 2; len <= L; len *= 2) {
+    u32 half = len / 2;
+    u32 step = L / len;
+    for (u32 start = 0; start < L; start += len) {
+      for (u32 j = 0; j < half; ++j) {
+        u32 a = v[start + j];
+        u32 b = mulMod(v[start + j + half], w[j * step], p);
+        v[start + j] = a + b >= p ? a + b - p : a + b;
+        v[start + j + half] = a >= b ? a - b : a + p - b;
+      }
+    }
+  }
+  if (inverse) { for (u32& x : v) { x = mulMod(x, iL, p); } }
+}
+
+Ntt::Ntt(u32 E) :
+  E{E},
+  bits{digitBits(E)},
+  nDigits{(E - 1) / bits + 1},
+  L{u32(1) << log2Ceil(2 * u64(nDigits))},
+  primes{Prime{P1, G1, L}, Prime{P2, G2, L}},
+  bitRev(L) {
+  if (L > MAX_L) { throw "exponent too large for the NTT"; }
+  u32 logL = log2Ceil(L);
+  for (u32 i = 0; i < L; ++i) {
+    u32 r = 0;
+    for (u32 b = 0; b < logL; ++b) { r |= ((i >> b) & 1) << (logL - 1 - b); }
+    bitRev[i] = r;
+  }
+  log("NTT %u digits of %u bits, transform length %u\n", nDigits, bits, L);
+}
+
+vector<u32> Ntt::split(const Words& words) const {
+  vector<u32> digits(nDigits);
+  for (u32 i = 0; i < nDigits; ++i) { digits[i] = bitsAt(words, i * bits, bits); }
+  return digits;
+}
+
+Words Ntt::join(const vector<u32>& digits) const {
+  assert(digits.size() == nDigits);
+  // The digit sum, up to 2^(nDigits * bits + 1).
+  Words full((nDigits * bits + 1) / 32 + 2);
+  u64 carry = 0;
+  for (u32 i = 0; i <= nDigits; ++i) {
+    u64 x = (i < nDigits ? digits[i] : 0) + carry;
+    u32 digit = x & ((1u << bits) - 1);
+    carry = x >> bits;
+    u32 pos = i * bits;
+    full[pos / 32] |= digit << (pos % 32);
+    if (pos % 32 + bits > 32) { full[pos / 32 + 1] |= digit >> (32 - pos % 32); }
+  }
+  assert(!carry);
+  return fold(full);
+}
+
+// 2^E == 1: the bits from E upwards, E at a time, added to the low E bits.
+Words Ntt::fold(const Words& full) const {
+  u32 nWords = (E - 1) / 32 + 1;
+  Words lo(nWords);
+  for (u32 from = 0; from < full.size() * 32; from += E) {
+    Words part(nWords);
+    for (u32 i = 0; i < nWords; ++i) { part[i] = bitsAt(full, from + 32 * i, (i + 1 == nWords && E % 32) ? E % 32 : 32); }
+    addMod(E, lo, part);
+  }
+  canonical(E, lo);
+  return lo;
+}
+
+// From the residues of the convolution modulo the two primes, the product modulo 2^E - 1.
+Words Ntt::fromProduct(const vector<u32>& r1, const vector<u32>& r2) const {
+  // The full product, 2 * nDigits digits of "bits" after the carry propagation.
+  u32 nWords = (E - 1) / 32 + 1;
+  Words full(2 * nWords + 2);
+  u64 carry = 0;
+  for (u32 i = 0; i < 2 * nDigits; ++i) {
+    u64 c = 0;
+    if (i < L) {
+      u32 a = r1[i];
+      u32 t = mulMod((r2[i] + P2 - a % P2) % P2, INV_P1, P2);
+      c = a + u64(P1) * t;
+    }
+    u64 x = c + carry;
+    u32 digit = x & ((1u << bits) - 1);
+    carry = x >> bits;
+    u32 pos = i * bits;
+    full[pos / 32] |= digit << (pos % 32);
+    if (pos % 32 + bits > 32) { full[pos / 32 + 1] |= digit >> (32 - pos % 32); }
+  }
+  assert(!carry);
+  return fold(full);
+}
+
+// a * b, or a^2 when b is null.
+Words Ntt::mul(const Words& a, const Words* b) const {
+  // The digits in bit-reversed order, zero-padded to L.
+  auto toDigits = [this](const Words& words) {
+    vector<u32> digits = split(words);
+    vector<u32> v(L);
+    for (u32 i = 0; i < nDigits; ++i) { v[bitRev[i]] = digits[i]; }
+    return v;
+  };
+  vector<u32> x1 = toDigits(a);
+  vector<u32> x2 = x1;
+  primes[0].transform(x1, false);
+  primes[1].transform(x2, false);
+  if (b) {
+    vector<u32> y1 = toDigits(*b);
+    vector<u32> y2 = y1;
+    primes[0].transform(y1, false);
+    primes[1].transform(y2, false);
+    for (u32 i = 0; i < L; ++i) {
+      x1[i] = mulMod(x1[i], y1[i], P1);
+      x2[i] = mulMod(x2[i], y2[i], P2);
+    }
+  } else {
+    for (u32 i = 0; i < L; ++i) {
+      x1[i] = mulMod(x1[i], x1[i], P1);
+      x2[i] = mulMod(x2[i], x2[i], P2);
+    }
+  }
+  // Back to bit-reversed order for the inverse transform.
+  for (u32 i = 0; i < L; ++i) {
+    if (i < bitRev[i]) {
+      std::swap(x1[i], x1[bitRev[i]]);
+      std::swap(x2[i], x2[bitRev[i]]);
+    }
+  }
+  primes[0].transform(x1, true);
+  primes[1].transform(x2, true);
+  return fromProduct(x1, x2);
+}
+
+Words Ntt::expMul(const Words& A, u64 h, const Words& B) { return engine::expMul(this, A, h, B); }
+
+Words Ntt::expMul2(const Words& A, u64 h, const Words& B) { return engine::expMul2(this, A, h, B); }
+
+Words Ntt::expExp2(const Words& A, u32 n) { return engine::expExp2(this, A, n); }
+
+PRPResult Ntt::isPrimePRP(const Args& args, const Task& task) { return engine::isPrimePRP(this, args, task); }
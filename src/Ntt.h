@@ -0,0 +1,81 @@
+// Copyright Mihai Preda.
+
+#pragma once
+
+#include "common.h"
+
+#include <array>
+
+struct PRPResult;
+class Args;
+class Task;
+
+// Squaring modulo 2^E - 1 with an integer number-theoretic transform: no floating point and thus no round-off.
+// The residue is split into b-bit digits and squared with a zero-padded (acyclic) convolution over the two NTT primes
+// 15*2^27+1 and 27*2^26+1, combined with CRT; the double-length product is then folded modulo 2^E - 1.
+// b is the largest such that the convolution sums stay below the product of the primes.
+// A portable CPU implementation, with the Words interface of Gpu used by the Gerbicz check and by proof verification;
+// also the bit-exact reference of the device NTT (NttGpu).
+class Ntt {
+public:
+  // The two NTT primes, with a primitive root of each.
+  static constexpr u32 P1 = 15 * (1u << 27) + 1, G1 = 31;
+  static constexpr u32 P2 = 27 * (1u << 26) + 1, G2 = 13;
+  static constexpr u32 INV_P1 = 1811939320; // 1/P1 mod P2
+
+  struct Prime {
+    u32 p;
+    vector<u32> roots, iRoots; // the powers of the L-th root of unity and of its inverse, L/2 each
+    u32 iL;                    // 1/L
+
+    Prime(u32 p, u32 generator, u32 L);
+    void transform(vector<u32>& v, bool inverse) const;
+  };
+
+  const u32 E;
+  const u32 bits; // per digit
+  const u32 nDigits;
+  const u32 L;    // the transform length, a power of two >= 2 * nDigits
+
+private:
+  std::array<Prime, 2> primes;
+  vector<u32> bitRev;
+
+  Words fromProduct(const vector<u32>& r1, const vector<u32>& r2) const;
+  Words fold(const Words& full) const;
+  Words mul(const Words& a, const Words* b) const;
+
+public:
+  explicit Ntt(u32 E);
+
+  u32 getFFTSize() const { return L; }
+  const Prime& prime(u32 i) const { return primes[i]; }
+
+  // The residue as nDigits digits of "bits"; and back, from digits that may each go up to 2^bits.
+  vector<u32> split(const Words& words) const;
+  Words join(const vector<u32>& digits) const;
+
+  Words square(const Words& a) const { return mul(a, nullptr); }
+  Words mul(const Words& a, const Words& b) const { return mul(a, &b); }
+
+  // The residues of the engine interface (Engine.h) are Words.
+  using Res = Words;
+  Res toRes(const Words& words) { return words; }
+  Words fromRes(const Res& a) { return a; }
+  Res copyRes(const Res& a) { return a; }
+  void squareRes(Res& a) { a = square(a); }
+  void mulRes(Res& a, const Res& b) { a = mul(a, b); }
+
+  // return A^h * B
+  Words expMul(const Words& A, u64 h, const Words& B);
+
+  // return A^h * B^2
+  Words expMul2(const Words& A, u64 h, const Words& B);
+
+  // return A^(2^n)
+  Words expExp2(const Words& A, u32 n);
+
+  // PRP test of 2^E - 1 from 3, with the Gerbicz check of Gpu::isPrimePRP() every blockSize^2 iterations, the same
+  // savefiles, and the same proof.
+  PRPResult isPrimePRP(const Args& args, const Task& task);
+};
@@ -0,0 +1,184 @@
+// Copyright Mihai Preda.
+
+#include "NttGpu.h"
+#include "Engine.h"
+#include "Args.h"
+#include "Gpu.h"
+#include "log.h"
+#include "timeutil.h"
+
+#include <cassert>
+#include <random>
+
+extern const char *NTT_SOURCE;
+
+namespace {
+
+// Digits carried in sequence by one item of nttCarryA and nttCarryB.
+constexpr u32 CHUNK = 32;
+
+u32 log2Ceil(u32 x) {
+  u32 n = 0;
+  while ((1u << n) < x) { ++n; }
+  return n;
+}
+
+u32 mulMod(u32 a, u32 b, u32 p) { return u64(a) * b % p; }
+
+// x * 2^32 mod p
+u32 toMont(u32 x, u32 p) { return (u64(x) << 32) % p; }
+
+// -1/p mod 2^32
+u32 negInv(u32 p) {
+  u32 inv = p; // good to 3 bits, each step doubles them
+  for (int i = 0; i < 4; ++i) { inv *= 2 - p * inv; }
+  assert(inv * p == 1);
+  return -inv;
+}
+
+// The roots of both primes, P1 then P2, in Montgomery form.
+vector<u32> montRoots(const Ntt& ntt, bool inverse) {
+  vector<u32> ret;
+  for (u32 i = 0; i < 2; ++i) {
+    const Ntt::Prime& prime = ntt.prime(i);
+    for (u32 w : inverse ? prime.iRoots : prime.roots) { ret.push_back(toMont(w, prime.p)); }
+  }
+  return ret;
+}
+
+cl_program compileNtt(const Args& args, cl_context context, cl_device_id id, const Ntt& ntt, u32 nChunks) {
+  auto define = [](const string& label, u32 value) { return label + '=' + to_string(value) + 'u'; };
+  // 1/L * R^2, as the pointwise product is followed by a Montgomery multiplication by it.
+  auto scale = [&ntt](u32 i) {
+    const Ntt::Prime& prime = ntt.prime(i);
+    u32 r = toMont(1, prime.p);
+    return mulMod(prime.iL, mulMod(r, r, prime.p), prime.p);
+  };
+  vector<string> defines{
+    define("L", ntt.L),
+    define("NDIGITS", ntt.nDigits),
+    define("BITS", ntt.bits),
+    define("PAD", ntt.nDigits * ntt.bits - ntt.E),
+    define("CHUNK", CHUNK),
+    define("NCHUNKS", nChunks),
+    define("P1", Ntt::P1),
+    define("P2", Ntt::P2),
+    define("PINV1", negInv(Ntt::P1)),
+    define("PINV2", negInv(Ntt::P2)),
+    define("SCALE1", scale(0)),
+    define("SCALE2", scale(1)),
+    define("INV_P1M", toMont(Ntt::INV_P1, Ntt::P2)),
+  };
+  string clArgs = args.dump.empty() ? ""s : (" -save-temps="s + args.dump + "/ntt");
+  cl_program program = compile(context, id, NTT_SOURCE, clArgs, defines);
+  if (!program) { throw "OpenCL compilation"; }
+  return program;
+}
+
+}
+
+NttGpu::NttGpu(u32 E, const Args& args) :
+  ref{E},
+  E{E},
+  L{ref.L},
+  // The last chunk takes the remainder, so each chunk has at least CHUNK digits to absorb the carry in.
+  nChunks{max(ref.nDigits / CHUNK, 1u)},
+  device{getDevice(args.device)},
+  context{device},
+  program{compileNtt(args, context.get(), device, ref, nChunks)},
+  queue{Queue::make(context, args.timeKernels, args.cudaYield)},
+
+#define LOAD_WS(name, workSize) name{program.get(), queue, device, #name, roundUp(workSize, 64)}
+  LOAD_WS(nttIn, L),
+  LOAD_WS(nttStage, L),
+  LOAD_WS(nttSquare, 2 * L),
+  LOAD_WS(nttMul, 2 * L),
+  LOAD_WS(nttCarryA, nChunks),
+  LOAD_WS(nttCarryB, nChunks),
+#undef LOAD_WS
+
+  bufRoots{context, "nttRoots", montRoots(ref, false)},
+  bufIRoots{context, "nttIRoots", montRoots(ref, true)},
+  bufA{queue, "nttA", 2 * L},
+  bufB{queue, "nttB", 2 * L},
+  bufC{queue, "nttC", 2 * L},
+  bufCarry{queue, "nttCarry", nChunks}
+{
+  // The device products must be those of the CPU Ntt, bit for bit: a square, then a multiplication by it, whose
+  // digits (up to 2^bits) are not those of Words.
+  Timer timer;
+  std::mt19937 rng{E};
+  auto randomWords = [&]() {
+    Words w((E - 1) / 32 + 1);
+    for (u32& x : w) { x = rng(); }
+    if (E % 32) { w.back() &= (1u << (E % 32)) - 1; }
+    return w;
+  };
+  Words x = randomWords();
+  Words y = randomWords();
+  Res a = toRes(x);
+  squareRes(a);
+  Words x2 = ref.square(x);
+  bool ok = fromRes(a) == x2;
+  if (ok) {
+    mulRes(a, toRes(y));
+    ok = fromRes(a) == ref.mul(x2, y);
+  }
+  if (!ok) {
+    log("NTT device products differ from the CPU NTT\n");
+    throw "NTT device check";
+  }
+  log("NTT on the device, checked against the CPU in %.1fs\n", timer.reset());
+}
+
+Buffer<u32>& NttGpu::transform(Buffer<u32>& x, Buffer<u32>& tmp, const ConstBuffer<u32>& roots) {
+  Buffer<u32> *in = &x, *out = &tmp;
+  for (u32 t = 0, logL = log2Ceil(L); t < logL; ++t) {
+    nttStage(*out, *in, roots, t);
+    std::swap(in, out);
+  }
+  return *in;
+}
+
+NttGpu::Res NttGpu::toRes(const Words& words) {
+  Res a{queue, "nttRes", ref.nDigits};
+  a.write(ref.split(words));
+  return a;
+}
+
+Words NttGpu::fromRes(const Res& a) { return ref.join(a.read()); }
+
+NttGpu::Res NttGpu::copyRes(const Res& a) {
+  Res b{queue, "nttRes", ref.nDigits};
+  b << a;
+  return b;
+}
+
+void NttGpu::squareRes(Res& a) {
+  nttIn(bufA, a);
+  Buffer<u32>& x = transform(bufA, bufB, bufRoots);
+  nttSquare(x);
+  Buffer<u32>& y = transform(x, &x == &bufA ? bufB : bufA, bufIRoots);
+  nttCarryA(a, bufCarry, y);
+  nttCarryB(a, bufCarry);
+}
+
+void NttGpu::mulRes(Res& a, const Res& b) {
+  nttIn(bufC, b);
+  Buffer<u32>& y = transform(bufC, bufB, bufRoots);
+  Buffer<u32>& tmp = &y == &bufC ? bufB : bufC;
+  nttIn(bufA, a);
+  Buffer<u32>& x = transform(bufA, tmp, bufRoots);
+  nttMul(x, y);
+  Buffer<u32>& z = transform(x, &x == &bufA ? tmp : bufA, bufIRoots);
+  nttCarryA(a, bufCarry, z);
+  nttCarryB(a, bufCarry);
+}
+
+Words NttGpu::expMul(const Words& A, u64 h, const Words& B) { return engine::expMul(this, A, h, B); }
+
+Words NttGpu::expMul2(const Words& A, u64 h, const Words& B) { return engine::expMul2(this, A, h, B); }
+
+Words NttGpu::expExp2(const Words& A, u32 n) { return engine::expExp2(this, A, n); }
+
+PRPResult NttGpu::isPrimePRP(const Args& args, const Task& task) { return engine::isPrimePRP(this, args, task); }
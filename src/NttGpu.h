@@ -0,0 +1,66 @@
+// Copyright Mihai Preda.
+
+#pragma once
+
+#include "Buffer.h"
+#include "Context.h"
+#include "Queue.h"
+
+#include "common.h"
+#include "kernel.h"
+#include "Ntt.h"
+
+struct PRPResult;
+class Args;
+class Task;
+
+// The integer NTT of Ntt on the device (ntt.cl): the same digits, primes and transform length, bit-exact with the
+// CPU Ntt, which it checks itself against on construction. The residues stay on the device as digits that may reach
+// 2^bits, and are turned into Words only for the checks, the savefiles and the proof.
+class NttGpu {
+  Ntt ref;
+
+public:
+  const u32 E;
+
+private:
+  const u32 L;
+  const u32 nChunks;
+  cl_device_id device;
+  Context context;
+  Holder<cl_program> program;
+  QueuePtr queue;
+
+  Kernel nttIn, nttStage, nttSquare, nttMul, nttCarryA, nttCarryB;
+
+  ConstBuffer<u32> bufRoots, bufIRoots;
+  Buffer<u32> bufA, bufB, bufC;
+  Buffer<u64> bufCarry;
+
+  // Transforms "x" with "tmp", leaving the result in the one returned.
+  Buffer<u32>& transform(Buffer<u32>& x, Buffer<u32>& tmp, const ConstBuffer<u32>& roots);
+
+public:
+  NttGpu(u32 E, const Args& args);
+
+  u32 getFFTSize() const { return L; }
+
+  // The residues of the engine interface (Engine.h).
+  using Res = HostAccessBuffer<u32>;
+  Res toRes(const Words& words);
+  Words fromRes(const Res& a);
+  Res copyRes(const Res& a);
+  void squareRes(Res& a);
+  void mulRes(Res& a, const Res& b);
+
+  // return A^h * B
+  Words expMul(const Words& A, u64 h, const Words& B);
+
+  // return A^h * B^2
+  Words expMul2(const Words& A, u64 h, const Words& B);
+
+  // return A^(2^n)
+  Words expExp2(const Words& A, u32 n);
+
+  PRPResult isPrimePRP(const Args& args, const Task& task);
+};
@@ -1,10 +1,17 @@
 // Copyright (C) Mihai Preda.
 
 #include "Proof.h"
+#include "Args.h"
 #include "ProofCache.h"
 #include "Sha3Hash.h"
+#include "Keccak.h"
 #include "MD5.h"
 #include "Gpu.h"
+#include "Ntt.h"
+#include "NttGpu.h"
+#include "FFGpu.h"
+#include "state.h"
+#include "GmpUtil.h"
 
 #include <vector>
 #include <string>
@@ -12,6 +19,9 @@
 #include <filesystem>
 #include <cinttypes>
 #include <climits>
+#include <algorithm>
+#include <future>
+#include <optional>
 
 #if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
 #error Byte order must be Little Endian
@@ -37,15 +47,35 @@ string fileHash(const fs::path& filePath) {
   return std::move(h).finish();
 }
 
+// Reads the header up to and including the NUMBER line, "M<E>" or "M<E>/<factor>/.." for PRP-CF.
+void readHeader(File& fi, u32 *power, u32 *E, vector<string> *knownFactors) {
+  char c = 0;
+  bool ok = fi.scanf(Proof::HEADER_v2, power, E, &c) == 3 && (c == '\n' || c == '/');
+  if (ok && c == '/') {
+    string tail = fi.readLine();
+    tail.pop_back();
+    for (size_t pos = 0; ok; ) {
+      size_t end = tail.find('/', pos);
+      string f = tail.substr(pos, end == string::npos ? string::npos : end - pos);
+      ok = !f.empty() && std::all_of(f.begin(), f.end(), [](char d) { return d >= '0' && d <= '9'; });
+      knownFactors->push_back(f);
+      if (end == string::npos) { break; }
+      pos = end + 1;
+    }
+    ok = ok && areFactors(*E, *knownFactors);
+  }
+  if (!ok) {
+    log("Proof file '%s' has invalid header\n", fi.name.c_str());
+    throw "Invalid proof header";
+  }
+}
+
 ProofInfo getInfo(const fs::path& proofFile) {
   string hash = proof::fileHash(proofFile);
   File fi = File::openReadThrow(proofFile);
   u32 E = 0, power = 0;
-  char c = 0;
-  if (fi.scanf(Proof::HEADER_v2, &power, &E, &c) != 3 || c != '\n') {
-    log("Proof file '%s' has invalid header\n", proofFile.string().c_str());
-    throw "Invalid proof header";
-  }
+  vector<string> knownFactors;
+  readHeader(fi, &power, &E, &knownFactors);
   return {power, E, hash};
 }
 
@@ -59,30 +89,89 @@ fs::path Proof::file(const fs::path& proofDir) const {
   return proofDir / (strE + '-' + to_string(power) + ".proof");  
 }
 
-void Proof::save(const fs::path& proofFile) const {
+ProofInfo Proof::save(const fs::path& proofFile) const {
   File fo = File::openWrite(proofFile);
   u32 power = middles.size();
-  fo.printf(HEADER_v2, power, E, '\n');
-  fo.write(B.data(), (E-1)/8+1);
-  for (const Words& w : middles) { fo.write(w.data(), (E-1)/8+1); }
+  MD5 h;
+
+  char buf[256];
+  int n = snprintf(buf, sizeof(buf), HEADER_v2, power, E, '\n');
+  assert(n > 0 && n < int(sizeof(buf)));
+  string header{buf, size_t(n - 1)};
+  for (const string& f : knownFactors) { header += '/' + f; }
+  header += '\n';
+  fo.write(header.data(), header.size());
+  h.update(header.data(), header.size());
+
+  u32 nBytes = (E - 1) / 8 + 1;
+  fo.write(B.data(), nBytes);
+  h.update(B.data(), nBytes);
+  for (const Words& w : middles) {
+    fo.write(w.data(), nBytes);
+    h.update(w.data(), nBytes);
+  }
+  return {power, E, std::move(h).finish()};
 }
 
 Proof Proof::load(const fs::path& path) {
   File fi = File::openReadThrow(path);
   u32 E = 0, power = 0;
-  char c = 0;
-  if (fi.scanf(HEADER_v2, &power, &E, &c) != 3 || c != '\n') {
-    log("Proof file '%s' has invalid header\n", path.string().c_str());
-    throw "Invalid proof header";
-  }
+  vector<string> knownFactors;
+  proof::readHeader(fi, &power, &E, &knownFactors);
   u32 nBytes = (E - 1) / 8 + 1;
   Words B = fi.readBytesLE(nBytes);
   vector<Words> middles;
   for (u32 i = 0; i < power; ++i) { middles.push_back(fi.readBytesLE(nBytes)); }
-  return {E, B, middles};
+  return {E, B, middles, knownFactors};
 }
 
-bool Proof::verify(Gpu *gpu) const {
+vector<vector<u64>> Proof::hashes(const vector<const Proof*>& proofs) {
+  u32 n = proofs.size();
+  u32 maxPower = 0;
+  for (const Proof* p : proofs) { maxPower = max(maxPower, u32(p->middles.size())); }
+
+  vector<array<u64, 4>> hash(n);
+  vector<vector<u64>> ret(n);
+
+  // Step 0 hashes B; step i hashes the previous hash followed by middles[i - 1].
+  for (u32 step = 0; step <= maxPower; ++step) {
+    vector<u32> active;
+    vector<vector<u8>> messages;
+    for (u32 j = 0; j < n; ++j) {
+      const Proof& p = *proofs[j];
+      if (step > p.middles.size()) { continue; }
+      active.push_back(j);
+      const u8* words = reinterpret_cast<const u8*>((step ? p.middles[step - 1] : p.B).data());
+      const u8* prefix = reinterpret_cast<const u8*>(hash[j].data());
+      vector<u8>& m = messages.emplace_back();
+      if (step) { m.insert(m.end(), prefix, prefix + sizeof(hash[j])); }
+      m.insert(m.end(), words, words + (p.E - 1) / 8 + 1);
+    }
+
+    for (u32 a = 0; a < active.size(); a += 4) {
+      u32 nLanes = min(u32(active.size()) - a, 4u);
+      if (nLanes == 1) {
+        // One lane of four would be slower than the single-lane Keccak.
+        hash[active[a]] = std::move(SHA3{}.update(messages[a].data(), messages[a].size())).finish();
+        continue;
+      }
+      const void* data[4];
+      size_t sizes[4];
+      for (u32 i = 0; i < 4; ++i) {
+        // The unused lanes hash an empty message.
+        data[i] = messages[a + (i < nLanes ? i : 0)].data();
+        sizes[i] = i < nLanes ? messages[a + i].size() : 0;
+      }
+      auto four = sha3x4(data, sizes);
+      for (u32 i = 0; i < nLanes; ++i) { hash[active[a + i]] = four[i]; }
+    }
+
+    if (step) { for (u32 j : active) { ret[j].push_back(hash[j][0]); } }
+  }
+  return ret;
+}
+
+template<typename Engine> bool Proof::verify(Engine *gpu, const vector<u64>& hashes) const {
   log("B         %016" PRIx64 "\n", res64(B));
   for (u32 i = 0; i < middles.size(); ++i) {
     log("Middle[%u] %016" PRIx64 "\n", i, res64(middles[i]));
@@ -92,17 +181,23 @@ bool Proof::verify(Gpu *gpu) const {
   assert(power > 0);
 
   bool isPrime = (B == makeWords(E, 9));
+  string number = "M"s + to_string(E);
+  if (!knownFactors.empty()) {
+    // PRP-CF: the status is that of the cofactor.
+    Words w = B;
+    Gpu::doDiv9(E, w);
+    isPrime = cofactorPRP(E, w, knownFactors).first;
+    for (const string& f : knownFactors) { number += '/' + f; }
+  }
 
   Words A{makeWords(E, 3)};
   Words B{this->B};
-  
-  auto hash = proof::hashWords(E, B);
+  assert(hashes.size() == power);
 
   u32 span = E;
   for (u32 i = 0; i < power; ++i, span = (span + 1) / 2) {
     const Words& M = middles[i];
-    hash = proof::hashWords(E, hash, M);
-    u64 h = hash[0];    
+    u64 h = hashes[i];
     A = gpu->expMul(A, h, M);
     
     if (span % 2) {
@@ -119,17 +214,44 @@ bool Proof::verify(Gpu *gpu) const {
 
   bool ok = (A == B);
   if (ok) {
-    log("proof: %u proved %s\n", E, isPrime ? "probable prime" : "composite");
+    log("proof: %s proved %s\n", number.c_str(), isPrime ? "probable prime" : "composite");
   } else {
     log("proof: invalid (%016" PRIx64 " expected %016" PRIx64 ")\n", res64(A), res64(B));
   }
   return ok;
 }
 
+template bool Proof::verify(Gpu *, const vector<u64>&) const;
+template bool Proof::verify(Ntt *, const vector<u64>&) const;
+template bool Proof::verify(NttGpu *, const vector<u64>&) const;
+template bool Proof::verify(FFGpu *, const vector<u64>&) const;
+
+template<typename Engine> optional<ProofInfo> Proof::publish(Engine *engine, const Args& args) const {
+  fs::path tmpFile = file(args.proofToVerifyDir);
+  ProofInfo info = save(tmpFile);
+
+  fs::path proofFile = file(args.proofResultDir);
+  bool doVerify = middles.size() >= args.proofVerify;
+  // The proof just written is verified from memory, without reading the file back.
+  bool ok = !doVerify || verify(engine);
+  if (doVerify) { log("Proof '%s' verification %s\n", tmpFile.string().c_str(), ok ? "OK" : "FAILED"); }
+  if (!ok) { return {}; }
+  error_code noThrow;
+  fs::remove(proofFile, noThrow);
+  fs::rename(tmpFile, proofFile);
+  log("Proof '%s' generated, MD5 %s\n", proofFile.string().c_str(), info.md5.c_str());
+  return info;
+}
+
+template optional<ProofInfo> Proof::publish(Gpu *, const Args&) const;
+template optional<ProofInfo> Proof::publish(Ntt *, const Args&) const;
+template optional<ProofInfo> Proof::publish(NttGpu *, const Args&) const;
+template optional<ProofInfo> Proof::publish(FFGpu *, const Args&) const;
+
 // ---- ProofSet ----
 
-ProofSet::ProofSet(const fs::path& tmpDir, u32 E, u32 power)
-  : E{E}, power{power}, exponentDir(tmpDir / to_string(E)) {
+ProofSet::ProofSet(const fs::path& tmpDir, u32 E, u32 power, const vector<string>& knownFactors)
+  : E{E}, power{power}, knownFactors{knownFactors}, exponentDir(tmpDir / to_string(E)) {
   
   assert(E & 1); // E is supposed to be prime
   assert(power > 0);
@@ -170,6 +292,40 @@ u32 ProofSet::effectivePower(const fs::path& tmpDir, u32 E, u32 power, u32 curre
   assert(false);
 }
     
+ProofPlan ProofSet::plan(const fs::path& tmpDir, u32 E, u32 power, u32 currentK, u32 N, u32 deviceBufs) {
+  const double GB = 1024.0 * 1024 * 1024;
+
+  // A checkpoint file of ProofCache: the words and a CRC. Those already written for this exponent count as space.
+  u64 fileBytes = (E / 32 + 2) * sizeof(u32);
+  u64 existing = 0;
+  error_code noThrow;
+  fs::path proofDir = tmpDir / to_string(E) / "proof";
+  for (auto it = fs::directory_iterator(proofDir, noThrow); !noThrow && it != fs::directory_iterator(); it.increment(noThrow)) {
+    existing += it->file_size(noThrow);
+  }
+  auto space = fs::space(tmpDir, noThrow);
+  u64 disk = noThrow ? u64(-1) : space.available + existing;
+
+  u32 p = power;
+  while (p > 0 && (u64(1) << p) * fileBytes > disk) { --p; }
+  if (p < power) {
+    log("proof: power %u needs %.1f GB in '%s' which has %.1f GB available, using power %u\n",
+        power, (u64(1) << power) * fileBytes / GB, tmpDir.string().c_str(), disk / GB, p);
+  }
+  if (p) { p = effectivePower(tmpDir, E, p, currentK); }
+
+  u32 nBufs = std::clamp(deviceBufs, 2u, max(p, 2u));
+  if (p && !N) {
+    log("proof plan: power %u, %.1f GB of checkpoints in '%s'\n", p, (u64(1) << p) * fileBytes / GB, tmpDir.string().c_str());
+  } else if (p) {
+    log("proof plan: power %u, %.1f GB of checkpoints in '%s', %u of %u stack buffers (%.0f MB) on the device%s\n",
+        p, (u64(1) << p) * fileBytes / GB, tmpDir.string().c_str(), nBufs, max(p, 2u),
+        nBufs * u64(N) * sizeof(i32) / (1024.0 * 1024), nBufs < p ? ", the rest spilled to host memory" : "");
+    if (deviceBufs < 2) { log("proof: the device may not have the memory for the 2 stack buffers needed\n"); }
+  }
+  return {p, nBufs};
+}
+
 bool ProofSet::isValidTo(u32 limitK) const {
   for (u32 k : points) {
     if (k > limitK) { break; }
@@ -195,7 +351,86 @@ Words ProofSet::load(u32 k) const {
   return cache.load(k);
 }
 
-Proof ProofSet::computeProof(Gpu *gpu) const {
+namespace {
+
+// The binary-counter stack used by computeProof(). The entries live in device buffers, as many as the
+// maxAlloc budget allows; when these run out the deepest entries are spilled (compacted) to host memory,
+// and brought back when they are needed again.
+class ProofStack {
+  Gpu *gpu;
+  vector<BufferPool::Lease<i32>> bufs;
+  vector<u32> freeBufs;
+
+  struct Entry {
+    std::optional<u32> buf;
+    Words host;
+  };
+  vector<Entry> entries;
+
+  u32 takeBuf(size_t keepFrom) {
+    if (freeBufs.empty()) {
+      // Spill the deepest device-resident entry.
+      auto it = std::find_if(entries.begin(), entries.begin() + keepFrom, [](const Entry& e) { return e.buf.has_value(); });
+      assert(it != entries.begin() + keepFrom);
+      it->host = gpu->readAndCompress(*bufs[*it->buf]);
+      freeBufs.push_back(*it->buf);
+      it->buf.reset();
+    }
+    u32 b = freeBufs.back();
+    freeBufs.pop_back();
+    return b;
+  }
+
+public:
+  ProofStack(Gpu *gpu, u32 nBufs) : gpu{gpu}, bufs{gpu->makeBufVector(nBufs)} {
+    assert(nBufs >= 2);
+    for (u32 i = 0; i < nBufs; ++i) { freeBufs.push_back(nBufs - 1 - i); }
+  }
+
+  size_t size() const { return entries.size(); }
+
+  void push(const vector<i32>& expanded) {
+    u32 b = takeBuf(entries.size());
+    gpu->writeIn(*bufs[b], expanded);
+    entries.push_back({b, {}});
+  }
+
+  // below := below^h * top; pop top.
+  void combine(u64 h) {
+    assert(entries.size() >= 2);
+    Entry& below = entries[entries.size() - 2];
+    if (!below.buf) {
+      below.buf = takeBuf(entries.size() - 2);
+      gpu->writeIn(*bufs[*below.buf], below.host);
+      below.host.clear();
+    }
+    u32 top = *entries.back().buf;
+    gpu->expMul(*bufs[*below.buf], h, *bufs[top]);
+    freeBufs.push_back(top);
+    entries.pop_back();
+  }
+
+  Words pop() {
+    Entry e = std::move(entries.back());
+    entries.pop_back();
+    if (!e.buf) { return e.host; }
+    freeBufs.push_back(*e.buf);
+    return gpu->readAndCompress(*bufs[*e.buf]);
+  }
+};
+
+}
+
+vector<u32> ProofSet::leaves() const {
+  vector<u32> ret;
+  for (u32 p = 0; p < power; ++p) {
+    u32 s = (1u << (power - p - 1));
+    for (u32 i = 0; i < (1u << p); ++i) { ret.push_back(points[s * (i * 2 + 1) - 1]); }
+  }
+  return ret;
+}
+
+Proof ProofSet::computeProof(Gpu *gpu, u32 nBufs) const {
   Words B = load(E);
   Words A = makeWords(E, 3);
 
@@ -204,28 +439,75 @@ Proof ProofSet::computeProof(Gpu *gpu) const {
 
   auto hash = proof::hashWords(E, B);
 
-  vector<Buffer<i32>> bufVect = gpu->makeBufVector(power);
+  vector<u32> leaves = this->leaves();
+
+  // A host thread reads and expands the next residue while the GPU works on the current ones.
+  u32 N = gpu->getFFTSize();
+  auto prefetch = [this, N](u32 k) { return std::async(std::launch::async, [this, N, k]() { return expandBits(load(k), N, E); }); };
+  auto nextLeaf = leaves.begin();
+  auto next = prefetch(*nextLeaf++);
+
+  // Planned when the test started; only a device that has less free memory now changes the plan.
+  if (u32 avail = std::max(gpu->maxBuffers(), 2u); avail < nBufs) {
+    log("proof: %u stack buffers fit on the device instead of the %u planned\n", avail, nBufs);
+    nBufs = avail;
+  }
+  if (nBufs < power) { log("proof: using %u GPU buffers, spilling to host memory\n", nBufs); }
+  ProofStack stack{gpu, nBufs};
 
   for (u32 p = 0; p < power; ++p) {
-    auto bufIt = bufVect.begin();
     assert(p == hashes.size());
-    u32 s = (1u << (power - p - 1));
     for (u32 i = 0; i < (1u << p); ++i) {
-      Words w = load(points[s * (i * 2 + 1) - 1]);
-      gpu->writeIn(*bufIt++, w);
+      vector<i32> leaf = next.get();
+      if (nextLeaf != leaves.end()) { next = prefetch(*nextLeaf++); }
+      stack.push(leaf);
       for (u32 k = 0; i & (1u << k); ++k) {
         assert(k <= p - 1);
-        --bufIt;
-        u64 h = hashes[p - 1 - k];
-        gpu->expMul(*(bufIt - 1), h, *bufIt);
+        stack.combine(hashes[p - 1 - k]);
       }
     }
-    assert(bufIt == bufVect.begin() + 1);
-    middles.push_back(gpu->readAndCompress(bufVect.front()));
+    assert(stack.size() == 1);
+    middles.push_back(stack.pop());
     hash = proof::hashWords(E, hash, middles.back());
     hashes.push_back(hash[0]);
 
     log("proof level %u : M %016" PRIx64 ", h %016" PRIx64 "\n", p, res64(middles.back()), hashes.back()); 
   }
-  return Proof{E, std::move(B), std::move(middles)};
+  return Proof{E, std::move(B), std::move(middles), knownFactors};
 }
+
+template<typename Engine> Proof ProofSet::computeProof(Engine *engine) const {
+  Words B = load(E);
+  vector<Words> middles;
+  vector<u64> hashes;
+  auto hash = proof::hashWords(E, B);
+
+  vector<u32> leaves = this->leaves();
+  auto nextLeaf = leaves.begin();
+  vector<Words> stack;
+
+  for (u32 p = 0; p < power; ++p) {
+    assert(p == hashes.size());
+    for (u32 i = 0; i < (1u << p); ++i) {
+      stack.push_back(load(*nextLeaf++));
+      for (u32 k = 0; i & (1u << k); ++k) {
+        assert(k <= p - 1);
+        Words top = std::move(stack.back());
+        stack.pop_back();
+        stack.back() = engine->expMul(stack.back(), hashes[p - 1 - k], top);
+      }
+    }
+    assert(stack.size() == 1);
+    middles.push_back(std::move(stack.back()));
+    stack.pop_back();
+    hash = proof::hashWords(E, hash, middles.back());
+    hashes.push_back(hash[0]);
+
+    log("proof level %u : M %016" PRIx64 ", h %016" PRIx64 "\n", p, res64(middles.back()), hashes.back());
+  }
+  return Proof{E, std::move(B), std::move(middles), knownFactors};
+}
+
+template Proof ProofSet::computeProof(Ntt *) const;
+template Proof ProofSet::computeProof(NttGpu *) const;
+template Proof ProofSet::computeProof(FFGpu *) const;
@@ -9,6 +9,7 @@
 namespace fs = std::filesystem;
 
 class Gpu;
+class Args;
 
 struct ProofInfo {
   u32 power;
@@ -33,6 +34,7 @@ public:
   const u32 E;
   const Words B;
   const vector<Words> middles;
+  const vector<string> knownFactors{}; // PRP-CF: the proof is of the same residues, the NUMBER is the cofactor
 
   /*Example header:
     PRP PROOF\n
@@ -40,22 +42,44 @@ public:
     HASHSIZE=64\n
     POWER=8\n
     NUMBER=M216091\n
+    With known factors (PRP-CF) the last line is e.g. NUMBER=M1277/2551/6361\n
   */
   static const constexpr char* HEADER_v2 = "PRP PROOF\nVERSION=2\nHASHSIZE=64\nPOWER=%u\nNUMBER=M%u%c";
 
   static Proof load(const fs::path& path);
   
-  void save(const fs::path& proofResultDir) const;
+  // Writes the proof and returns its info, with the MD5 computed on the bytes as they are written.
+  ProofInfo save(const fs::path& proofFile) const;
 
   fs::path file(const fs::path& proofDir) const;
   
-  bool verify(Gpu *gpu) const;
+  // The hash h of each middle, as used by verify(); it depends only on the contents of the proof.
+  vector<u64> hashes() const { return hashes({this})[0]; }
+
+  // The hashes of several proofs. The chains are sequential, but the steps of different proofs are not, and are
+  // done four at a time with sha3x4().
+  static vector<vector<u64>> hashes(const vector<const Proof*>& proofs);
+
+  // With a Gpu, or with an engine of Engine.h (Ntt, NttGpu, FFGpu).
+  template<typename Engine> bool verify(Engine *gpu) const { return verify(gpu, hashes()); }
+  template<typename Engine> bool verify(Engine *gpu, const vector<u64>& hashes) const;
+
+  // Saves the proof to the proofResultDir by way of the proofToVerifyDir; from the -autoverify power on, it is
+  // verified with "engine" first. Empty if the verification failed.
+  template<typename Engine> optional<ProofInfo> publish(Engine *engine, const Args& args) const;
+};
+
+// What the proof generation of a PRP test fits in.
+struct ProofPlan {
+  u32 power; // limited by the tmpDir free space and by the checkpoints already there
+  u32 nBufs; // the proof stack buffers on the device; with fewer than power, the deepest entries spill to host memory
 };
 
 class ProofSet {
 public:
   const u32 E;
   const u32 power;
+  const vector<string> knownFactors; // for the NUMBER of the proof
   
 private:  
   fs::path exponentDir;
@@ -66,13 +90,20 @@ private:
   
   bool isValidTo(u32 limitK) const;
 
+  // The residues in the order computeProof() consumes them.
+  vector<u32> leaves() const;
+
   static bool canDo(const fs::path& tmpDir, u32 E, u32 power, u32 currentK);
 
 public:
   
   static u32 effectivePower(const fs::path& tmpDir, u32 E, u32 power, u32 currentK);
+
+  // The highest power up to "power" whose checkpoints fit in tmpDir, and the proof stack buffers that fit in the
+  // "deviceBufs" free buffers of N words; N is 0 for a proof built on the CPU. Logs the plan.
+  static ProofPlan plan(const fs::path& tmpDir, u32 E, u32 power, u32 currentK, u32 N, u32 deviceBufs);
   
-  ProofSet(const fs::path& tmpDir, u32 E, u32 power);
+  ProofSet(const fs::path& tmpDir, u32 E, u32 power, const vector<string>& knownFactors = {});
     
   u32 next(u32 k) const;
 
@@ -80,5 +111,9 @@ public:
 
   Words load(u32 k) const;
         
-  Proof computeProof(Gpu *gpu) const;
+  // With the nBufs stack buffers of the plan, fewer if the device memory has shrunk since.
+  Proof computeProof(Gpu *gpu, u32 nBufs) const;
+
+  // With the entries of the stack in host memory: with the CPU Ntt, NttGpu or FFGpu.
+  template<typename Engine> Proof computeProof(Engine *engine) const;
 };
@@ -0,0 +1,103 @@
+// Copyright Mihai Preda.
+
+#pragma once
+
+#include "common.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+// Statistics of the per-iteration round-off error (ROE, the max over all the words of one iteration).
+// The device bins the ROE of each window into a histogram (kernel roeHist); here the windows are summed up over a test.
+// The per-iteration maxima are fitted with a Gumbel distribution (by moments) to estimate the probability that
+// any iteration reaches 0.5, see https://en.wikipedia.org/wiki/Gumbel_distribution
+struct RoeStats {
+  // The histogram covers [0, 0.5]; must match ROE_BINS in gpuowl.cl
+  static constexpr u32 NBINS = 256;
+
+  static double binValue(u32 bin) { return (bin + 0.5) * (0.5 / NBINS); }
+
+  // From a summary as stored in the savefile.
+  static RoeStats fromSummary(u32 N, double mean, double sd, float max) {
+    return {N, N * mean, N * (sd * sd + mean * mean), max};
+  }
+
+  u32 N{};
+  double sum{};
+  double sumSq{};
+  float max{};
+
+  // "hist" has NBINS bins, "m" is the exact max.
+  static RoeStats fromHist(const vector<u32>& hist, float m) {
+    assert(hist.size() == NBINS);
+    RoeStats s{0, 0, 0, m};
+    for (u32 i = 0; i < NBINS; ++i) {
+      double x = binValue(i);
+      s.N += hist[i];
+      s.sum += hist[i] * x;
+      s.sumSq += hist[i] * x * x;
+    }
+    return s;
+  }
+
+  RoeStats& operator+=(const RoeStats& o) {
+    N += o.N;
+    sum += o.sum;
+    sumSq += o.sumSq;
+    max = std::max(max, o.max);
+    return *this;
+  }
+
+  double mean() const { return N ? sum / N : 0; }
+  double rms() const { return N ? sqrt(sumSq / N) : 0; }
+  double sd() const { return N ? sqrt(std::max(0.0, sumSq / N - mean() * mean())) : 0; }
+
+  // The probability of a round-off error (ROE >= 0.5) in any of E iterations.
+  double pErr(u32 E) const { return N < 2 ? 0 : pErr(mean(), sd(), E); }
+
+  static double pErr(double mean, double sd, u32 E) {
+    if (sd == 0) { return 0; }
+    double gamma = 0.577215665; // Euler-Mascheroni
+    double z = (0.5 - mean) / sd;
+    return -expm1(-exp(-z * (M_PI / sqrt(6))) * (E * exp(-gamma)));
+  }
+
+  // Least-squares fit of y = a + b * x.
+  static pair<double, double> fitLine(const vector<double>& x, const vector<double>& y) {
+    u32 n = x.size();
+    assert(n >= 2 && y.size() == n);
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    for (u32 i = 0; i < n; ++i) {
+      sx += x[i];
+      sy += y[i];
+      sxx += x[i] * x[i];
+      sxy += x[i] * y[i];
+    }
+    double b = (n * sxy - sx * sy) / (n * sxx - sx * sx);
+    return {(sy - b * sx) / n, b};
+  }
+
+  // The log2 of the mean and of the SD of the ROE are about linear in bits-per-word (each extra bit
+  // quadruples the products). The limit is the bits-per-word in [lo, hi] where the fitted pErr of a test of
+  // bpw * fftSize iterations reaches targetPErr. "samples" are (bits-per-word, ROE) pairs.
+  static double fitLimit(const vector<pair<double, RoeStats>>& samples, u32 fftSize, double lo, double hi, double targetPErr) {
+    vector<double> x, logMean, logSD;
+    for (const auto& [bpw, roe] : samples) {
+      x.push_back(bpw);
+      logMean.push_back(log2(roe.mean()));
+      logSD.push_back(log2(roe.sd()));
+    }
+    auto [a, b] = fitLine(x, logMean);
+    auto [c, d] = fitLine(x, logSD);
+    auto pErrAt = [&](double bpw) { return pErr(exp2(a + b * bpw), exp2(c + d * bpw), u32(bpw * fftSize)); };
+
+    if (pErrAt(lo) >= targetPErr) { return lo; }
+    if (pErrAt(hi) <= targetPErr) { return hi; }
+    while (hi - lo > 0.001) {
+      double mid = (lo + hi) / 2;
+      (pErrAt(mid) < targetPErr ? lo : hi) = mid;
+    }
+    return lo;
+  }
+};
@@ -12,6 +12,7 @@
 #include <cassert>
 #include <cinttypes>
 #include <string>
+#include <algorithm>
 
 namespace fs = std::filesystem;
 
@@ -19,6 +20,9 @@ namespace {
 
 u32 nWords(u32 E) { return (E - 1) / 32 + 1; }
 
+// The size of a PRP savefile, with the header.
+u64 prpFileBytes(u32 E) { return u64(nWords(E)) * sizeof(u32) + 128; }
+
 error_code& noThrow() {
   static error_code dummy;
   return dummy;
@@ -26,10 +30,10 @@ error_code& noThrow() {
 
 }
 
-vector<u32> Saver::listIterations(const string& prefix, const string& ext) {
+vector<u32> Saver::listIterations(const fs::path& dir, const string& prefix, const string& ext) {
   vector<u32> ret;
-  if (!fs::exists(base)) { fs::create_directory(base); }
-  for (auto entry : fs::directory_iterator(base)) {
+  if (!fs::exists(dir)) { fs::create_directory(dir); }
+  for (auto entry : fs::directory_iterator(dir)) {
     if (entry.is_regular_file()) {
       string name = entry.path().filename().string();
       u32 dot = name.find('.');
@@ -49,51 +53,43 @@ vector<u32> Saver::listIterations(const string& prefix, const string& ext) {
   return ret;
 }
 
+// The PRP savefiles in base and in the tier, sorted.
 vector<u32> Saver::listIterations() {
-  return listIterations(to_string(E) + '-', ".prp");
+  vector<u32> ret = listIterations(base, to_string(E) + '-', ".prp");
+  if (!tier.empty() && fs::exists(tier)) {
+    vector<u32> more = listIterations(tier, to_string(E) + '-', ".prp");
+    ret.insert(ret.end(), more.begin(), more.end());
+  }
+  std::sort(ret.begin(), ret.end());
+  ret.erase(std::unique(ret.begin(), ret.end()), ret.end());
+  return ret;
 }
 
 void Saver::cleanup(u32 E, const Args& args) {
   if (args.clean) {
     fs::path here = fs::current_path();
     fs::remove_all(here / to_string(E), noThrow());
+    if (!args.saveTier.empty()) { fs::remove_all(args.saveTier / to_string(E), noThrow()); }
   }
 }
 
-float Saver::value(u32 k) {
-  assert(k > 0);
-  u32 dist = (k < E) ? (E - k) : 1;
-  u32 nice = 1;
-
-  while (k % 2 == 0) {
-    k /= 2;
-    nice *= 2;
-
-    if (k % 5 == 0) {
-      k /= 5;
-      nice *= 5;
-    }
-  }
-      
-  return nice / float(dist);
-}
-
-Saver::Saver(u32 E, u32 nKeep, u32 startFrom, const fs::path& mprimeDir)
-  : E{E}, nKeep{max(nKeep, 5u)}, mprimeDir{mprimeDir} {
+Saver::Saver(u32 E, u32 nKeep, u32 startFrom, const fs::path& mprimeDir, u64 budget, const fs::path& tierDir)
+  : E{E}, nKeep{max(nKeep, 5u)}, startFrom{startFrom}, mprimeDir{mprimeDir}, budget{budget},
+    tier{tierDir.empty() ? fs::path{} : tierDir / to_string(E)} {
   scan(startFrom);
 }
 
 void Saver::scan(u32 upToK) {
   lastK = 0;
-  minValPRP = {};
+  kept.clear();
   
-  vector<u32> iterations = listIterations();
-  for (u32 k : iterations) {
+  for (u32 k : listIterations()) {
     if (k <= upToK) {
-      minValPRP.push({value(k), k});
+      kept.push_back(k);
       lastK = max(lastK, k);
     }
   }
+  if (!kept.empty()) { logRetention(); }
 }
 
 void Saver::deleteBadSavefiles(u32 kBad, u32 currentK) {
@@ -108,20 +104,82 @@ void Saver::deleteBadSavefiles(u32 kBad, u32 currentK) {
   scan(kBad);
 }
 
+fs::path Saver::findPRP(u32 k) const {
+  fs::path p = pathPRP(k);
+  return tier.empty() || fs::exists(p) ? p : tierPathPRP(k);
+}
+
 void Saver::del(u32 k) {
   // log("Note: deleting savefile %u\n", k);
   fs::remove(pathPRP(k), noThrow()); 
+  if (!tier.empty()) { fs::remove(tierPathPRP(k), noThrow()); }
+}
+
+// Keeps the savefiles log-spaced back from the most recent: the rollback distance after losing the newest i savefiles
+// grows geometrically with i, instead of the oldest ones crowding out the recent. The most recent is always kept.
+// Removes the savefile which leaves the smallest gap relative to its age: (next - prev) / (lastK - next + 1).
+void Saver::thin() {
+  u32 maxKeep = nKeep;
+  if (budget) { maxKeep = min<u64>(maxKeep, max<u64>(budget / prpFileBytes(E), 2)); }
+
+  while (kept.size() > maxKeep) {
+    u32 best = 0;
+    double bestScore = 0;
+    for (u32 i = 0; i + 1 < kept.size(); ++i) {
+      u32 prev = i ? kept[i - 1] : 0;
+      u32 next = kept[i + 1];
+      double score = double(next - prev) / (lastK - next + 1);
+      if (i == 0 || score < bestScore) {
+        best = i;
+        bestScore = score;
+      }
+    }
+    del(kept[best]);
+    kept.erase(kept.begin() + best);
+  }
+}
+
+void Saver::moveToTier() {
+  if (tier.empty() || kept.size() <= 2) { return; }
+  fs::create_directories(tier, noThrow());
+  for (u32 i = 0; i + 2 < kept.size(); ++i) {
+    u32 k = kept[i];
+    fs::path from = pathPRP(k);
+    if (!fs::exists(from)) { continue; }
+    fs::path to = tierPathPRP(k);
+    error_code ec;
+    fs::rename(from, to, ec);
+    if (ec) {
+      // A different filesystem.
+      fs::copy_file(from, to, fs::copy_options::overwrite_existing, ec);
+      if (ec) {
+        log("Can't move savefile @ %u to '%s': %s\n", k, tier.string().c_str(), ec.message().c_str());
+        fs::remove(to, noThrow());
+        continue;
+      }
+      fs::remove(from, noThrow());
+    }
+  }
+}
+
+// The metrics of the retention: the space used, and the iterations to redo when the newest savefiles are bad.
+void Saver::logRetention() const {
+  string rework;
+  for (u32 i = 1; i <= 3; ++i) {
+    u32 back = i < kept.size() ? lastK - kept[kept.size() - 1 - i] : lastK;
+    rework += (i > 1 ? ", "s : ""s) + to_string(back);
+  }
+  log("savefiles: %u kept, %.0f MB%s; rework if the newest 1, 2, 3 are bad: %s iterations\n",
+      u32(kept.size()), kept.size() * prpFileBytes(E) / (1024.0 * 1024),
+      tier.empty() ? "" : (" (all but 2 in '"s + tier.string() + "')"s).c_str(), rework.c_str());
 }
 
 void Saver::savedPRP(u32 k) {
   assert(k >= lastK);
-  while (minValPRP.size() >= nKeep) {
-    auto kDel = minValPRP.top().second;
-    minValPRP.pop();
-    del(kDel);
-  }
   lastK = k;
-  minValPRP.push({value(k), k});
+  kept.push_back(k);
+  thin();
+  moveToTier();
 }
 
 namespace {
@@ -148,7 +206,7 @@ PRPState Saver::loadPRP(u32 iniBlockSize) {
 
 PRPState Saver::loadPRPAux(u32 k) {
   assert(k > 0);
-  fs::path path = pathPRP(k);
+  fs::path path = findPRP(k);
   File fi = File::openReadThrow(path);
   string header = fi.readLine();
 
@@ -156,7 +214,15 @@ PRPState Saver::loadPRPAux(u32 k) {
   u64 res64;
   vector<u32> check;
   u32 b1, nBits, start, nextK;
-  if (sscanf(header.c_str(), PRP_v12, &fileE, &fileK, &blockSize, &res64, &nErrors, &crc) == 6) {
+  u32 roeN;
+  double roeMean, roeSD;
+  float roeMax;
+  RoeStats roe;
+  if (sscanf(header.c_str(), PRP_v13, &fileE, &fileK, &blockSize, &res64, &nErrors, &crc, &roeN, &roeMean, &roeSD, &roeMax) == 10) {
+    assert(E == fileE && k == fileK);
+    check = fi.readWithCRC<u32>(nWords(E), crc);
+    roe = RoeStats::fromSummary(roeN, roeMean, roeSD, roeMax);
+  } else if (sscanf(header.c_str(), PRP_v12, &fileE, &fileK, &blockSize, &res64, &nErrors, &crc) == 6) {
     assert(E == fileE && k == fileK);
     check = fi.readWithCRC<u32>(nWords(E), crc);
   } else if (sscanf(header.c_str(), PRP_v10, &fileE, &fileK, &blockSize, &res64, &nErrors) == 5
@@ -167,7 +233,7 @@ PRPState Saver::loadPRPAux(u32 k) {
     log("In file '%s': bad header '%s'\n", fi.name.c_str(), header.c_str());
     throw "bad savefile";
   }
-  return {k, blockSize, res64, check, nErrors};
+  return {k, blockSize, res64, check, nErrors, roe};
 }
 
 void Saver::savePRP(const PRPState& state) {
@@ -178,13 +244,107 @@ void Saver::savePRP(const PRPState& state) {
   {
     File fo = File::openWrite(path);
 
-    if (fo.printf(PRP_v12, E, k, state.blockSize, state.res64, state.nErrors, crc32(state.check)) <= 0) {
+    const RoeStats& roe = state.roe;
+    if (fo.printf(PRP_v13, E, k, state.blockSize, state.res64, state.nErrors, crc32(state.check),
+                  roe.N, roe.mean(), roe.sd(), roe.max) <= 0) {
       throw(ios_base::failure("can't write header"));
     }    
     fo.write(state.check);
   }
   loadPRPAux(k);
   savedPRP(k);
+  // Superseded by the verified savefile.
+  deleteEmergency();
+}
+
+std::optional<PRPEmergencyState> Saver::loadEmergency() {
+  File fi = File::openRead(pathEmergency());
+  if (!fi) { return {}; }
+  string header = fi.readLine();
+  u32 fileE, k, blockSize, nErrors, dataCrc, checkCrc;
+  u64 res64;
+  if (sscanf(header.c_str(), PRP_EMERGENCY_v1, &fileE, &k, &blockSize, &res64, &nErrors, &dataCrc, &checkCrc) != 7
+      || fileE != E) {
+    log("In file '%s': bad header '%s'\n", fi.name.c_str(), header.c_str());
+    deleteEmergency();
+    return {};
+  }
+  if (k <= lastK) {
+    log("Emergency checkpoint @ %u is older than the savefile @ %u, ignored\n", k, lastK);
+    deleteEmergency();
+    return {};
+  }
+  try {
+    Words data = fi.readWithCRC<u32>(nWords(E), dataCrc);
+    Words check = fi.readWithCRC<u32>(nWords(E), checkCrc);
+    return PRPEmergencyState{k, blockSize, res64, data, check, nErrors};
+  } catch (...) {
+    log("Emergency checkpoint @ %u can't be read, ignored\n", k);
+    deleteEmergency();
+    return {};
+  }
+}
+
+void Saver::saveEmergency(const PRPEmergencyState& state) {
+  assert(state.data.size() == nWords(E) && state.check.size() == nWords(E));
+  {
+    File fo = File::openWrite(pathEmergency() + ".new");
+    if (fo.printf(PRP_EMERGENCY_v1, E, state.k, state.blockSize, state.res64, state.nErrors,
+                  crc32(state.data), crc32(state.check)) <= 0) {
+      throw(ios_base::failure("can't write header"));
+    }
+    fo.write(state.data);
+    fo.write(state.check);
+  }
+  fs::rename(pathEmergency() + ".new", pathEmergency());
+}
+
+void Saver::deleteEmergency() { fs::remove(pathEmergency(), noThrow()); }
+
+// --- LL ---
+
+LLState Saver::loadLL() {
+  vector<u32> iterations = listIterations(base, to_string(E) + '-', ".ll");
+  u32 k = 0;
+  for (u32 it : iterations) { if (it <= startFrom) { k = max(k, it); } }
+  if (!k) {
+    log("LL starting from beginning\n");
+    return {0, makeVect(nWords(E), 4), 0};
+  }
+  return loadLLAux(k);
+}
+
+LLState Saver::loadLLAux(u32 k) {
+  assert(k > 0);
+  File fi = File::openReadThrow(pathLL(k));
+  string header = fi.readLine();
+
+  u32 fileE, fileK, nErrors, crc;
+  if (sscanf(header.c_str(), LL_v1, &fileE, &fileK, &nErrors, &crc) != 4) {
+    log("In file '%s': bad header '%s'\n", fi.name.c_str(), header.c_str());
+    throw "bad savefile";
+  }
+  assert(E == fileE && k == fileK);
+  return {k, fi.readWithCRC<u32>(nWords(E), crc), nErrors};
+}
+
+void Saver::saveLL(const LLState& state) {
+  assert(state.data.size() == nWords(E));
+  u32 k = state.k;
+  {
+    File fo = File::openWrite(pathLL(k));
+    if (fo.printf(LL_v1, E, k, state.nErrors, crc32(state.data)) <= 0) {
+      throw(ios_base::failure("can't write header"));
+    }
+    fo.write(state.data);
+  }
+  loadLLAux(k);
+
+  // Keep the nKeep most recent up to k; the ones beyond k (after a -from) are left alone.
+  vector<u32> iterations;
+  for (u32 it : listIterations(base, to_string(E) + '-', ".ll")) { if (it <= k) { iterations.push_back(it); } }
+  std::sort(iterations.begin(), iterations.end());
+  for (u32 i = 0; i + nKeep < iterations.size(); ++i) { fs::remove(pathLL(iterations[i]), noThrow()); }
 }
 
 // --- P1 ---
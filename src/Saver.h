@@ -4,11 +4,11 @@
 
 #include "File.h"
 #include "common.h"
+#include "RoeStats.h"
 
 #include <vector>
 #include <string>
 #include <cinttypes>
-#include <queue>
 
 class Args;
 
@@ -18,6 +18,24 @@ struct PRPState {
   u64 res64{};
   vector<u32> check;
   u32 nErrors{};
+  RoeStats roe{};
+};
+
+// Written on SIGTERM at any iteration, without a Gerbicz check: the data too, as it can't be recomputed from the check
+// within a block. Verified by the first check after resuming.
+struct PRPEmergencyState {
+  u32 k{};
+  u32 blockSize{};
+  u64 res64{};
+  Words data;
+  Words check;
+  u32 nErrors{};
+};
+
+struct LLState {
+  u32 k{};
+  Words data;
+  u32 nErrors{};
 };
 
 struct P1State {
@@ -37,19 +55,29 @@ class Saver {
   // E, k, block-size, res64, nErrors, CRC
   static constexpr const char *PRP_v12 = "OWL PRP 12 %u %u %u %016" SCNx64 " %u %u\n";
 
+  // E, k, block-size, res64, nErrors, CRC
+  // ROE summary: N, mean, SD, max
+  static constexpr const char *PRP_v13 = "OWL PRP 13 %u %u %u %016" SCNx64 " %u %u %u %lg %lg %g\n";
+
   static constexpr const char *P1_v3 = "OWL P1 3 E=%u B1=%u k=%u\n";
 
+  // E, k, block-size, res64, nErrors, data CRC, check CRC
+  static constexpr const char *PRP_EMERGENCY_v1 = "OWL PRPE 1 %u %u %u %016" SCNx64 " %u %u %u\n";
+
+  // E, k, nErrors, CRC
+  static constexpr const char *LL_v1 = "OWL LL 1 %u %u %u %u\n";
+
   // ----
 
   u32 lastK = 0;
-  
-  using T = pair<float, u32>;
-  using Heap = priority_queue<T, std::vector<T>, std::greater<T>>;
-  Heap minValPRP;
-  
 
-  float value(u32 k);
+  // The PRP savefiles kept, in increasing k. See thin().
+  vector<u32> kept;
+
   void del(u32 k);
+  void thin();
+  void moveToTier();
+  void logRetention() const;
 
   static string str9(u32 k) {
     char buf[32];
@@ -66,30 +94,50 @@ class Saver {
   }
 
   fs::path pathPRP(u32 k) const { return path(str9(k), ".prp"); }
+  fs::path tierPathPRP(u32 k) const { return tier / (to_string(E) + '-' + str9(k) + ".prp"); }
+  // Where the savefile is: in base, or moved to the tier.
+  fs::path findPRP(u32 k) const;
   fs::path pathP1() const       { return base / to_string(E) + ".p1"; }
+  fs::path pathEmergency() const { return base / to_string(E) + ".emergency"; }
+  fs::path pathLL(u32 k) const  { return path(str9(k), ".ll"); }
 
   void savedPRP(u32 k);
 
   PRPState loadPRPAux(u32 k);
-  vector<u32> listIterations(const string& prefix, const string& ext);
+  LLState loadLLAux(u32 k);
+  vector<u32> listIterations(const fs::path& dir, const string& prefix, const string& ext);
   vector<u32> listIterations();
   void scan(u32 upToK = u32(-1));
   
   const u32 E;
   const fs::path base = fs::current_path() / to_string(E);
   const u32 nKeep;
+  const u32 startFrom; // for LL; PRP applies it in scan()
   fs::path mprimeDir;
+  const u64 budget;   // bytes of PRP savefiles, 0 for no limit
+  const fs::path tier; // where the older PRP savefiles go, empty for none
   
 public:
   static void cycle(const fs::path& name);
   static void cleanup(u32 E, const Args& args);
   
-  Saver(u32 E, u32 nKeep, u32 startFrom, const fs::path& mprimeDir);
+  // PRP retention: at most nKeep savefiles, and at most budget bytes of them; all but the two most recent are moved
+  // to the tierDir if given, e.g. a slower and larger disk.
+  Saver(u32 E, u32 nKeep, u32 startFrom, const fs::path& mprimeDir, u64 budget = 0, const fs::path& tierDir = {});
 
 
   PRPState loadPRP(u32 iniBlockSize);  
   void savePRP(const PRPState& state);
 
+  // The emergency checkpoint, if it is more recent than the PRP savefiles.
+  std::optional<PRPEmergencyState> loadEmergency();
+  void saveEmergency(const PRPEmergencyState& state);
+  void deleteEmergency();
+
+  // Only Jacobi-checked LL states are saved, so the most recent one is the rollback point.
+  LLState loadLL();
+  void saveLL(const LLState& state);
+
   P1State loadP1();
   void saveP1(const P1State& state, bool isDone);
   void saveP1Prime95(const P1State& state);
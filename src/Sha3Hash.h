@@ -2,25 +2,17 @@
 
 #pragma once
 
-#include "sha3.h"
+#include "Keccak.h"
 
 #include <array>
 
 class Sha3Hash {
-  SHA3Context context;
-  static const constexpr int SIZE_BITS = 256;
-
-  void clear() { SHA3Init(&context, SIZE_BITS); }
+  Keccak256 keccak;
   
 public:
-  Sha3Hash() { clear(); }
-
-  void update(const void* data, u32 size) { SHA3Update(&context, reinterpret_cast<const unsigned char*>(data), size); }
+  void update(const void* data, u32 size) { keccak.update(data, size); }
   
-  array<u64, 4> finish() && {
-    u64 *p = reinterpret_cast<u64 *>(SHA3Final(&context));
-    return {p[0], p[1], p[2], p[3]};
-  }
+  array<u64, 4> finish() && { return std::move(keccak).finish(); }
 };
 
 #include "Hash.h"
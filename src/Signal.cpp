@@ -3,16 +3,46 @@
 #include "Signal.h"
 
 #include <signal.h>
+#include <atomic>
+#include <mutex>
+
+static std::atomic<unsigned> stop = 0;
+static std::atomic<bool> urgent = false;
+static std::atomic<unsigned> checkpoints = 0; // the SIGUSR1 count
 
-static volatile unsigned stop = 0;
-static void (*oldHandler)(int) = 0;
 static void myHandler(int dummy) { ++stop; }
 
-Signal::Signal() {
-  if (!oldHandler) {
+// A preemption: stop at once, without waiting for the next check.
+static void termHandler(int dummy) {
+  urgent = true;
+  ++stop;
+}
+
+static void checkpointHandler(int dummy) { ++checkpoints; }
+
+#ifdef SIGUSR1
+// SIGUSR1 is handled for the whole life of the process, so that it never kills it, e.g. during a proof build.
+static const bool usr1Installed = (signal(SIGUSR1, checkpointHandler), true);
+#endif
+
+// The SIGUSR1 count last seen by this worker thread; each worker checkpoints once per request.
+static unsigned& seenCheckpoints() {
+  thread_local unsigned seen = checkpoints;
+  return seen;
+}
+
+// The SIGINT and SIGTERM handlers are installed while at least one Signal (e.g. one per device worker) is alive.
+static std::mutex ownersMutex;
+static unsigned nOwners = 0;
+static void (*oldHandler)(int) = 0;
+static void (*oldTermHandler)(int) = 0;
+
+Signal::Signal() : isOwner{true} {
+  seenCheckpoints();
+  std::lock_guard lock(ownersMutex);
+  if (nOwners++ == 0) {
     oldHandler = signal(SIGINT, myHandler);
-    isOwner = true;
-    // assert(oldHandler);
+    oldTermHandler = signal(SIGTERM, termHandler);
   }
 }
 
@@ -20,11 +50,22 @@ Signal::~Signal() { release(); }
 
 unsigned Signal::stopRequested() { return stop; }
 
+bool Signal::urgentStopRequested() { return urgent; }
+
+bool Signal::takeCheckpointRequest() {
+  unsigned n = checkpoints;
+  if (n == seenCheckpoints()) { return false; }
+  seenCheckpoints() = n;
+  return true;
+}
+
 void Signal::release() {
   if (isOwner) {
     isOwner = false;
-    // assert(oldHandler);
-    signal(SIGINT, oldHandler);
-    oldHandler = 0;
+    std::lock_guard lock(ownersMutex);
+    if (--nOwners == 0) {
+      signal(SIGINT, oldHandler);
+      signal(SIGTERM, oldTermHandler);
+    }
   }
 }
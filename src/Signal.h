@@ -9,6 +9,11 @@ public:
   Signal();
   ~Signal();
   
+  // SIGINT or SIGTERM.
   unsigned stopRequested();
+  // SIGTERM, e.g. the preemption of the node: stop now, with an unverified checkpoint.
+  bool urgentStopRequested();
+  // SIGUSR1 since the last call on this thread: make a verified checkpoint, and continue.
+  bool takeCheckpointRequest();
   void release();
 };
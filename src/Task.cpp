@@ -3,6 +3,9 @@
 #include "Task.h"
 
 #include "Gpu.h"
+#include "Ntt.h"
+#include "NttGpu.h"
+#include "FFGpu.h"
 #include "Args.h"
 #include "File.h"
 #include "GmpUtil.h"
@@ -11,11 +14,15 @@
 #include "version.h"
 #include "Proof.h"
 #include "log.h"
+#include "Lookahead.h"
+#include "Background.h"
+#include "timeutil.h"
 
 #include <cstdio>
 #include <cmath>
 #include <thread>
 #include <cassert>
+#include <mutex>
 
 namespace {
 
@@ -35,10 +42,21 @@ struct Hex {
   u64 value;
 };
 
+struct Float {
+  explicit Float(double value) : value{value} {}
+  double value;
+};
+
 string json(Hex x) { return '"' + hex(x.value) + '"'; }
 string json(const string& s) { return '"' + s + '"'; }
 string json(u32 x) { return json(to_string(x)); }
 
+string json(Float x) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.4g", x.value);
+  return json(string(buf));
+}
+
 template<typename T> string json(const string& key, const T& value) { return json(key) + ':' + json(value); }
 
 string maybe(const string& key, const string& value) { return value.empty() ? ""s : json(key, value); }
@@ -112,38 +130,65 @@ void writeResult(u32 E, const char *workType, const string &status, const std::s
   fields += tailFields(AID, args);
   string s = json(std::move(fields));
   log("%s\n", s.c_str());
+  static std::mutex resultsMutex;
+  std::lock_guard lock(resultsMutex);
   File::append(args.resultsFile, s + '\n');
 }
 
 }
 /*
 string Task::kindStr() const {
-  assert(kind == PRP || kind == PM1);
+  assert(kind == PRP || kind == PM1 || kind == LL);
   return kind == PRP ? "PRP" : "PM1";
 }
 */
 
-void Task::writeResultPRP(const Args &args, bool isPrime, u64 res64, u32 fftSize, u32 nErrors, const fs::path& proofPath) const {
+void Task::writeResultPRP(const Args &args, bool isPrime, u64 res64, u32 fftSize, u32 nErrors, const optional<ProofInfo>& proof,
+                          const RoeStats& roe) const {
+  // PRP-CF reports the type-5 residue of the cofactor.
+  string factorList;
+  for (const string& f : knownFactors) { factorList += (factorList.empty() ? "" : ",") + json(f); }
+
   vector<string> fields{json("res64", Hex{res64}),
-                        json("residue-type", 1),
+                        json("residue-type", knownFactors.empty() ? 1 : 5),
+                        knownFactors.empty() ? "" : (json("known-factors") + ":[" + factorList + "]"),
                         json("errors", vector<string>{json("gerbicz", nErrors)}),
-                        json("fft-length", fftSize)
+                        fftSize ? json("fft-length", fftSize) : ""
   };
 
   // "proof":{"version":1, "power":6, "hashsize":64, "md5":"0123456789ABCDEF"}, 
-  if (!proofPath.empty()) {
-    ProofInfo info = proof::getInfo(proofPath);
+  if (proof) {
     fields.push_back(json("proof", vector<string>{
             json("version", 1),
-            json("power", info.power),
+            json("power", proof->power),
             json("hashsize", 64),
-            json("md5", info.md5)
+            json("md5", proof->md5)
             }));
   }
   
+  // The round-off summary, for fitting the FFT size limits from results: "roe":{"N":"..", "mean":"..", ..}
+  if (roe.N) {
+    fields.push_back(json("roe", vector<string>{
+            json("N", roe.N),
+            json("mean", Float{roe.mean()}),
+            json("sd", Float{roe.sd()}),
+            json("max", Float{roe.max}),
+            json("perr", Float{roe.pErr(exponent)})
+            }));
+  }
+
   writeResult(exponent, "PRP-3", isPrime ? "P" : "C", AID, args, fields);
 }
 
+void Task::writeResultLL(const Args &args, bool isPrime, u64 res64, u32 fftSize, u32 nErrors) const {
+  writeResult(exponent, "LL", isPrime ? "P" : "C", AID, args,
+              {json("res64", Hex{res64}),
+               json("errors", vector<string>{json("jacobi", nErrors)}),
+               json("shift-count", 0),
+               json("fft-length", fftSize)
+              });
+}
+
 void Task::writeResultPM1(const Args& args, const string& factor, u32 fftSize) const {
   assert(B1);
   bool hasFactor = !factor.empty();
@@ -158,32 +203,106 @@ void Task::writeResultPM1(const Args& args, const string& factor, u32 fftSize) c
               });
 }
 
-void Task::execute(const Args& args) {
+void Task::finishPRP(const Args& args, Gpu* gpu, const PRPResult& r, u32 fftSize) const {
+  optional<ProofInfo> proof = r.proof;
+  if (r.proofPower) { proof = gpu->saveProof(args, ProofSet{args.tmpDir, exponent, r.proofPower, knownFactors}, r.proofBufs); }
+  if (r.factor.empty()) {
+    writeResultPRP(args, r.isPrime, r.res64, fftSize, r.nErrors, proof, r.roe);
+  }
+
+  Worktodo::deleteTask(*this);
+  if (!r.isPrime) { Saver::cleanup(exponent, args); }
+}
+
+void Task::execute(const Args& args, Lookahead* lookahead, Background* background) {
   LogContext pushContext(std::to_string(exponent));
   
   if (kind == VERIFY) {
-    Proof proof = Proof::load(verifyPath);
-    auto gpu = Gpu::make(proof.E, args);
-    bool ok = proof.verify(gpu.get());
-    log("proof '%s' %s\n", verifyPath.c_str(), ok ? "verified" : "failed");
+    // A comma separated list of proofs is verified four at a time: their hash chains are computed together.
+    vector<string> paths;
+    for (size_t pos = 0, end = 0; end != string::npos; pos = end + 1) {
+      end = verifyPath.find(',', pos);
+      paths.push_back(verifyPath.substr(pos, end == string::npos ? string::npos : end - pos));
+    }
+    for (u32 i = 0; i < paths.size(); i += 4) {
+      vector<Proof> proofs;
+      for (u32 j = i; j < min(i + 4, u32(paths.size())); ++j) { proofs.push_back(Proof::load(paths[j])); }
+      vector<const Proof*> ptrs;
+      for (const Proof& proof : proofs) { ptrs.push_back(&proof); }
+      Timer timer;
+      vector<vector<u64>> hashes = Proof::hashes(ptrs);
+      if (proofs.size() > 1) { log("hashed %u proofs in %.2fs\n", u32(proofs.size()), timer.reset()); }
+
+      for (u32 j = 0; j < proofs.size(); ++j) {
+        const Proof& proof = proofs[j];
+        bool ok = false;
+        if (args.engine == Args::ENGINE_NTT_CPU) {
+          Ntt ntt{proof.E};
+          ok = proof.verify(&ntt, hashes[j]);
+        } else if (args.engine == Args::ENGINE_NTT) {
+          NttGpu ntt{proof.E, args};
+          ok = proof.verify(&ntt, hashes[j]);
+        } else if (args.engine == Args::ENGINE_FF) {
+          FFGpu ff{proof.E, args};
+          ok = proof.verify(&ff, hashes[j]);
+        } else {
+          auto gpu = Gpu::make(proof.E, args);
+          ok = proof.verify(gpu.get(), hashes[j]);
+        }
+        log("proof '%s' %s\n", paths[i + j].c_str(), ok ? "verified" : "failed");
+      }
+    }
     return;
   }
 
-  assert(kind == PRP || kind == PM1);
+  assert(kind == PRP || kind == PM1 || kind == LL);
+
+  if (args.engine != Args::ENGINE_FFT) {
+    if (kind != PRP) { throw "-ntt and -ff do only PRP"; }
+    // The proof is already built, so no Gpu is needed; and the NTT length, unlike the FF one, is not an FFT length.
+    if (args.engine == Args::ENGINE_NTT_CPU) {
+      Ntt ntt{exponent};
+      finishPRP(args, nullptr, ntt.isPrimePRP(args, *this), 0);
+    } else if (args.engine == Args::ENGINE_FF) {
+      FFGpu ff{exponent, args};
+      finishPRP(args, nullptr, ff.isPrimePRP(args, *this), ff.getFFTSize());
+    } else {
+      NttGpu ntt{exponent, args};
+      finishPRP(args, nullptr, ntt.isPrimePRP(args, *this), 0);
+    }
+    return;
+  }
 
-  auto gpu = Gpu::make(exponent, args);
+  auto gpu = lookahead ? lookahead->makeGpu(exponent) : Gpu::make(exponent, args);
   auto fftSize = gpu->getFFTSize();
 
   if (kind == PRP) {
-    auto [factor, isPrime, res64, nErrors, proofPath] = gpu->isPrimePRP(args, *this);
-    if (factor.empty()) {
-      writeResultPRP(args, isPrime, res64, fftSize, nErrors, proofPath);
+    PRPResult r = gpu->isPrimePRP(args, *this, lookahead);
+    if (r.proofPower && background) {
+      // The task keeps its worktodo line and its residues until the proof is done.
+      log("proof of power %u continues in the background\n", r.proofPower);
+      background->run([task = *this, &args, gpu = std::move(gpu), r, fftSize, context = LogContext::current()]() {
+        LogContext pushContext{context};
+        try {
+          task.finishPRP(args, gpu.get(), r, fftSize);
+        } catch (const char *mes) {
+          log("proof failed: \"%s\"\n", mes);
+        } catch (const std::exception& e) {
+          log("proof failed: %s\n", e.what());
+        }
+      });
+    } else {
+      finishPRP(args, gpu.get(), r, fftSize);
     }
-
+  } else if (kind == LL) {
+    PRPResult r = gpu->isPrimeLL(args, *this, lookahead);
+    writeResultLL(args, r.isPrime, r.res64, fftSize, r.nErrors);
     Worktodo::deleteTask(*this);
-    if (!isPrime) { Saver::cleanup(exponent, args); }
+    if (!r.isPrime) { Saver::cleanup(exponent, args); }
   } else { // P-1
     LogContext p1{"P1"};
+    // P-1 first stage is short, so start preparing the next task right away.
+    if (lookahead) { lookahead->start(*this); }
     assert(!line.empty());  // We want to pass the same line to mprime following first-stage
     gpu->doPm1(args, *this);
     File::openAppend(args.mprimeDir/"worktodo.add").write(line);
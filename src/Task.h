@@ -8,10 +8,16 @@
 #include <string>
 #include <cstdio>
 #include <atomic>
+#include <optional>
 
 class Args;
 class Result;
 class Background;
+class Lookahead;
+class Gpu;
+struct PRPResult;
+struct ProofInfo;
+struct RoeStats;
 
 struct Task {
   enum Kind {PRP, VERIFY, PM1, LL};
@@ -26,10 +32,16 @@ struct Task {
   u32 howFarFactored = 0;
 
   string verifyPath; // For Verify
+  vector<string> knownFactors; // For PRP-CF, the PRP test is of the cofactor.
     
-  void execute(const Args& args);
+  void execute(const Args& args, Lookahead* lookahead = nullptr, Background* background = nullptr);
 
-  void writeResultPRP(const Args&, bool isPrime, u64 res64, u32 fftSize, u32 nErrors, const fs::path& proofPath) const;
+  // The end of a PRP test: the proof (if still pending), the result and the cleanup.
+  void finishPRP(const Args& args, Gpu* gpu, const PRPResult& r, u32 fftSize) const;
+
+  void writeResultPRP(const Args&, bool isPrime, u64 res64, u32 fftSize, u32 nErrors, const std::optional<ProofInfo>& proof,
+                      const RoeStats& roe) const;
+  void writeResultLL(const Args&, bool isPrime, u64 res64, u32 fftSize, u32 nErrors) const;
   void writeResultPM1(const Args&, const std::string& factor, u32 fftSize) const;
 
   // string kindStr() const;
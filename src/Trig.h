@@ -0,0 +1,57 @@
+// Copyright Mihai Preda and George Woltman.
+
+#pragma once
+
+// The host-side trig tables for gpuowl.cl, in long double precision. Also used by trigcheck as the reference.
+
+#include "common.h"
+
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+#ifndef M_PIl
+#define M_PIl 3.141592653589793238462643383279502884L
+#endif
+
+// Returns the primitive root of unity of order N, to the power k.
+
+template<typename T>
+pair<T, T> root1(u32 N, u32 k) {
+  assert(k < N);
+  if (k >= N/2) {
+    auto [c, s] = root1<T>(N, k - N/2);
+    return {-c, -s};
+  } else if (k > N/4) {
+    auto [c, s] = root1<T>(N, N/2 - k);
+    return {-c, s};
+  } else if (k > N/8) {
+    auto [c, s] = root1<T>(N, N/4 - k);
+    return {-s, -c};
+  } else {
+    assert(!(N&7));
+    assert(k <= N/8);
+    N /= 2;
+    auto angle = - M_PIl * k / N;
+    return {cosl(angle), sinl(angle)};
+  }
+}
+
+template<typename T>
+vector<pair<T, T>> makeTrig(u32 n) {
+  assert(n % 8 == 0);
+  vector<pair<T, T>> tab;
+  tab.reserve(n/8 + 1);
+  for (u32 k = 0; k <= n/8; ++k) { tab.push_back(root1<T>(n, k)); }
+  return tab;
+}
+
+template<typename T>
+vector<pair<T, T>> makeTinyTrig(u32 W, u32 hN) {
+  vector<pair<T, T>> tab;
+  for (u32 k = 0; k <= W/2; ++k) {
+    auto[c, s] = root1<f128>(hN, k);
+    tab.push_back({c - 1, s});
+  }
+  return tab;
+}
@@ -7,13 +7,26 @@
 #include "common.h"
 #include "Args.h"
 #include "Saver.h"
+#include "GmpUtil.h"
 
 #include <cassert>
+#include <cctype>
 #include <string>
 #include <optional>
+#include <algorithm>
+#include <iterator>
+#include <sstream>
+#include <mutex>
+#include <set>
 
 namespace {
 
+// An assignment ID is exactly 32 hex digits; a shorter hex-looking field is the exponent.
+bool startsWithAID(const string& s) {
+  return s.size() >= 32 && std::all_of(s.begin(), s.begin() + 32, [](char c) { return isxdigit(u8(c)); })
+    && (s.size() == 32 || s[32] == ',');
+}
+
 std::optional<Task> parse(const std::string& line) {
   u32 exp = 0;
   int pos = 0;
@@ -33,8 +46,16 @@ std::optional<Task> parse(const std::string& line) {
     string kind = kindStr;
     tail = tail.substr(pos);
     if (kind == "PRP" || kind == "PRPDC" || kind == "Pfactor" || kind == "PFactor") {
-      if (tail.find('"') != string::npos) {
-        log("GpuOwl does not support PRP-CF!\n");
+      // PRP-CF: the known factors are a quoted, comma separated list at the end of the line.
+      vector<string> factors;
+      if (auto q = tail.find('"'); q != string::npos) {
+        string list = tail.substr(q + 1, tail.rfind('"') - q - 1);
+        std::replace(list.begin(), list.end(), ',', ' ');
+        std::istringstream iss{list};
+        factors.insert(factors.end(), std::istream_iterator<string>{iss}, std::istream_iterator<string>{});
+      }
+      if (!factors.empty() && kind != "PRP" && kind != "PRPDC") {
+        log("Known factors are only supported with PRP\n");
       } else {
         char AIDStr[64] = {0};
         u32 howFarFactored = 0;
@@ -44,9 +65,24 @@ std::optional<Task> parse(const std::string& line) {
             || ((AIDStr[0]=0, sscanf(tail.c_str(), "%u", &exp)) == 1 && exp > 1000)) {
           string AID = AIDStr;
           if (AID == "N/A" || AID == "0") { AID = ""; }
-          return {{kind=="Pfactor"||kind=="PFactor" ? Task::PM1 : Task::PRP, exp, AID, line, B1, B2, howFarFactored}};
+          if (!areFactors(exp, factors)) {
+            log("Invalid known factors for %u\n", exp);
+          } else {
+            return {{kind=="Pfactor"||kind=="PFactor" ? Task::PM1 : Task::PRP, exp, AID, line, B1, B2, howFarFactored, "", factors}};
+          }
         }
       }
+    } else if (kind == "Test" || kind == "DoubleCheck") {
+      // Test=AID,exponent,how_far_factored,has_been_pminus1ed
+      char AIDStr[64] = {0};
+      u32 howFarFactored = 0;
+      if ((startsWithAID(tail) && sscanf(tail.c_str(), "%32[0-9a-fA-F],%u,%u", AIDStr, &exp, &howFarFactored) >= 2)
+          || (AIDStr[0]=0, sscanf(tail.c_str(), "N/A,%u,%u", &exp, &howFarFactored) >= 1)
+          || ((AIDStr[0]=0, sscanf(tail.c_str(), "%u,%u", &exp, &howFarFactored)) >= 1 && exp > 1000)) {
+        string AID = AIDStr;
+        if (AID == "N/A" || AID == "0") { AID = ""; }
+        return {{Task::LL, exp, AID, line, 0, 0, howFarFactored}};
+      }
     }
   }
   log("worktodo.txt line ignored: \"%s\"\n", rstripNewline(line).c_str());
@@ -76,8 +112,15 @@ bool deleteLine(const fs::path& fileName, const std::string& targetLine) {
   return true;
 }
 
+// Guards the worktodo files and "claimed" when several workers (one per device) share this process.
+std::mutex worktodoMutex;
+
+// The lines handed out by getTask() and not yet deleted.
+std::set<string> claimed;
+
 std::optional<Task> firstGoodTask(const fs::path& fileName) {
   for (const string& line : File::openRead(fileName)) {
+    if (claimed.count(line)) { continue; }
     if (optional<Task> maybeTask = parse(line)) { return maybeTask; }
   }
   return nullopt;
@@ -85,12 +128,14 @@ std::optional<Task> firstGoodTask(const fs::path& fileName) {
 
 }
 
-std::optional<Task> Worktodo::getTask(Args &args) {
+std::optional<Task> Worktodo::getTask(const Args &args) {
   string worktodoTxt = "worktodo.txt";
+  std::lock_guard lock(worktodoMutex);
   
  again:
   // Try to get a task from the local worktodo.txt
-  if (optional<Task> task = firstGoodTask(worktodoTxt)) {    
+  if (optional<Task> task = firstGoodTask(worktodoTxt)) {
+    claimed.insert(task->line);
     return task;
   }
   
@@ -106,8 +151,27 @@ std::optional<Task> Worktodo::getTask(Args &args) {
   return std::nullopt;
 }
 
+std::optional<Task> Worktodo::peekNext(const Args &args, const Task &current) {
+  std::lock_guard lock(worktodoMutex);
+  bool seen = current.line.empty();
+  for (const string& line : File::openRead("worktodo.txt")) {
+    if (!seen) {
+      seen = (line == current.line);
+    } else if (claimed.count(line)) {
+      continue;
+    } else if (optional<Task> task = parse(line)) {
+      return task;
+    }
+  }
+  
+  if (!args.masterDir.empty()) { return firstGoodTask(args.masterDir / "worktodo.txt"); }
+  return std::nullopt;
+}
+
 bool Worktodo::deleteTask(const Task &task) {
   // Some tasks don't originate in worktodo.txt and thus don't need deleting.
   if (task.line.empty()) { return true; }
+  std::lock_guard lock(worktodoMutex);
+  claimed.erase(task.line);
   return deleteLine("worktodo.txt", task.line);
 }
@@ -10,8 +10,11 @@
 
 class Worktodo {
 public:
-  static std::optional<Task> getTask(Args &args);
+  static std::optional<Task> getTask(const Args &args);
   static bool deleteTask(const Task &task);
+
+  // The task that getTask() is expected to return once "current" is deleted. Does not modify any file.
+  static std::optional<Task> peekNext(const Args &args, const Task &current);
   
   static Task makePRP(Args &args, u32 exponent) {
    Task task;
@@ -112,7 +112,7 @@ u64 getTotalMem(cl_device_id id) {
   try {
     u64 totSize = 0; 
     GET_INFO(id, CL_DEVICE_GLOBAL_MEM_SIZE, totSize);
-    return totSize * 1024; // KB to Bytes.    
+    return totSize; // already in bytes, unlike the AMD free memory
   } catch (const gpu_error& err) {
     return u64(64) * 1024 * 1024 * 1024; // return huge size (64G) when free-info not available
   }
@@ -335,6 +335,17 @@ void write(cl_queue queue, bool blocking, cl_mem buf, size_t size, const void *d
   CHECK1(clEnqueueWriteBuffer(queue, buf, blocking, start, size, data, 0, NULL, NULL));
 }
 
+void *mapBuf(cl_queue queue, cl_mem buf, size_t size, bool forWrite) {
+  int err = 0;
+  void *ptr = clEnqueueMapBuffer(queue, buf, true, forWrite ? CL_MAP_WRITE_INVALIDATE_REGION : CL_MAP_READ, 0, size, 0, NULL, NULL, &err);
+  CHECK2(err, "clEnqueueMapBuffer");
+  return ptr;
+}
+
+void unmapBuf(cl_queue queue, cl_mem buf, void *ptr) {
+  CHECK1(clEnqueueUnmapMemObject(queue, buf, ptr, 0, NULL, NULL));
+}
+
 void copyBuf(cl_queue queue, const cl_mem src, cl_mem dst, size_t size) {
   CHECK1(clEnqueueCopyBuffer(queue, src, dst, 0, 0, size, 0, NULL, NULL));
 }
@@ -384,6 +395,13 @@ cl_context getQueueContext(cl_command_queue q) {
   return ret;
 }
 
+// Our contexts have a single device.
+cl_device_id getContextDevice(cl_context context) {
+  cl_device_id id;
+  CHECK1(clGetContextInfo(context, CL_CONTEXT_DEVICES, sizeof(id), &id, 0));
+  return id;
+}
+
 cl_device_id getQueueDevice(cl_command_queue q) {
   cl_device_id id;
   CHECK1(clGetCommandQueueInfo(q, CL_QUEUE_DEVICE, sizeof(id), &id, 0));
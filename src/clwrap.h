@@ -57,6 +57,8 @@ string getLongInfo(cl_device_id device);
 
 // Get GPU free memory in bytes.
 u64 getFreeMem(cl_device_id id);
+// The GPU global memory size in bytes.
+u64 getTotalMem(cl_device_id id);
 bool hasFreeMemInfo(cl_device_id id);
 bool isAmdGpu(cl_device_id id);
 
@@ -89,6 +91,10 @@ EventHolder run(cl_queue queue, cl_kernel kernel, size_t groupSize, size_t workS
 void read(cl_queue queue, bool blocking, cl_mem buf, size_t size, void *data, size_t start = 0);
 void write(cl_queue queue, bool blocking, cl_mem buf, size_t size, const void *data, size_t start = 0);
 
+// Blocking map of the whole buffer into host memory; for reading, or for overwriting all of it.
+void *mapBuf(cl_queue queue, cl_mem buf, size_t size, bool forWrite);
+void unmapBuf(cl_queue queue, cl_mem buf, void *ptr);
+
 void copyBuf(cl_queue queue, const cl_mem src, cl_mem dst, size_t size);
 
 void fillBuf(cl_queue q, cl_mem buf, void *pat, size_t patSize, size_t size = 0, size_t start = 0);
@@ -101,3 +107,4 @@ u64 getEventNanos(cl_event event);
 u32 getEventInfo(cl_event event);
 
 cl_context getQueueContext(cl_command_queue q);
+cl_device_id getContextDevice(cl_context context);
@@ -0,0 +1,156 @@
+// Copyright Mihai Preda.
+
+#pragma once
+
+// A CPU squaring engine modulo 2^E - 1 (irrational-base DWT), generic over the FFT arithmetic: double, as the FP64 path,
+// or FF, the CPU reference of the float-float kernels of FFGpu (ff.cl), which it follows operation for operation up to
+// the rounding to integers. The N real words are packed in pairs into N/2 complex values, transformed with a complex FFT
+// of size N/2 and split into the spectrum of the real signal for the squaring, like the GPU does. The words are
+// balanced, with the word sizes and weights of state.h.
+
+#include "ff.h"
+#include "state.h"
+#include "common.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+template<typename T> struct Cx {
+  T re, im;
+};
+
+template<typename T> Cx<T> operator+(Cx<T> a, Cx<T> b) { return {a.re + b.re, a.im + b.im}; }
+template<typename T> Cx<T> operator-(Cx<T> a, Cx<T> b) { return {a.re - b.re, a.im - b.im}; }
+template<typename T> Cx<T> operator*(Cx<T> a, Cx<T> b) { return {a.re * b.re - a.im * b.im, a.re * b.im + a.im * b.re}; }
+template<typename T> Cx<T> conj(Cx<T> a) { return {a.re, -a.im}; }
+template<typename T> Cx<T> scale(Cx<T> a, float p2) { return {scale(a.re, p2), scale(a.im, p2)}; }
+
+// Multiplies by -i.
+template<typename T> Cx<T> mulMinusI(Cx<T> a) { return {a.im, -a.re}; }
+
+template<typename T> class Dwt {
+  u32 E, N, H; // H == N / 2, the size of the complex FFT
+  std::vector<T> weight, iWeight;
+  std::vector<Cx<T>> trigH; // e^(-2*pi*i*k/H), k < H/2
+  std::vector<Cx<T>> trigN; // e^(-2*pi*i*k/N), k < H
+
+  static Cx<T> root(u32 n, u32 k) {
+    long double a = -2 * M_PIl * k / n;
+    return {fromLD<T>(cosl(a)), fromLD<T>(sinl(a))};
+  }
+
+  // Radix-2 Stockham DIF FFT of size H, natural order in and out, with the stages of the FFGpu kernels (ff.cl);
+  // "inverse" uses the conjugate roots, unscaled.
+  void fft(std::vector<Cx<T>>& v, bool inverse) const {
+    std::vector<Cx<T>> out(H);
+    for (u32 t = 0; (1u << t) < H; ++t) {
+      u32 m = (H / 2) >> t;
+      for (u32 i = 0; i < H / 2; ++i) {
+        u32 j = i >> t, q = i & ((1u << t) - 1);
+        Cx<T> w = inverse ? conj(trigH[j << t]) : trigH[j << t];
+        Cx<T> a = v[q + (j << t)];
+        Cx<T> b = v[q + ((j + m) << t)];
+        out[q + ((2 * j) << t)] = a + b;
+        out[q + ((2 * j + 1) << t)] = (a - b) * w;
+      }
+      std::swap(v, out);
+    }
+  }
+
+  // The weighted words, transformed.
+  std::vector<Cx<T>> spectrum(const std::vector<i64>& words) const {
+    assert(words.size() == N);
+    std::vector<Cx<T>> z(H);
+    for (u32 k = 0; k < H; ++k) {
+      z[k] = {fromLD<T>(words[2 * k]) * weight[2 * k], fromLD<T>(words[2 * k + 1]) * weight[2 * k + 1]};
+    }
+    fft(z, false);
+    return z;
+  }
+
+  // a * b, or a^2 when b is null; returns the max round-off error.
+  double mul(std::vector<i64>& words, const std::vector<i64>* b) const {
+    std::vector<Cx<T>> z = spectrum(words);
+    std::vector<Cx<T>> zb = b ? spectrum(*b) : std::vector<Cx<T>>{};
+
+    // Split into the spectrum X of the real signal, multiply, and merge back.
+    std::vector<Cx<T>> y(H);
+    for (u32 k = 0; k < H; ++k) {
+      u32 j = (H - k) % H;
+      auto [lo, hi] = split(z[k], z[j], k);
+      if (b) {
+        auto [loB, hiB] = split(zb[k], zb[j], k);
+        lo = lo * loB;
+        hi = hi * hiB;
+      } else {
+        lo = lo * lo;
+        hi = hi * hi;
+      }
+      Cx<T> even2 = scale(lo + hi, 0.5f);
+      Cx<T> odd2 = scale(lo - hi, 0.5f) * conj(trigN[k]);
+      // even2 + i * odd2
+      y[k] = {even2.re - odd2.im, even2.im + odd2.re};
+    }
+    fft(y, true);
+
+    double maxErr = 0;
+    std::vector<i64> out(N);
+    for (u32 k = 0; k < H; ++k) {
+      for (u32 p = 0; p < 2; ++p) {
+        u32 i = 2 * k + p;
+        T v = (p ? y[k].im : y[k].re) * iWeight[i];
+        double x = toDouble(v) / H;
+        double r = rint(x);
+        maxErr = std::max(maxErr, std::fabs(x - r));
+        out[i] = i64(r);
+      }
+    }
+
+    // Carry propagation; the carry out of the top word wraps around to word 0, until it settles.
+    i64 carry = 0;
+    do {
+      for (u32 i = 0; i < N; ++i) {
+        u32 len = bitlen(i);
+        i64 x = out[i] + carry;
+        i64 w = (x << (64 - len)) >> (64 - len); // balanced, in [-2^(len-1), 2^(len-1))
+        carry = (x - w) >> len;
+        out[i] = w;
+      }
+    } while (carry);
+    words = std::move(out);
+    return maxErr;
+  }
+
+  // The spectrum of the real signal at k and at H + k, from the transform of the packed words at k and at H - k.
+  std::pair<Cx<T>, Cx<T>> split(Cx<T> a, Cx<T> b, u32 k) const {
+    b = conj(b);
+    Cx<T> even = scale(a + b, 0.5f);
+    Cx<T> odd = mulMinusI(scale(a - b, 0.5f)) * trigN[k];
+    return {even + odd, even - odd};
+  }
+
+public:
+  Dwt(u32 E, u32 N) : E{E}, N{N}, H{N / 2} {
+    assert(N >= 4 && !(N & (N - 1)));
+    for (u32 k = 0; k < N; ++k) {
+      long double w = exp2l(extra(N, E, k) / (long double) N);
+      weight.push_back(fromLD<T>(w));
+      iWeight.push_back(fromLD<T>(1 / w));
+    }
+    for (u32 k = 0; k < H / 2; ++k) { trigH.push_back(root(H, k)); }
+    for (u32 k = 0; k < H; ++k) { trigN.push_back(root(N, k)); }
+  }
+
+  u32 bitlen(u32 k) const { return E / N + isBigWord(N, E, k); }
+
+  // words := words^2, or words * b, mod 2^E - 1. The words are balanced; returns the max round-off error.
+  double square(std::vector<i64>& words) const { return mul(words, nullptr); }
+  double mul(std::vector<i64>& words, const std::vector<i64>& b) const { return mul(words, &b); }
+
+  const std::vector<T>& weights() const { return weight; }
+  const std::vector<T>& iWeights() const { return iWeight; }
+  const std::vector<Cx<T>>& rootsH() const { return trigH; }
+  const std::vector<Cx<T>>& rootsN() const { return trigN; }
+};
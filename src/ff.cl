@@ -0,0 +1,192 @@
+// Copyright Mihai Preda.
+
+// The float-float ("FF") squaring of FFGpu, for devices with a low FP64 rate: a FF value is the unevaluated sum x + y
+// of two floats, with the compensated arithmetic of SP/sp.cl. The NWORDS balanced words are weighted (irrational-base
+// DWT), packed in pairs into H complex FF values, and transformed with a radix-2 Stockham FFT of size H; the tail
+// splits out the spectrum of the real signal. dwt.h (Dwt<FF>) is the CPU reference, operation for operation.
+
+/* Set by the host:
+EXP
+NWORDS     a power of two
+H          NWORDS / 2
+STEP       NWORDS - EXP % NWORDS, for the word sizes
+CHUNK      the words carried in sequence by one item of carryA and carryB
+NCHUNKS    NWORDS / CHUNK
+*/
+
+// The compensated sums and products must not be contracted into fma().
+#pragma OPENCL FP_CONTRACT OFF
+
+typedef int i32;
+typedef uint u32;
+typedef long i64;
+typedef ulong u64;
+
+typedef float2 T;  // FF
+typedef float4 T2; // complex FF, xy + i * zw
+
+#define P(x) global x * restrict
+#define CP(x) const P(x)
+#define KERNEL(x) kernel __attribute__((reqd_work_group_size(x, 1, 1))) void
+#define OVERLOAD __attribute__((overloadable))
+
+OVERLOAD T U2(float x, float y) { T r; r.x = x; r.y = y; return r; }
+OVERLOAD T2 U2(T x, T y) { T2 r; r.xy = x; r.zw = y; return r; }
+
+// See Fast-Two-Sum and Two-Sum in
+// "Extended-Precision Floating-Point Numbers for GPU Computation" by Andrew Thall
+
+// Fast: assumes |a| >= |b|; cost: 3 ADD
+T fastTwoSum(float a, float b) {
+  float s = a + b;
+  return U2(s, b - (s - a));
+}
+
+// See Two-Product-FMA in the A. Thall paper above. 2 MUL
+T twoMul(float a, float b) {
+  float x = a * b;
+  float e = fma(a, b, -x);
+  return U2(x, e);
+}
+
+// assumes |a| >= |b|. 14 ADD.
+T fastSum(T a, T b) {
+  T s = fastTwoSum(a.x, b.x);
+  T t = fastTwoSum(a.y, b.y);
+  s = fastTwoSum(s.x, s.y + t.x);
+  s = fastTwoSum(s.x, s.y + t.y);
+  return s;
+}
+
+OVERLOAD T sum(T a, T b) { return (fabs(a.x) >= fabs(b.x)) ? fastSum(a, b) : fastSum(b, a); }
+
+// 5 MUL + 3 ADD
+OVERLOAD T mul(T a, T b) {
+  T t = twoMul(a.x, b.x);
+  t.y = fma(a.x, b.y, fma(a.y, b.x, t.y));
+  t = fastTwoSum(t.x, t.y);
+  t.y = fma(a.y, b.y, t.y);
+  return t;
+}
+
+// Complex sum, difference and mul.
+OVERLOAD T2 sum(T2 a, T2 b) { return U2(sum(a.xy, b.xy), sum(a.zw, b.zw)); }
+T2 sub(T2 a, T2 b) { return U2(sum(a.xy, -b.xy), sum(a.zw, -b.zw)); }
+OVERLOAD T2 mul(T2 a, T2 b) { return U2(sum(mul(a.xy, b.xy), -mul(a.zw, b.zw)), sum(mul(a.xy, b.zw), mul(a.zw, b.xy))); }
+
+T2 conjugate(T2 a) { return U2(a.xy, -a.zw); }
+
+// Multiplies by -i.
+T2 mulMinusI(T2 a) { return U2(a.zw, -a.xy); }
+
+// The words, weighted and packed in pairs.
+KERNEL(64) ffIn(P(T2) out, CP(i32) words, CP(T) weights) {
+  u32 k = get_global_id(0);
+  if (k >= H) { return; }
+  out[k] = U2(mul(U2((float) words[2 * k], 0), weights[2 * k]), mul(U2((float) words[2 * k + 1], 0), weights[2 * k + 1]));
+}
+
+// Stage "t" of the radix-2 Stockham DIF transform of size H, natural order in and out.
+// "roots" has the H/2 powers of the H-th root of unity, or of its inverse.
+KERNEL(64) ffStage(P(T2) out, CP(T2) in, CP(T2) roots, u32 t) {
+  u32 i = get_global_id(0);
+  if (i >= H / 2) { return; }
+  u32 m = (H / 2) >> t;
+  u32 j = i >> t;
+  u32 q = i & ((1u << t) - 1);
+  T2 a = in[q + (j << t)];
+  T2 b = in[q + ((j + m) << t)];
+  out[q + ((2 * j) << t)] = sum(a, b);
+  out[q + ((2 * j + 1) << t)] = mul(sub(a, b), roots[j << t]);
+}
+
+// The spectrum of the real signal at k (lo) and at H + k (hi), from the transform at k and at H - k.
+void split(T2 a, T2 b, T2 w, T2 *lo, T2 *hi) {
+  b = conjugate(b);
+  T2 even = sum(a, b) * 0.5f;
+  T2 odd = mul(mulMinusI(sub(a, b) * 0.5f), w);
+  *lo = sum(even, odd);
+  *hi = sub(even, odd);
+}
+
+// The inverse of split(), from the products.
+T2 merge(T2 lo, T2 hi, T2 w) {
+  T2 even = sum(lo, hi) * 0.5f;
+  T2 odd = mul(sub(lo, hi) * 0.5f, conjugate(w));
+  // even + i * odd
+  return U2(sum(even.xy, -odd.zw), sum(even.zw, odd.xy));
+}
+
+// "rootsN" has the H powers of the NWORDS-th root of unity.
+KERNEL(64) ffSquare(P(T2) out, CP(T2) in, CP(T2) rootsN) {
+  u32 k = get_global_id(0);
+  if (k >= H) { return; }
+  T2 lo, hi;
+  split(in[k], in[(H - k) & (H - 1)], rootsN[k], &lo, &hi);
+  out[k] = merge(mul(lo, lo), mul(hi, hi), rootsN[k]);
+}
+
+KERNEL(64) ffMul(P(T2) out, CP(T2) in, CP(T2) inB, CP(T2) rootsN) {
+  u32 k = get_global_id(0);
+  if (k >= H) { return; }
+  u32 j = (H - k) & (H - 1);
+  T2 lo, hi, loB, hiB;
+  split(in[k], in[j], rootsN[k], &lo, &hi);
+  split(inB[k], inB[j], rootsN[k], &loB, &hiB);
+  out[k] = merge(mul(lo, loB), mul(hi, hiB), rootsN[k]);
+}
+
+u32 bitlen(u32 k) { return EXP / NWORDS + (((STEP * k) & (NWORDS - 1)) + STEP < NWORDS); }
+
+// Rounds x to an integer, and returns the round-off error in "err". x.x and x.y are rounded apart, as x.x may not be
+// an integer while beyond the 24 bits of a float x is.
+i64 roundFF(T x, float *err) {
+  float hi = rint(x.x);
+  float lo = rint(x.y);
+  float rem = (x.x - hi) + (x.y - lo);
+  float r = rint(rem);
+  *err = fabs(rem - r);
+  return (i64) hi + (i64) lo + (i64) r;
+}
+
+// word := the balanced low "len" bits of x; returns the carry.
+i64 balance(i64 x, u32 len, i32 *word) {
+  i64 w = (x << (64 - len)) >> (64 - len);
+  *word = (i32) w;
+  return (x - w) >> len;
+}
+
+// The words of each chunk, unweighted, rounded and carried; the carry out of each chunk; and the max round-off
+// error, as the bits of a non-negative float, in roe[0]. "iWeights" include the 1/H of the inverse transform.
+KERNEL(64) ffCarryA(P(i32) words, P(i64) carryOut, P(u32) roe, CP(T2) in, CP(T) iWeights) {
+  u32 c = get_global_id(0);
+  if (c >= NCHUNKS) { return; }
+  i64 carry = 0;
+  float maxErr = 0;
+  for (u32 i = c * CHUNK, end = i + CHUNK; i < end; ++i) {
+    T2 v = in[i / 2];
+    float err;
+    i64 x = roundFF(mul((i & 1) ? v.zw : v.xy, iWeights[i]), &err);
+    maxErr = fmax(maxErr, err);
+    i32 w;
+    carry = balance(x + carry, bitlen(i), &w);
+    words[i] = w;
+  }
+  carryOut[c] = carry;
+  atomic_max(roe, as_uint(maxErr));
+}
+
+// The carry into each chunk; that out of the last one, at 2^EXP == 1, wraps to word 0. The last word of a chunk takes
+// the carry left, so it may be a little beyond the balanced range.
+KERNEL(64) ffCarryB(P(i32) words, CP(i64) carryIn) {
+  u32 c = get_global_id(0);
+  if (c >= NCHUNKS) { return; }
+  i64 carry = carryIn[c ? c - 1 : NCHUNKS - 1];
+  u32 i = c * CHUNK;
+  for (u32 end = i + CHUNK - 1; i < end && carry; ++i) {
+    i32 w;
+    carry = balance(words[i] + carry, bitlen(i), &w);
+    words[i] = w;
+  }
+  words[i] += (i32) carry;
+}
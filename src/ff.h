@@ -0,0 +1,92 @@
+// Copyright Mihai Preda.
+
+#pragma once
+
+// Host emulation of the float-float ("FF") arithmetic of ff.cl (from SP/sp.cl), operation for operation, so that the
+// round-off of the FF transform can be measured on the CPU. A FF value is the unevaluated sum x + y of two floats with |y| <= ulp(x)/2.
+
+#include <cmath>
+
+struct FF {
+  float x, y;
+};
+
+// See Fast-Two-Sum and Two-Sum in
+// "Extended-Precision Floating-Point Numbers for GPU Computation" by Andrew Thall
+
+// Fast: assumes |a| >= |b|; cost: 3 ADD
+inline FF fastTwoSum(float a, float b) {
+  float s = a + b;
+  return {s, b - (s - a)};
+}
+
+// cost: 6 ADD
+inline FF twoSum(float a, float b) {
+  float s = a + b;
+  float b1 = s - a;
+  float a1 = s - b1;
+  float e = (b - b1) + (a - a1);
+  return {s, e};
+}
+
+// See Two-Product-FMA in the A. Thall paper above. 2 MUL
+inline FF twoMul(float a, float b) {
+  float x = a * b;
+  float e = std::fma(a, b, -x);
+  return {x, e};
+}
+
+// assumes |a| >= |b|. 14 ADD.
+inline FF fastSum(FF a, FF b) {
+  FF s = fastTwoSum(a.x, b.x);
+  FF t = fastTwoSum(a.y, b.y);
+  s = fastTwoSum(s.x, s.y + t.x);
+  s = fastTwoSum(s.x, s.y + t.y);
+  return s;
+}
+
+inline FF sum(FF a, FF b) { return (std::fabs(a.x) >= std::fabs(b.x)) ? fastSum(a, b) : fastSum(b, a); }
+
+// 5 MUL + 3 ADD
+inline FF mul(FF a, FF b) {
+  FF t = twoMul(a.x, b.x);
+  t.y = std::fma(a.x, b.y, std::fma(a.y, b.x, t.y));
+  t = fastTwoSum(t.x, t.y);
+  t.y = std::fma(a.y, b.y, t.y);
+  return t;
+}
+
+// 3 MUL
+inline FF mul(FF a, float b) {
+  FF t = twoMul(a.x, b);
+  t.y = std::fma(a.y, b, t.y);
+  return t;
+}
+
+inline FF sq(FF a) {
+  FF t = twoMul(a.x, a.x);
+  t.y = std::fma(a.x * 2, a.y, t.y);
+  t.y = std::fma(a.y, a.y, t.y);
+  return fastTwoSum(t.x, t.y);
+}
+
+inline FF operator+(FF a, FF b) { return sum(a, b); }
+inline FF operator-(FF a) { return {-a.x, -a.y}; }
+inline FF operator-(FF a, FF b) { return sum(a, -b); }
+inline FF operator*(FF a, FF b) { return mul(a, b); }
+
+// Multiplication by a power of two is exact.
+inline FF scale(FF a, float p2) { return {a.x * p2, a.y * p2}; }
+inline double scale(double a, double p2) { return a * p2; }
+
+// Conversions, rounding to nearest.
+template<typename T> T fromLD(long double x);
+template<> inline double fromLD<double>(long double x) { return x; }
+template<> inline FF fromLD<FF>(long double x) {
+  float a = x;
+  return {a, float(x - a)};
+}
+
+// The sum of the two floats is exact in double (48 significant bits at most).
+inline double toDouble(FF a) { return double(a.x) + a.y; }
+inline double toDouble(double a) { return a; }
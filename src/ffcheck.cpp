@@ -0,0 +1,111 @@
+// Copyright Mihai Preda.
+
+// The CPU reference of the float-float engine FFGpu (ff.h, dwt.h), checked against the FP64 path and GMP.
+//   ffcheck check <E> <N> <iters> : PRP squarings from 3 with both paths, compares the res64 with GMP
+//   ffcheck limits <N>..          : fits the max bits-per-word of the FF and of the FP64 path at these sizes,
+//                                   to which FFTConfig::getMaxExpFF() is fitted
+
+#include "dwt.h"
+#include "RoeStats.h"
+#include "GmpUtil.h"
+#include "FFTConfig.h"
+#include "timeutil.h"
+
+#include <gmpxx.h>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+namespace {
+
+std::vector<i64> start(u32 E, u32 N) {
+  vector<int> w = expandBits(makeWords(E, 3), N, E);
+  return {w.begin(), w.end()};
+}
+
+u64 res64Of(u32 E, u32 N, const std::vector<i64>& words) {
+  vector<int> w{words.begin(), words.end()};
+  return res64(compactBits(w.data(), N, E));
+}
+
+template<typename T> pair<u64, double> run(u32 E, u32 N, u32 iters) {
+  Dwt<T> dwt{E, N};
+  auto words = start(E, N);
+  double maxErr = 0;
+  for (u32 k = 0; k < iters; ++k) { maxErr = std::max(maxErr, dwt.square(words)); }
+  return {res64Of(E, N, words), maxErr};
+}
+
+u64 gmpRes64(u32 E, u32 iters) {
+  mpz_class m = (mpz_class{1} << E) - 1;
+  mpz_class x{3};
+  for (u32 k = 0; k < iters; ++k) { x = x * x % m; }
+  mpz_class low = x & ((mpz_class{1} << 64) - 1);
+  return (u64(mpz_class{low >> 32}.get_ui()) << 32) | mpz_class{low & 0xffffffffu}.get_ui();
+}
+
+int check(u32 E, u32 N, u32 iters) {
+  u64 expected = gmpRes64(E, iters);
+  auto [resD, errD] = run<double>(E, N, iters);
+  auto [resF, errF] = run<FF>(E, N, iters);
+  printf("E %u N %u (%.2f bpw), %u iterations: GMP %016" PRIx64 "\n", E, N, double(E) / N, iters, expected);
+  printf("  FP64 %016" PRIx64 " max ROE %.4f %s\n", resD, errD, resD == expected ? "OK" : "MISMATCH");
+  printf("  FF   %016" PRIx64 " max ROE %.4f %s\n", resF, errF, resF == expected ? "OK" : "MISMATCH");
+  return (resD == expected && resF == expected) ? 0 : 1;
+}
+
+// The per-iteration ROE of "iters" squarings, after the residue has grown to full size.
+template<typename T> RoeStats sample(u32 E, u32 N, u32 iters) {
+  Dwt<T> dwt{E, N};
+  auto words = start(E, N);
+  for (u32 k = 0; k < 40; ++k) { dwt.square(words); }
+  RoeStats s;
+  for (u32 k = 0; k < iters; ++k) {
+    double x = dwt.square(words);
+    ++s.N;
+    s.sum += x;
+    s.sumSq += x * x;
+    s.max = std::max(s.max, float(x));
+  }
+  return s;
+}
+
+// As in -calibrate: log2 of the ROE mean and SD are fitted as lines in bits-per-word, and the limit
+// is where the Gumbel pErr of a whole test reaches FFTConfig::TARGET_PERR.
+template<typename T> double limit(u32 N) {
+  // Coarse: the bits-per-word where the mean ROE crosses 0.2.
+  double bpw = FFTConfig::MIN_BPW, hiBpw = 24;
+  while (hiBpw - bpw > 0.1) {
+    double mid = (bpw + hiBpw) / 2;
+    (sample<T>(nextPrime(mid * N), N, 10).mean() < 0.2 ? bpw : hiBpw) = mid;
+  }
+
+  vector<pair<double, RoeStats>> samples;
+  for (double delta : {-1.0, -0.75, -0.5, -0.25}) {
+    u32 E = nextPrime((bpw + delta) * N);
+    samples.push_back({double(E) / N, sample<T>(E, N, 200)});
+  }
+  return RoeStats::fitLimit(samples, N, FFTConfig::MIN_BPW, 24, FFTConfig::TARGET_PERR);
+}
+
+}
+
+int main(int argc, char **argv) {
+  string mode = argc > 1 ? argv[1] : "";
+  if (mode == "check" && argc == 5) {
+    return check(atoi(argv[2]), atoi(argv[3]), atoi(argv[4]));
+  } else if (mode == "limits" && argc > 2) {
+    for (int i = 2; i < argc; ++i) {
+      u32 N = atoi(argv[i]);
+      Timer timer;
+      double ff = limit<FF>(N);
+      double fp64 = limit<double>(N);
+      printf("N %8u : FF %.3f bpw (max exponent %u), FP64 %.3f bpw (%.1fs)\n", N, ff, u32(ff * N), fp64, timer.reset());
+      fflush(stdout);
+    }
+    return 0;
+  }
+  printf("Usage: ffcheck check <E> <N> <iters> | ffcheck limits <N>..\n");
+  return 2;
+}
@@ -785,112 +785,6 @@ void readDelta(u32 WG, u32 N, T2 *u, const global T2 *a, const global T2 *b, u32
   }
 }
 
-#if ULTRA_TRIG
-
-// These are ultra accurate routines.  We modified Ernst's qfcheb program and selected a multiplier such that
-// a) k * multipler / n can be represented exactly as a double, and
-// b) x * x can be represented exactly as a double, and
-// c) the difference between S0 and C0 represented as a double vs infinite precision is minimized.
-// Note that condition (a) requires different multipliers for different MIDDLE values.
-
-#if MIDDLE <= 4 || MIDDLE == 6 || MIDDLE == 8 || MIDDLE == 12
-
-#define SIN_COEFS {0.013255665205020225,-3.8819803226819742e-07,3.4105654433606424e-12,-1.4268560139781677e-17,3.4821751757020666e-23,-5.5620764489252689e-29,6.2011635226098908e-35, 237}
-#define COS_COEFS {-8.7856330013791936e-05,1.2864557872487131e-09,-7.5348856128299892e-15,2.3642407019488875e-20,-4.6158547847666762e-26,6.1440808274170587e-32,-5.8714657758002626e-38, 237}
-
-#elif MIDDLE == 11
-
-#define SIN_COEFS {0.0058285577988678909,-3.3001377814174114e-08,5.6056282285321817e-14,-4.5341639101320423e-20,2.1393746357239815e-26,-6.6068179928427645e-33,1.4241237670800455e-39, 49*11}
-
-// {0.005492294848933205,-2.761278944626038e-08,4.1647407612374865e-14,-2.9912063263788177e-20,1.2532031863362935e-26,-3.4364949357849832e-33,6.5816772637974481e-40, 143 * 4};
-
-#define COS_COEFS {-1.6986043007371857e-05,4.8087609508047477e-11,-5.4454546881584527e-17,3.3034545522108849e-23,-1.2469468591680302e-29,3.2090160573145604e-36,-5.9289892824449386e-43, 49*11}
-
-// {-1.5082651353809108e-05,3.7914395310092582e-11,-3.8123307049954028e-17,2.0535733847563737e-23,-6.8829596395036851e-30,1.5727926864212422e-36,-2.5737325744028274e-43, 143 * 4};
-
-// This should be the best choice for MIDDLE=11.  For reasons I cannot explain, the Sun coefficients beat this
-// code.  We know this code works as it gives great results for MIDDLE=5 and MIDDLEE=10.
-#elif MIDDLE == 5 || MIDDLE == 10 || MIDDLE == 11
-
-#define SIN_COEFS {0.0033599921428767842,-6.3221316482145663e-09,3.5687001824123009e-15,-9.5926212207432193e-22,1.5041156546369205e-28,-1.5436222869257443e-35,1.1057341951605355e-42, 85 * 11}
-#define COS_COEFS {-5.6447736000968621e-06,5.3105781660583875e-12,-1.9984674288638241e-18,4.0288914910974918e-25,-5.0538167304629085e-32,4.3221291704923216e-39,-2.6537550015407366e-46, 85 * 11}
-
-#elif MIDDLE == 7 || MIDDLE == 14
-
-#define SIN_COEFS {0.0030120734933746819,-4.5545496673734544e-09,2.066077343547647e-15,-4.4630156850662332e-22,5.6237622654854882e-29,-4.6381134477150518e-36,2.6699656391050201e-43, 149 * 7}
-#define COS_COEFS {-4.5362933647451799e-06,3.4296595818385068e-12,-1.0371961336265129e-18,1.6803664055570525e-25,-1.6939185081650983e-32,1.1641940392856976e-39,-5.7443786570712859e-47, 149 * 7}
-
-#elif MIDDLE == 9
-
-#define SIN_COEFS {0.0032024389944850084,-5.4738305054252556e-09,2.8068750524532041e-15,-6.8538645985346134e-22,9.7625812823195236e-29,-9.1014309535685973e-36,5.9224934064240749e-43, 109*9}
-#define COS_COEFS {-5.1278077566990758e-06,4.3824020649438457e-12,-1.4981410201032161e-18,2.7436354064447543e-25,-3.1264070669243379e-32,2.4288963593034543e-39,-1.3547441195887408e-46,109*9}
-
-#elif MIDDLE == 13
-
-#define SIN_COEFS {0.0034036756810290284,-6.5719350793639721e-09,3.8067960700283384e-15,-1.0500419865908618e-21,1.6895475541832181e-28,-1.779303563885441e-35,1.3079151443222568e-42, 71*13}
-#define COS_COEFS {-5.7925040708142102e-06,5.5921839017331711e-12,-2.1595165343644285e-18,4.4675029669254463e-25,-5.7506718639750315e-32,5.0468065746580596e-39,-3.1797982320621979e-46, 71*13}
-
-#elif MIDDLE == 15
-
-#define SIN_COEFS {0.0032221463113741469,-5.5755089924509359e-09,2.8943099587177684e-15,-7.1546148933480147e-22,1.0316780436916074e-28,-9.7368389615915834e-36,6.4141878934890016e-43, 65*15}
-#define COS_COEFS {-5.1911134259510105e-06,4.4912764335147829e-12,-1.5543150262419615e-18,2.8816519982635366e-25,-3.3242175693980929e-32,2.6144580878684214e-39,-1.4762460824550342e-46, 65*15}
-
-#endif
-
-double ksinpi(u32 k, u32 n) {
-  const double S[] = SIN_COEFS;
-  
-  double x = S[7] / n * k;
-  double z = x * x;
-  double r = fma(fma(fma(fma(fma(S[6], z, S[5]), z, S[4]), z, S[3]), z, S[2]), z, S[1]) * (z * x);
-  return fma(x, S[0], r);
-}
-
-#else
-
-// Copyright notice of original k_cos, k_sin from which our ksin/kcos evolved:
-/* ====================================================
- * Copyright (C) 1993 by Sun Microsystems, Inc. All rights reserved.
- *
- * Developed at SunSoft, a Sun Microsystems, Inc. business.
- * Permission to use, copy, modify, and distribute this
- * software is freely granted, provided that this notice 
- * is preserved.
- * ====================================================
- */
-
-// Coefficients from http://www.netlib.org/fdlibm/k_cos.c
-#define COS_COEFS {-0.5,0.041666666666666602,-0.001388888888887411,2.4801587289476729e-05,-2.7557314351390663e-07,2.0875723212981748e-09,-1.1359647557788195e-11, M_PI}
-
-// Experimental: const double C[] = {-0.5,0.041666666666665589,-0.0013888888888779014,2.4801587246942509e-05,-2.7557304501248813e-07,2.0874583610048953e-09,-1.1307548621486489e-11, M_PI};
-
-double ksinpi(u32 k, u32 n) {
-  // const double S[] = {-0.16666666666666455,0.0083333333332988729,-0.00019841269816529426,2.7557310051600518e-06,-2.5050279451232251e-08,1.5872611854244144e-10};
-
-  // Coefficients from http://www.netlib.org/fdlibm/k_sin.c
-  const double S[] = {1, -0.16666666666666666,0.0083333333333309497,-0.00019841269836761127,2.7557316103728802e-06,-2.5051132068021698e-08,1.5918144304485914e-10, M_PI};
-  
-  double x = S[7] / n * k;
-  double z = x * x;
-  // Special-case based on S[0]==1:
-  return fma(fma(fma(fma(fma(fma(S[6], z, S[5]), z, S[4]), z, S[3]), z, S[2]), z, S[1]), z * x, x);
-}
-
-#endif
-
-double kcospi(u32 k, u32 n) {
-  const double C[] = COS_COEFS;
-  double x = C[7] / n * k;
-  double z = x * x;
-  return fma(fma(fma(fma(fma(fma(fma(C[6], z, C[5]), z, C[4]), z, C[3]), z, C[2]), z, C[1]), z, C[0]), z, 1);
-}
-
-// N represents a full circle, so N/2 is pi radians and N/8 is pi/4 radians.
-double2 reducedCosSin(u32 k, u32 N) {
-  assert(k <= N/8);
-  return U2(kcospi(k, N/2), -ksinpi(k, N/2));
-}
-
 global double2 TRIG_2SH[SMALL_HEIGHT / 4 + 1];
 global double2 TRIG_BH[BIG_HEIGHT / 8 + 1];
 
@@ -903,32 +797,7 @@ global double2 TRIG_W[WIDTH / 2 + 1];
 TT THREAD_WEIGHTS[G_W];
 TT CARRY_WEIGHTS[BIG_HEIGHT / CARRY_LEN];
 
-double2 tableTrig(u32 k, u32 n, u32 kBound, global double2* trigTable) {
-  assert(n % 8 == 0);
-  assert(k < kBound);       // kBound actually bounds k
-  assert(kBound <= 2 * n);  // angle <= 2 tau
-
-  if (kBound > n && k >= n) { k -= n; }
-  assert(k < n);
-
-  bool negate = kBound > n/2 && k >= n/2;
-  if (negate) { k -= n/2; }
-  
-  bool negateCos = kBound > n / 4 && k >= n / 4;
-  if (negateCos) { k = n/2 - k; }
-  
-  bool flip = kBound > n / 8 + 1 && k > n / 8;
-  if (flip) { k = n / 4 - k; }
-
-  assert(k <= n / 8);
-
-  double2 r = trigTable[k];
-
-  if (flip) { r = -swap(r); }
-  if (negateCos) { r.x = -r.x; }
-  if (negate) { r = -r; }
-  return r;
-}
+#include "trig.cl"
 
 float fastSinSP(u32 k, u32 tau, u32 M) {
   // These DP coefs are optimized for computing sin(2*pi*x) with x in [0, 1/8], using
@@ -989,64 +858,6 @@ KERNEL(64) writeGlobals(global double2* trig2ShDP, global double2* trigBhDP, glo
   for (u32 k = get_global_id(0); k < BIG_HEIGHT / CARRY_LEN; k += get_global_size(0)) { CARRY_WEIGHTS[k] = carryWeights[k]; }  
 }
 
-double2 slowTrig_2SH(u32 k, u32 kBound) { return tableTrig(k, 2 * SMALL_HEIGHT, kBound, TRIG_2SH); }
-double2 slowTrig_BH(u32 k, u32 kBound)  { return tableTrig(k, BIG_HEIGHT, kBound, TRIG_BH); }
-
-// Returns e^(-i * tau * k / n), (tau == 2*pi represents a full circle). So k/n is the ratio of a full circle.
-// Inverse trigonometric direction is chosen as an FFT convention.
-double2 slowTrig_N(u32 k, u32 kBound)   {
-  u32 n = ND;
-  assert(n % 8 == 0);
-  assert(k < kBound);       // kBound actually bounds k
-  assert(kBound <= 2 * n);  // angle <= 2 tau
-
-  if (kBound > n && k >= n) { k -= n; }
-  assert(k < n);
-
-  bool negate = kBound > n/2 && k >= n/2;
-  if (negate) { k -= n/2; }
-  
-  bool negateCos = kBound > n / 4 && k >= n / 4;
-  if (negateCos) { k = n/2 - k; }
-  
-  bool flip = kBound > n / 8 + 1 && k > n / 8;
-  if (flip) { k = n / 4 - k; }
-
-  assert(k <= n / 8);
-
-#if TRIG_COMPUTE >= 2
-  double2 r = reducedCosSin(k, n);
-#elif TRIG_COMPUTE == 1
-  u32 a = (k + WIDTH/2) / WIDTH;
-  i32 b = k - a * WIDTH;
-  
-  double2 cs1 = TRIG_BH[a];
-  double c1 = cs1.x;
-  double s1 = cs1.y;
-  
-  double2 cs2 = TRIG_W[abs(b)];
-  double c2 = cs2.x;
-  double s2 = (b < 0) ? -cs2.y : cs2.y; 
-
-  // cos(a+b) = cos(a)cos(b) - sin(a)sin(b)
-  // sin(a+b) = cos(a)sin(b) + sin(a)cos(b)
-  // c2 is stored with "-1" trick to increase accuracy, so we use fma(x,y,x) for x*(y+1)
-  double c = fma(-s1, s2, fma(c1, c2, c1));
-  double s = fma(c1, s2, fma(s1, c2, s1));
-  double2 r = (double2)(c, s);
-#elif TRIG_COMPUTE == 0
-  double2 r = TRIG_N[k];
-#else
-#error set TRIG_COMPUTE to 0, 1 or 2.
-#endif
-
-  if (flip) { r = -swap(r); }
-  if (negateCos) { r.x = -r.x; }
-  if (negate) { r = -r; }
-  
-  return r;
-}
-
 void transposeWords(u32 W, u32 H, local Word2 *lds, const Word2 *in, Word2 *out) {
   u32 GPW = W / 64, GPH = H / 64;
 
@@ -1114,6 +925,128 @@ KERNEL(256) isNotZero(P(bool) outNotZero, u32 sizeBytes, global i64 *in) {
   }
 }
 
+// Residue compaction on the device, see Gpu::readAndCompress() and compactBitsChunked() (the CPU reference).
+// The sequential words (after transposeOut) are unbalanced to [0, 2^bits) and packed into EXP bits, in chunks of
+// COMPACT_CHUNK words. compactCarry finds the borrow out of each chunk for both possible borrows in,
+// compactScan resolves the borrows between chunks, and compactPack packs each chunk independently.
+#define COMPACT_CHUNK 64
+#define N_COMPACT_CHUNKS (NWORDS / COMPACT_CHUNK)
+
+u32 compactBitlen(u32 k) { return bitlen(((ulong) STEP * k) % NWORDS + STEP < NWORDS); }
+
+Word compactUnbalance(Word w, u32 nBits, i32 *borrow) {
+  w += *borrow;
+  *borrow = 0;
+  if (w < 0) {
+    w += (1 << nBits);
+    *borrow = -1;
+  }
+  return w;
+}
+
+// The borrow out of a chunk as a function of the borrow in: .x for a borrow in of 0, .y for -1.
+i32 applyBorrow(int2 f, i32 borrow) { return borrow ? f.y : f.x; }
+
+// "f" after "g".
+int2 composeBorrow(int2 f, int2 g) { return (int2) (applyBorrow(f, g.x), applyBorrow(f, g.y)); }
+
+KERNEL(64) compactCarry(P(int2) chunkBorrow, CP(Word) in) {
+  u32 c = get_global_id(0);
+  if (c >= N_COMPACT_CHUNKS) { return; }
+  i32 b0 = 0, b1 = -1;
+  for (u32 k = c * COMPACT_CHUNK, end = k + COMPACT_CHUNK; k < end; ++k) {
+    u32 nBits = compactBitlen(k);
+    Word w = in[k];
+    compactUnbalance(w, nBits, &b0);
+    compactUnbalance(w, nBits, &b1);
+  }
+  chunkBorrow[c] = (int2) (b0, b1);
+}
+
+// A single group; each thread composes a segment of chunks, followed by a scan over the segments.
+KERNEL(256) compactScan(P(i32) borrowIn, P(i32) wrapBorrow, CP(int2) chunkBorrow) {
+  local int2 lds[256];
+  u32 me = get_local_id(0);
+  u32 per = (N_COMPACT_CHUNKS + 255) / 256;
+  u32 begin = min(me * per, (u32) N_COMPACT_CHUNKS);
+  u32 end = min(begin + per, (u32) N_COMPACT_CHUNKS);
+
+  int2 f = (int2) (0, -1);
+  for (u32 c = begin; c < end; ++c) { f = composeBorrow(chunkBorrow[c], f); }
+  lds[me] = f;
+
+  for (u32 step = 1; step < 256; step *= 2) {
+    bar();
+    int2 g = (me >= step) ? lds[me - step] : (int2) (0, -1);
+    bar();
+    f = composeBorrow(f, g);
+    lds[me] = f;
+  }
+  bar();
+
+  i32 borrow = me ? lds[me - 1].x : 0;
+  for (u32 c = begin; c < end; ++c) {
+    borrowIn[c] = borrow;
+    borrow = applyBorrow(chunkBorrow[c], borrow);
+  }
+  if (me == 255) { wrapBorrow[0] = borrow; }
+}
+
+// "out" must be zero on entry. The words shared with the neighbouring chunks are OR-ed atomically.
+KERNEL(64) compactPack(P(u32) out, CP(Word) in, CP(i32) borrowIn) {
+  u32 c = get_global_id(0);
+  if (c >= N_COMPACT_CHUNKS) { return; }
+  i32 borrow = borrowIn[c];
+  u32 k = c * COMPACT_CHUNK;
+  u32 pos = ((ulong) k * EXP + (NWORDS - 1)) / NWORDS;
+  u32 wordPos = pos / 32;
+  u32 have = pos % 32;
+  ulong acc = 0;
+  bool first = true;
+  for (u32 end = k + COMPACT_CHUNK; k < end; ++k) {
+    u32 nBits = compactBitlen(k);
+    acc |= ((ulong) (u32) compactUnbalance(in[k], nBits, &borrow)) << have;
+    have += nBits;
+    if (have >= 32) {
+      if (first) {
+        atomic_or(&out[wordPos], (u32) acc);
+        first = false;
+      } else {
+        out[wordPos] = (u32) acc;
+      }
+      ++wordPos;
+      acc >>= 32;
+      have -= 32;
+    }
+  }
+  if (have) { atomic_or(&out[wordPos], (u32) acc); }
+}
+
+// Histogram of the per-iteration ROE, see RoeStats. The bins cover [0, 0.5]; hist[ROE_BINS] gets the max (as uint).
+// "hist" must be zero on entry.
+#define ROE_BINS 256
+
+KERNEL(256) roeHist(P(u32) hist, CP(float) roe, u32 n) {
+  local u32 lds[ROE_BINS];
+  u32 me = get_local_id(0);
+  for (u32 i = me; i < ROE_BINS; i += 256) { lds[i] = 0; }
+  bar();
+
+  u32 m = 0;
+  for (u32 i = get_global_id(0); i < n; i += get_global_size(0)) {
+    float x = roe[i];
+    atomic_inc(&lds[min((u32) (x * (2 * ROE_BINS)), ROE_BINS - 1u)]);
+    m = max(m, as_uint(x));
+  }
+  m = work_group_reduce_max(m);
+  bar();
+
+  for (u32 i = me; i < ROE_BINS; i += 256) {
+    if (lds[i]) { atomic_add(&hist[i], lds[i]); }
+  }
+  if (me == 0) { atomic_max(&hist[ROE_BINS], m); }
+}
+
 void fft_WIDTH(local T2 *lds, T2 *u, Trig trig) {
 #if WIDTH == 256
   fft256w(lds, u, trig);
@@ -1676,6 +1609,11 @@ KERNEL(G_W) NAME(u32 posROE, P(Word2) out, CP(T2) in, P(CarryABM) carryOut, CP(u
     double w1 = i == 0 ? base : optionalDouble(fancyMul(base, iweightUnitStep(i)));
     double w2 = optionalDouble(fancyMul(w1, IWEIGHT_STEP));
     T2 x = conjugate(in[p]) * U2(w1, w2);
+
+#if DO_SUB2
+    // Lucas-Lehmer "-2", applied to word 0.
+    if (g == 0 && me == 0 && i == 0) { x.x -= 2; }
+#endif
         
 #if DO_MUL3
     out[p] = carryPairMul(x, &carry, test(b, 2 * i), test(b, 2 * i + 1), carry, &roundMax, &carryMax);
@@ -1695,8 +1633,9 @@ KERNEL(G_W) NAME(u32 posROE, P(Word2) out, CP(T2) in, P(CarryABM) carryOut, CP(u
 }
 //}}
 
-//== CARRYA NAME=kernCarryA,DO_MUL3=0
-//== CARRYA NAME=kernCarryM,DO_MUL3=1
+//== CARRYA NAME=kernCarryA,DO_MUL3=0,DO_SUB2=0
+//== CARRYA NAME=kernCarryM,DO_MUL3=1,DO_SUB2=0
+//== CARRYA NAME=kernCarryLL,DO_MUL3=0,DO_SUB2=1
 
 KERNEL(G_W) carryB(P(Word2) io, CP(CarryABM) carryIn, CP(u32) bits) {
   u32 g  = get_group_id(0);
@@ -1781,6 +1720,11 @@ KERNEL(G_W) NAME(u32 posROE, P(T2) out, CP(T2) in, P(i64) carryShuttle, P(u32) r
     u[i] = conjugate(u[i]) * U2(invWeight1, invWeight2);
   }
 
+#if CF_SUB2
+  // Lucas-Lehmer "-2", applied to word 0. Line 0 is processed by both the first and the last group.
+  if (line == 0 && me == 0) { u[0].x -= 2; }
+#endif
+
   // Generate our output carries
   for (i32 i = 0; i < NW; ++i) {
 #if CF_MUL    
@@ -1861,8 +1805,9 @@ KERNEL(G_W) NAME(u32 posROE, P(T2) out, CP(T2) in, P(i64) carryShuttle, P(u32) r
 }
 //}}
 
-//== CARRY_FUSED NAME=kernCarryFused,    CF_MUL=0
-//== CARRY_FUSED NAME=kernCarryFusedMul, CF_MUL=1
+//== CARRY_FUSED NAME=kernCarryFused,    CF_MUL=0, CF_SUB2=0
+//== CARRY_FUSED NAME=kernCarryFusedMul, CF_MUL=1, CF_SUB2=0
+//== CARRY_FUSED NAME=kernCarryFusedLL,  CF_MUL=0, CF_SUB2=1
 
 // from transposed to sequential.
 KERNEL(64) transposeOut(P(Word2) out, CP(Word2) in) {
@@ -8,7 +8,9 @@
 #include "common.h"
 
 #include <string>
+#include <string_view>
 #include <stdexcept>
+#include <vector>
 
 class Kernel {
   KernelHolder kernel;
@@ -17,6 +19,11 @@ class Kernel {
   size_t workSize;
   string name;
 
+  // The bytes of the argument last set at each position. An unchanged argument is not set again, so in the
+  // steady state of the squaring loop the only clSetKernelArg left is that of posROE. Buffers compare by their id,
+  // as a released cl_mem handle may be reused by a new buffer.
+  std::vector<string> argCache;
+
 public:
   Kernel(cl_program program, QueuePtr queue, cl_device_id device, u32 nWorkGroups, const std::string &name) :
     kernel(makeKernel(program, name.c_str())),
@@ -47,10 +54,29 @@ public:
   string getName() { return name; }
 
 private:
-  template<typename T> void setArgs(int pos, const ConstBuffer<T>& buf) { setArgs(pos, buf.get()); }
-  template<typename T> void setArgs(int pos, const Buffer<T>& buf) { setArgs(pos, buf.get()); }
-  template<typename T> void setArgs(int pos, const HostAccessBuffer<T>& buf) { setArgs(pos, buf.get()); }
-  template<typename T> void setArgs(int pos, const T &arg) { ::setArg(kernel.get(), pos, arg); }
+  template<typename T> void setArgs(int pos, const ConstBuffer<T>& buf) { setBuf(pos, buf); }
+  template<typename T> void setArgs(int pos, const Buffer<T>& buf) { setBuf(pos, buf); }
+  template<typename T> void setArgs(int pos, const HostAccessBuffer<T>& buf) { setBuf(pos, buf); }
+  template<typename T> void setArgs(int pos, const PinnedBuffer<T>& buf) { setBuf(pos, buf); }
+  template<typename T> void setArgs(int pos, const T &arg) {
+    if (isCached(pos, &arg, sizeof(T))) { return; }
+    ::setArg(kernel.get(), pos, arg);
+  }
+
+  template<typename T> void setBuf(int pos, const ConstBuffer<T>& buf) {
+    u64 id = buf.getId();
+    if (isCached(pos, &id, sizeof(id))) { return; }
+    ::setArg(kernel.get(), pos, buf.get());
+  }
+
+  // Whether the argument at pos is already these bytes; if not, records them as the new argument.
+  bool isCached(int pos, const void *p, size_t size) {
+    std::string_view bytes{static_cast<const char *>(p), size};
+    if (u32(pos) >= argCache.size()) { argCache.resize(pos + 1); }
+    if (argCache[pos] == bytes) { return true; }
+    argCache[pos] = bytes;
+    return false;
+  }
   
   template<typename T, typename... Args> void setArgs(int pos, const T &arg, const Args &...tail) {
     setArgs(pos, arg);
@@ -1,52 +1,301 @@
 #include "log.h"
 #include "File.h"
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdarg>
 #include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <exception>
 #include <mutex>
+#include <thread>
 
-vector<File> logFiles;
 string globalCpuName;
-string context;
+// Each thread (e.g. a background preparation) has its own log context.
+thread_local string context;
 
-void initLog() { logFiles.emplace_back(stdout, "stdout"); }
+namespace {
+
+// log() only formats the message into a slot of a bounded lock-free MPSC ring (Vyukov's sequence-per-slot scheme)
+// and returns; the flusher thread takes the timestamp prefix from a per-second cache, writes the whole batch to each
+// file and flushes once per batch. A slow log file (e.g. on NFS) stalls only the flusher: when the ring is full
+// the lines are dropped and counted, never waited for.
+enum Kind : u32 { LINE, SPIN };
+
+struct Slot {
+  std::atomic<u64> seq;
+  Kind kind;
+  time_t time;
+  u32 prefixLen; // the first prefixLen chars of text are the cpu name and the context
+  char text[2 * 1024 + 256];
+};
+
+constexpr u32 N_SLOTS = 512;
+
+class Ring {
+  Slot slots[N_SLOTS];
+  alignas(64) std::atomic<u64> tail{0};
+  alignas(64) u64 head = 0; // only the flusher reads
+
+public:
+  Ring() { for (u64 i = 0; i < N_SLOTS; ++i) { slots[i].seq.store(i, std::memory_order_relaxed); } }
+
+  // The slot for the next message, or null when the ring is full. Must be published with push().
+  Slot* claim(u64 *pos) {
+    u64 p = tail.load(std::memory_order_relaxed);
+    while (true) {
+      Slot* slot = &slots[p % N_SLOTS];
+      i64 diff = i64(slot->seq.load(std::memory_order_acquire) - p);
+      if (diff == 0) {
+        if (tail.compare_exchange_weak(p, p + 1, std::memory_order_relaxed)) {
+          *pos = p;
+          return slot;
+        }
+      } else if (diff < 0) {
+        return nullptr;
+      } else {
+        p = tail.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  void push(Slot* slot, u64 pos) { slot->seq.store(pos + 1, std::memory_order_release); }
+
+  // The oldest published slot, or null. Must be released with pop().
+  Slot* front() {
+    Slot* slot = &slots[head % N_SLOTS];
+    return slot->seq.load(std::memory_order_acquire) == head + 1 ? slot : nullptr;
+  }
+
+  void pop(Slot* slot) { slot->seq.store(++head + N_SLOTS - 1, std::memory_order_release); }
+
+  bool empty() const { return tail.load(std::memory_order_acquire) == head; }
+};
+
+string jsonEscape(string_view s) {
+  string out;
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (u8(c) < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      out += buf;
+    } else {
+      out += c;
+    }
+  }
+  return out;
+}
+
+class AsyncLog {
+  Ring ring;
+  std::atomic<u64> nDropped{0};
+
+  std::mutex mut; // guards the files and the flusher state below
+  std::condition_variable cond;
+  vector<File> files;
+  std::optional<File> jsonFile;
+  bool stopping = false;
+  std::thread flusher;
+
+  time_t cachedTime = 0;
+  string cachedStamp;
+
+  const string& stamp(time_t t) {
+    if (t != cachedTime) {
+      char buf[64];
+      strftime(buf, sizeof(buf), "%Y%m%d %H:%M:%S", localtime(&t));
+      cachedTime = t;
+      cachedStamp = buf;
+    }
+    return cachedStamp;
+  }
+
+  // Moves the published messages out of the ring into the text of one batch per sink.
+  u32 drain(string& out, string& outStdout, string& outJson) {
+    u32 n = 0;
+    for (Slot* slot; (slot = ring.front()); ++n) {
+      string_view text{slot->text};
+      if (slot->kind == SPIN) {
+        outStdout += '\r';
+        outStdout += text;
+      } else {
+        const string& t = stamp(slot->time);
+        string line = t + ' ' + string(text.substr(0, slot->prefixLen)) + ' ' + string(text.substr(slot->prefixLen));
+        out += line;
+        outStdout += '\r';
+        outStdout += line;
+        if (jsonFile) {
+          string_view mes = text.substr(slot->prefixLen);
+          if (!mes.empty() && mes.back() == '\n') { mes.remove_suffix(1); }
+          outJson += "{\"time\":"s + to_string(slot->time) + ",\"context\":\""s
+            + jsonEscape(text.substr(0, slot->prefixLen)) + "\",\"message\":\""s + jsonEscape(mes) + "\"}\n"s;
+        }
+      }
+      ring.pop(slot);
+    }
+    if (u64 dropped = nDropped.exchange(0)) {
+      string line = stamp(time(nullptr)) + " log: "s + to_string(dropped) + " messages dropped, the log output is too slow\n"s;
+      out += line;
+      outStdout += '\r' + line;
+    }
+    return n;
+  }
+
+  void write(const string& out, const string& outStdout, const string& outJson) {
+    for (File& f : files) {
+      const string& s = f.get() == stdout ? outStdout : out;
+      if (!s.empty()) {
+        fwrite(s.data(), s.size(), 1, f.get());
+        fflush(f.get());
+      }
+    }
+    if (jsonFile && !outJson.empty()) {
+      fwrite(outJson.data(), outJson.size(), 1, jsonFile->get());
+      fflush(jsonFile->get());
+    }
+  }
+
+  void run() {
+    std::unique_lock lock(mut);
+    while (true) {
+      string out, outStdout, outJson;
+      u32 n = drain(out, outStdout, outJson);
+      if (n || !out.empty()) {
+        write(out, outStdout, outJson);
+        cond.notify_all();
+        continue;
+      }
+      if (stopping) { break; }
+      // The producers do not take the lock, so a wakeup may be missed; the timeout bounds the latency.
+      cond.wait_for(lock, std::chrono::milliseconds(20));
+    }
+  }
+
+public:
+  ~AsyncLog() {
+    {
+      std::unique_lock lock(mut);
+      if (!flusher.joinable()) { return; }
+      stopping = true;
+    }
+    cond.notify_all();
+    flusher.join();
+  }
+
+  void addFile(File&& f) {
+    std::unique_lock lock(mut);
+    files.push_back(std::move(f));
+    if (!flusher.joinable()) { flusher = std::thread{[this]() { run(); }}; }
+  }
+
+  void setJsonFile(File&& f) {
+    std::unique_lock lock(mut);
+    jsonFile.emplace(std::move(f));
+  }
+
+  void put(Kind kind, const string& prefix, const char *fmt, va_list va) {
+    u64 pos = 0;
+    Slot* slot = ring.claim(&pos);
+    if (!slot) {
+      if (kind == LINE) { ++nDropped; }
+      return;
+    }
+    slot->kind = kind;
+    slot->time = time(nullptr);
+    u32 prefixLen = std::min<u32>(prefix.size(), 255);
+    memcpy(slot->text, prefix.data(), prefixLen);
+    slot->prefixLen = prefixLen;
+    vsnprintf(slot->text + prefixLen, sizeof(slot->text) - prefixLen, fmt, va);
+    ring.push(slot, pos);
+    cond.notify_one();
+  }
+
+  void putf(Kind kind, const string& prefix, const char *fmt, ...) {
+    va_list va;
+    va_start(va, fmt);
+    put(kind, prefix, fmt, va);
+    va_end(va);
+  }
+
+  // Writes out the queued lines from the calling thread, for a process that is about to die (e.g. an assert):
+  // the flusher may never run again. Gives up if the flusher does not let go of the files within a second.
+  void flushNow() {
+    std::unique_lock lock(mut, std::defer_lock);
+    for (int i = 0; i < 100 && !lock.try_lock(); ++i) { std::this_thread::sleep_for(std::chrono::milliseconds(10)); }
+    if (!lock.owns_lock()) { return; }
+    string out, outStdout, outJson;
+    drain(out, outStdout, outJson);
+    write(out, outStdout, outJson);
+  }
+
+  // Waits until everything logged so far is written out.
+  void flush() {
+    std::unique_lock lock(mut);
+    if (!flusher.joinable()) { return; }
+    cond.notify_all();
+    while (!ring.empty()) { cond.wait_for(lock, std::chrono::milliseconds(20)); }
+  }
+};
+
+AsyncLog asyncLog;
+
+void abortHandler(int) {
+  asyncLog.flushNow();
+  signal(SIGABRT, SIG_DFL);
+  raise(SIGABRT);
+}
+
+// The diagnostic logged just before a failed assert or an uncaught exception must reach the log.
+void installAbortFlush() {
+  signal(SIGABRT, abortHandler);
+  static std::terminate_handler oldTerminate = std::set_terminate([]() {
+    asyncLog.flushNow();
+    oldTerminate();
+  });
+}
+
+}
+
+void initLog() {
+  installAbortFlush();
+  asyncLog.addFile(File{stdout, "stdout"});
+}
 
 void initLog(const char *logName) {
-  auto fo = File::openAppend(logName);
-#if defined(_DEFAULT_SOURCE) || defined(_BSD_SOURCE)
-    setlinebuf(fo.get());
-#endif
-  logFiles.push_back(std::move(fo));
+  // The lines logged before the file was opened are not written to it.
+  asyncLog.flush();
+  asyncLog.addFile(File::openAppend(logName));
 }
 
+void initJsonLog(const string& name) { asyncLog.setJsonFile(File::openAppend(name)); }
+
+void logFlush() { asyncLog.flush(); }
+
 string longTimeStr()  { return timeStr("%Y-%m-%d %H:%M:%S %Z"); }
 string shortTimeStr() { return timeStr("%Y%m%d %H:%M:%S"); }
 
 void log(const char *fmt, ...) {
-  static std::mutex logMutex;
-  
-  char buf[2 * 1024];
-
   va_list va;
   va_start(va, fmt);
-  vsnprintf(buf, sizeof(buf), fmt, va);
+  asyncLog.put(LINE, globalCpuName.empty() ? context : globalCpuName + " "s + context, fmt, va);
   va_end(va);
-  
-  string prefix = shortTimeStr() + " "s + (globalCpuName.empty() ? "" : globalCpuName + " "s) + context;
-
-  std::unique_lock lock(logMutex);
-  for (auto &f : logFiles) {
-    fprintf(f.get(), f.get() == stdout ? "\r%s %s" : "%s %s", prefix.c_str(), buf);
-#if !(defined(_DEFAULT_SOURCE) || defined(_BSD_SOURCE))
-    fflush(f.get());
-#endif
-  }
 }
 
+void logSpin(char c) { asyncLog.putf(SPIN, "", "%c", c); }
+
 LogContext::LogContext(const string& s) : part{s} {
   assert(!s.empty()); // && (s.find(' ') == string::npos));
   context = context + s;
 }
 
+string LogContext::current() { return context; }
+
 LogContext::~LogContext() {
   auto p = context.rfind(part);
   assert(p != string::npos);
@@ -8,13 +8,27 @@ void log(const char *fmt, ...) __attribute__ ((format(printf, 1, 2)));
 void log(const char *fmt, ...);
 #endif
 
+// The log lines are written by a background thread, see log.cpp. The queued lines are written out on abort()
+// (a failed assert) and std::terminate() too.
 void initLog();
 void initLog(const char *);
 
+// Also write each log line as a JSON object, one per line, to this file.
+void initJsonLog(const std::string& name);
+
+// Returns once the lines logged so far have been written.
+void logFlush();
+
+// The progress spinner, on stdout only.
+void logSpin(char c);
+
 struct LogContext {
   explicit LogContext(const std::string& s);
   ~LogContext();
 
+  // The full context of the calling thread, to be carried over to a helper thread.
+  static std::string current();
+
 private:
   std::string part;
 };
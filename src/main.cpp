@@ -9,9 +9,14 @@
 #include "AllocTrac.h"
 #include "typeName.h"
 #include "log.h"
+#include "Lookahead.h"
+#include "Background.h"
+#include "Calibrate.h"
+#include "FFTConfig.h"
 
 #include <cstdio>
 #include <filesystem>
+#include <thread>
 
 extern string globalCpuName;
 
@@ -34,6 +39,39 @@ static void readConfig(Args& args, const fs::path& path, bool doLog) {
   }
 }
 
+// Runs the tasks from worktodo.txt until there are none left.
+static void runTasks(const Args& args) {
+  Lookahead lookahead{args};
+  Background background;
+  while (auto task = Worktodo::getTask(args)) { task->execute(args, &lookahead, &background); }
+}
+
+// One worker thread per device (-devices), or -workers threads per device. Each worker has its own Gpu,
+// thus its own queue and buffers; the workers pick up the tasks from the shared worktodo.txt.
+static void runWorkers(const Args& args) {
+  vector<std::thread> workers;
+  for (int device : args.devices) {
+    Args deviceArgs = args;
+    deviceArgs.setDevice(device);
+    for (u32 i = 0; i < args.workers; ++i) {
+      string name = deviceArgs.cpu + (args.workers > 1 ? "#" + to_string(i) : ""s);
+      workers.emplace_back([workerArgs = deviceArgs, name]() {
+        LogContext context{name + ' '};
+        try {
+          runTasks(workerArgs);
+        } catch (const char *mes) {
+          log("Worker exiting because \"%s\"\n", mes);
+        } catch (const std::exception& e) {
+          log("Worker exception %s: %s\n", typeName(e), e.what());
+        } catch (...) {
+          log("Worker unexpected exception\n");
+        }
+      });
+    }
+  }
+  for (auto& w : workers) { w.join(); }
+}
+
 int main(int argc, char **argv) {
   initLog();
   log("GpuOwl VERSION %s\n", VERSION);
@@ -47,6 +85,7 @@ int main(int argc, char **argv) {
       args.parse(mainLine);
       if (!args.dir.empty()) { filesystem::current_path(args.dir); }
       initLog("gpuowl.log");
+      if (!args.jsonLog.empty()) { initJsonLog(args.jsonLog.string()); }
     }
 
     log("GpuOwl VERSION %s\n", VERSION);
@@ -66,16 +105,23 @@ int main(int argc, char **argv) {
       args.parse(mainLine);
     }
     args.setDefaults();
-    if (!args.cpu.empty()) { globalCpuName = args.cpu; }
+    // With -devices the name of each worker is in its log context instead.
+    if (!args.cpu.empty() && args.devices.empty()) { globalCpuName = args.cpu; }
     
     if (args.maxAlloc) { AllocTrac::setMaxAlloc(args.maxAlloc); }
+
+    FFTConfig::loadLimits(args.fftLimits);
     
-    if (args.prpExp) {
+    if (!args.calibrate.empty()) {
+      calibrate(args);
+    } else if (args.prpExp) {
       Worktodo::makePRP(args, args.prpExp).execute(args);
     } else if (!args.verifyPath.empty()) {
       Worktodo::makeVerify(args, args.verifyPath).execute(args);
+    } else if (!args.devices.empty()) {
+      runWorkers(args);
     } else {
-      while (auto task = Worktodo::getTask(args)) { task->execute(args); }
+      runTasks(args);
     }
   } catch (const char *mes) {
     log("Exiting because \"%s\"\n", mes);
@@ -88,5 +134,6 @@ int main(int argc, char **argv) {
   // background.wait();
   // if (factorFoundForExp) { Worktodo::deletePRP(factorFoundForExp); }
   log("Bye\n");
+  logFlush();
   return exitCode; // not used yet.
 }
@@ -0,0 +1,136 @@
+// Copyright Mihai Preda.
+
+// The integer NTT squaring of NttGpu, bit-exact with the CPU Ntt: the residue is NDIGITS digits of BITS, squared with a
+// zero-padded convolution of length L over the primes P1 and P2, combined with CRT, folded modulo 2^E - 1.
+// The two transforms are in one buffer of 2*L: P1 at [0, L), P2 at [L, 2L). Data is kept in the normal (not Montgomery)
+// form; the twiddles and the constants that multiply it are in Montgomery form, R = 2^32.
+
+/* Set by the host:
+L          the transform length, a power of two >= 2 * NDIGITS
+NDIGITS    the digits of the residue
+BITS       per digit
+PAD        NDIGITS * BITS - E, below BITS
+CHUNK      the digits carried in sequence by one item of carryA and carryB
+NCHUNKS    the last chunk has the NDIGITS % CHUNK extra digits
+P1, P2, PINV1, PINV2 (-1/p mod 2^32), SCALE1, SCALE2 (R^2/L mod p), INV_P1M (1/P1 mod P2, Montgomery)
+*/
+
+typedef uint u32;
+typedef ulong u64;
+
+#define P(x) global x * restrict
+#define CP(x) const P(x)
+#define KERNEL(x) kernel __attribute__((reqd_work_group_size(x, 1, 1))) void
+
+// a * b / R mod p, from a, b < p < 2^31.
+u32 montMul(u32 a, u32 b, u32 p, u32 pinv) {
+  u64 t = (u64) a * b;
+  u32 m = (u32) t * pinv;
+  u32 r = (u32) ((t + (u64) m * p) >> 32);
+  return r >= p ? r - p : r;
+}
+
+u32 addMod(u32 a, u32 b, u32 p) { return a + b >= p ? a + b - p : a + b; }
+u32 subMod(u32 a, u32 b, u32 p) { return a >= b ? a - b : a + p - b; }
+
+// The digits, zero-padded to L, for both primes. The digits are at most 2^BITS, below both primes.
+KERNEL(64) nttIn(P(u32) out, CP(u32) digits) {
+  u32 i = get_global_id(0);
+  if (i >= L) { return; }
+  u32 x = i < NDIGITS ? digits[i] : 0;
+  out[i] = x;
+  out[L + i] = x;
+}
+
+// Stage "t" of the radix-2 Stockham DIF transform, natural order in and out, of both primes.
+// "roots" has the L/2 powers of the L-th root of unity (or its inverse) for P1, then those for P2.
+KERNEL(64) nttStage(P(u32) out, CP(u32) in, CP(u32) roots, u32 t) {
+  u32 g = get_global_id(0);
+  if (g >= L) { return; }
+  u32 half = L / 2;
+  bool second = g >= half;
+  u32 i = second ? g - half : g;
+  u32 p = second ? P2 : P1;
+  u32 pinv = second ? PINV2 : PINV1;
+  u32 base = second ? L : 0;
+
+  u32 s = 1u << t;
+  u32 m = half >> t;
+  u32 j = i >> t;
+  u32 q = i & (s - 1);
+  u32 a = in[base + q + (j << t)];
+  u32 b = in[base + q + ((j + m) << t)];
+  u32 w = roots[(second ? half : 0) + (j << t)];
+  out[base + q + ((2 * j) << t)] = addMod(a, b, p);
+  out[base + q + ((2 * j + 1) << t)] = montMul(subMod(a, b, p), w, p, pinv);
+}
+
+// Pointwise, with the 1/L of the inverse transform.
+KERNEL(64) nttSquare(P(u32) io) {
+  u32 i = get_global_id(0);
+  if (i >= 2 * L) { return; }
+  bool second = i >= L;
+  u32 p = second ? P2 : P1;
+  u32 pinv = second ? PINV2 : PINV1;
+  u32 x = io[i];
+  io[i] = montMul(montMul(x, x, p, pinv), second ? SCALE2 : SCALE1, p, pinv);
+}
+
+KERNEL(64) nttMul(P(u32) io, CP(u32) in) {
+  u32 i = get_global_id(0);
+  if (i >= 2 * L) { return; }
+  bool second = i >= L;
+  u32 p = second ? P2 : P1;
+  u32 pinv = second ? PINV2 : PINV1;
+  io[i] = montMul(montMul(io[i], in[i], p, pinv), second ? SCALE2 : SCALE1, p, pinv);
+}
+
+// The convolution term at "i", below P1 * P2 < 2^62, from its residues.
+u64 crt(CP(u32) x, u32 i) {
+  u32 a = x[i];
+  u32 a2 = a >= P2 ? a - P2 : a;
+  u32 t = montMul(subMod(x[L + i], a2, P2), INV_P1M, P2, PINV2);
+  return a + (u64) P1 * t;
+}
+
+u32 chunkEnd(u32 c) { return c + 1 == NCHUNKS ? NDIGITS : (c + 1) * CHUNK; }
+
+// The product, folded modulo 2^E - 1, as digits of BITS in each chunk, and the carry out of each chunk.
+// Term i + NDIGITS is at bit (i + NDIGITS) * BITS == i * BITS + E + PAD, i.e. at digit i shifted by PAD.
+KERNEL(64) nttCarryA(P(u32) digits, P(u64) carryOut, CP(u32) x) {
+  u32 c = get_global_id(0);
+  if (c >= NCHUNKS) { return; }
+  u32 mask = (1u << BITS) - 1;
+  u32 lowMask = (1u << (BITS - PAD)) - 1;
+  u64 carry = 0;
+  for (u32 i = c * CHUNK, end = chunkEnd(c); i < end; ++i) {
+    u64 hi = crt(x, i + NDIGITS);
+    // (hi << PAD) is (hi >> (BITS - PAD)) digits up, and the low part of hi shifted by PAD.
+    u64 v = crt(x, i) + carry + ((hi & lowMask) << PAD);
+    digits[i] = (u32) v & mask;
+    carry = (v >> BITS) + (hi >> (BITS - PAD));
+  }
+  carryOut[c] = carry;
+}
+
+// The carry into each chunk; that out of the last chunk, at bit NDIGITS * BITS == E + PAD, wraps to bit PAD.
+// The last digit of a chunk takes the carry left without masking, so a digit may reach 2^BITS.
+KERNEL(64) nttCarryB(P(u32) digits, CP(u64) carryIn) {
+  u32 c = get_global_id(0);
+  if (c >= NCHUNKS) { return; }
+  u32 mask = (1u << BITS) - 1;
+  u32 shift = c ? 0 : PAD;
+  u64 in = carryIn[c ? c - 1 : NCHUNKS - 1];
+  u32 i = c * CHUNK;
+  u32 end = chunkEnd(c) - 1;
+  u64 v = digits[i] + ((in & ((1ul << (BITS - shift)) - 1)) << shift);
+  u64 carry = in >> (BITS - shift);
+  while (i < end) {
+    digits[i] = (u32) v & mask;
+    carry += v >> BITS;
+    if (!carry) { return; }
+    v = digits[++i] + carry;
+    carry = 0;
+  }
+  digits[i] = (u32) v;
+}
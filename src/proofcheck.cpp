@@ -0,0 +1,94 @@
+// Copyright Mihai Preda.
+
+// Round-trips proof files through Proof::save(), Proof::load() and proof::getInfo(): the header (with and without
+// the known factors of PRP-CF), the residues and the MD5; and checks the hash chains of Proof::hashes().
+// Build with "make proofcheck"; run as "./proofcheck".
+
+#include "Proof.h"
+#include "File.h"
+
+#include <cstdio>
+#include <array>
+#include <random>
+
+namespace {
+
+Words randomWords(u32 E, std::mt19937& rng) {
+  Words w((E - 1) / 32 + 1);
+  for (u32& x : w) { x = rng(); }
+  if (E % 32) { w.back() &= (1u << (E % 32)) - 1; }
+  return w;
+}
+
+string header(const fs::path& path) {
+  File fi = File::openReadThrow(path);
+  string s;
+  for (int i = 0; i < 5; ++i) { s += fi.readLine(); }
+  return s;
+}
+
+bool check(u32 E, u32 power, const vector<string>& knownFactors, const string& expectedNumber) {
+  std::mt19937 rng{E};
+  vector<Words> middles;
+  for (u32 i = 0; i < power; ++i) { middles.push_back(randomWords(E, rng)); }
+  Proof proof{E, randomWords(E, rng), middles, knownFactors};
+
+  fs::path path = fs::temp_directory_path() / ("proofcheck-"s + to_string(E) + ".proof");
+  ProofInfo saved = proof.save(path);
+  Proof loaded = Proof::load(path);
+  ProofInfo info = proof::getInfo(path);
+  string head = header(path);
+  fs::remove(path);
+
+  string expectedHead = "PRP PROOF\nVERSION=2\nHASHSIZE=64\nPOWER="s + to_string(power) + "\nNUMBER=" + expectedNumber + '\n';
+  bool ok = head == expectedHead
+    && loaded.E == E && loaded.B == proof.B && loaded.middles == middles && loaded.knownFactors == knownFactors
+    && info.exp == E && info.power == power && info.md5 == saved.md5
+    && saved.exp == E && saved.power == power;
+  printf("%s %s\n", ok ? "OK  " : "FAIL", expectedNumber.c_str());
+  return ok;
+}
+
+// The hash chains computed together by Proof::hashes() against the sequential proof::hashWords().
+bool checkHashes() {
+  std::mt19937 rng{1};
+  vector<Proof> proofs;
+  for (auto [E, power] : {pair{216091u, 8u}, {216091u, 8u}, {86243u, 5u}, {1277u, 2u}, {44497u, 9u}, {127u, 1u}}) {
+    vector<Words> middles;
+    for (u32 i = 0; i < power; ++i) { middles.push_back(randomWords(E, rng)); }
+    proofs.push_back(Proof{E, randomWords(E, rng), middles});
+  }
+  vector<const Proof*> ptrs;
+  for (const Proof& p : proofs) { ptrs.push_back(&p); }
+  vector<vector<u64>> hashes = Proof::hashes(ptrs);
+
+  bool ok = hashes.size() == proofs.size();
+  for (u32 j = 0; ok && j < proofs.size(); ++j) {
+    const Proof& p = proofs[j];
+    auto hash = proof::hashWords(p.E, p.B);
+    vector<u64> expected;
+    for (const Words& M : p.middles) {
+      hash = proof::hashWords(p.E, hash, M);
+      expected.push_back(hash[0]);
+    }
+    ok = hashes[j] == expected && p.hashes() == expected;
+  }
+  printf("%s hash chains of %u proofs\n", ok ? "OK  " : "FAIL", u32(proofs.size()));
+  return ok;
+}
+
+}
+
+int main() {
+  try {
+    bool ok = check(216091, 8, {}, "M216091")
+      && check(1277, 2, {}, "M1277")
+      && check(29, 1, {"233"}, "M29/233")
+      && check(29, 3, {"233", "1103"}, "M29/233/1103")
+      && checkHashes();
+    return ok ? 0 : 1;
+  } catch (const char *mes) {
+    printf("FAIL %s\n", mes);
+    return 1;
+  }
+}
@@ -24,13 +24,12 @@ static u32 unbalance(int w, int nBits, int *carry) {
   return w;
 }
 
-std::vector<u32> compactBits(const vector<int> &dataVect, u32 E) {
+std::vector<u32> compactBits(const vector<int> &dataVect, u32 E) { return compactBits(dataVect.data(), dataVect.size(), E); }
+
+std::vector<u32> compactBits(const int *data, u32 N, u32 E) {
   std::vector<u32> out;
   out.reserve((E - 1) / 32 + 1);
 
-  u32 N = dataVect.size();
-  const int *data = dataVect.data();
-
   int carry = 0;
   u32 outWord = 0;
   int haveBits = 0;
@@ -67,6 +66,57 @@ std::vector<u32> compactBits(const vector<int> &dataVect, u32 E) {
   return out;
 }
 
+vector<u32> compactBitsChunked(const int *data, u32 N, u32 E, u32 chunk) {
+  assert(N % chunk == 0);
+  u32 nChunks = N / chunk;
+
+  // The borrow out of each chunk, for a borrow in of 0 and of -1.
+  vector<pair<int, int>> chunkBorrow(nChunks);
+  for (u32 c = 0; c < nChunks; ++c) {
+    int b0 = 0, b1 = -1;
+    for (u32 k = c * chunk; k < (c + 1) * chunk; ++k) {
+      int nBits = bitlen(N, E, k);
+      unbalance(data[k], nBits, &b0);
+      unbalance(data[k], nBits, &b1);
+    }
+    chunkBorrow[c] = {b0, b1};
+  }
+
+  vector<int> borrowIn(nChunks);
+  int borrow = 0;
+  for (u32 c = 0; c < nChunks; ++c) {
+    borrowIn[c] = borrow;
+    borrow = borrow ? chunkBorrow[c].second : chunkBorrow[c].first;
+  }
+
+  vector<u32> out((E - 1) / 32 + 1);
+  for (u32 c = 0; c < nChunks; ++c) {
+    int carry = borrowIn[c];
+    u32 pos = wordToBitpos(E, N, c * chunk);
+    u32 wordPos = pos / 32;
+    u32 have = pos % 32;
+    u64 acc = 0;
+    for (u32 k = c * chunk; k < (c + 1) * chunk; ++k) {
+      int nBits = bitlen(N, E, k);
+      acc |= u64(unbalance(data[k], nBits, &carry)) << have;
+      have += nBits;
+      if (have >= 32) {
+        out[wordPos++] |= u32(acc);
+        acc >>= 32;
+        have -= 32;
+      }
+    }
+    if (have) { out[wordPos] |= u32(acc); }
+  }
+
+  for (int p = 0; borrow; ++p) {
+    i64 v = i64(out[p]) + borrow;
+    out[p] = v & 0xffffffff;
+    borrow = v >> 32;
+  }
+  return out;
+}
+
 struct BitBucket {
   u64 bits;
   u32 size;
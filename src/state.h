@@ -9,6 +9,11 @@
 #include <cfenv>
 
 vector<u32> compactBits(const vector<int> &dataVect, u32 E);
+vector<u32> compactBits(const int *data, u32 N, u32 E);
+
+// Same result as compactBits(), computed the way the device does it (kernels compactCarry, compactScan, compactPack):
+// per-chunk borrows for both borrow-in values, a scan over the chunks, then an independent pack of each chunk.
+vector<u32> compactBitsChunked(const int *data, u32 N, u32 E, u32 chunk);
 vector<int> expandBits(const vector<u32> &compactBits, u32 N, u32 E);
 u64 residueFromRaw(u32 N, u32 E, const vector<int> &words);
 
@@ -27,11 +27,13 @@ typedef unsigned cl_kernel_work_group_info;
 typedef unsigned cl_profiling_info;
 typedef unsigned cl_event_info;
 typedef unsigned cl_command_queue_info;
+typedef unsigned cl_context_info;
 
 typedef u64 cl_mem_flags;
 typedef u64 cl_svm_mem_flags;
 typedef u64 cl_device_type;
 typedef u64 cl_queue_properties;
+typedef u64 cl_map_flags;
 
 extern "C" {
 
@@ -50,6 +52,7 @@ int clGetProgramInfo(cl_program, cl_program_info, size_t, void *, size_t *);
 int clGetDeviceInfo(cl_device_id, cl_device_info, size_t, void *, size_t *);
 int clGetPlatformInfo(cl_platform_id, cl_device_info, size_t, void *, size_t *);
 int clGetCommandQueueInfo(cl_command_queue, cl_command_queue_info, size_t, void*, size_t*);
+int clGetContextInfo(cl_context, cl_context_info, size_t, void*, size_t*);
 
   
 cl_kernel clCreateKernel(cl_program, const char *, int *);
@@ -64,6 +67,9 @@ int clEnqueueWriteBuffer(cl_command_queue, cl_mem, cl_bool, size_t, size_t, cons
                          unsigned numEvent, const cl_event *waitEvents, cl_event *outEvent);
 int clEnqueueCopyBuffer(cl_command_queue, cl_mem, cl_mem, size_t, size_t, size_t,
                         unsigned numEvent, const cl_event *waitEvents, cl_event *outEvent);
+void *clEnqueueMapBuffer(cl_command_queue, cl_mem, cl_bool blocking, cl_map_flags, size_t offset, size_t size,
+                         unsigned numEvents, const cl_event *waitEvents, cl_event *outEvent, int *err);
+int clEnqueueUnmapMemObject(cl_command_queue, cl_mem, void *, unsigned numEvents, const cl_event *waitEvents, cl_event *outEvent);
 int clEnqueueFillBuffer(cl_command_queue, cl_mem, const void *, size_t patternSize, size_t offset, size_t size,
                         unsigned numEvent, const cl_event *waitEvents, cl_event *outEvent);
   
@@ -117,12 +123,18 @@ int clSetKernelArgSVMPointer(cl_kernel, unsigned, const void *);
 #define CL_MEM_HOST_READ_ONLY   (1 << 8)
 #define CL_MEM_HOST_NO_ACCESS   (1 << 9)
 
+#define CL_MAP_READ                  (1 << 0)
+#define CL_MAP_WRITE_INVALIDATE_REGION (1 << 2)
+
 #define CL_MEM_SVM_FINE_GRAIN_BUFFER (1 << 10)
 #define CL_MEM_SVM_ATOMICS           (1 << 11)
 
 #define CL_QUEUE_PROFILING_ENABLE    (1 << 1)
 #define CL_QUEUE_PROPERTIES       0x1093
 
+/* cl_context_info */
+#define CL_CONTEXT_DEVICES                          0x1081
+
 /* cl_command_queue_info */
 #define CL_QUEUE_CONTEXT                            0x1090
 #define CL_QUEUE_DEVICE                             0x1091
@@ -0,0 +1,293 @@
+// Copyright Mihai Preda.
+
+// Compiles the trig routines of gpuowl.cl (trig.cl) for the host and checks them against the long double reference
+// of Trig.h: for every k of the full circle, the max and mean error in ULPs of slowTrig_N() with each TRIG_COMPUTE,
+// and with ULTRA_TRIG for the MIDDLE of the FFT; also the table lookup of slowTrig_BH(). And the ns per evaluation.
+// Build with "make trigcheck"; run as "./trigcheck [-save <file>] [-against <file>] [<FFT spec>..]", by default
+// 1K:<middle>:256 for every middle. -save writes the ULTRA_TRIG errors of each FFT to the file; -against fails
+// (exit code 1) if the max or the mean ULTRA_TRIG error of any FFT is worse than in the file, as "make trig-coefs" does.
+
+#include "Trig.h"
+#include "FFTConfig.h"
+#include "timeutil.h"
+#include "File.h"
+
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+
+// OpenCL for the host, as much as trig.cl needs.
+struct double2 { double x, y; };
+double2 U2(double a, double b) { return {a, b}; }
+double2 operator-(double2 a) { return {-a.x, -a.y}; }
+double2 swap(double2 a) { return {a.y, a.x}; }
+#define global
+
+// The FFT geometry is a run-time choice here.
+u32 nd, width, smallHeight, bigHeight;
+#define ND nd
+#define WIDTH width
+#define SMALL_HEIGHT smallHeight
+#define BIG_HEIGHT bigHeight
+
+double2 *TRIG_2SH, *TRIG_BH, *TRIG_N, *TRIG_W;
+
+using TrigFun = double2 (*)(u32 k, u32 kBound);
+
+#define TRIG_COMPUTE 0
+namespace tc0 {
+#include "trig.cl"
+}
+#undef TRIG_COMPUTE
+#undef COS_COEFS
+
+#define TRIG_COMPUTE 1
+namespace tc1 {
+#include "trig.cl"
+}
+#undef TRIG_COMPUTE
+#undef COS_COEFS
+
+#define TRIG_COMPUTE 2
+namespace tc2 {
+#include "trig.cl"
+}
+#undef COS_COEFS
+
+// ULTRA_TRIG has its own coefficients for each MIDDLE (trigcoefs.cl); one instance per MIDDLE, with TRIG_COMPUTE 2.
+#define ULTRA_TRIG 1
+
+#define MIDDLE 2
+namespace ultra2 {
+#include "trig.cl"
+}
+#undef MIDDLE
+
+#define MIDDLE 3
+namespace ultra3 {
+#include "trig.cl"
+}
+#undef MIDDLE
+
+#define MIDDLE 4
+namespace ultra4 {
+#include "trig.cl"
+}
+#undef MIDDLE
+
+#define MIDDLE 5
+namespace ultra5 {
+#include "trig.cl"
+}
+#undef MIDDLE
+
+#define MIDDLE 6
+namespace ultra6 {
+#include "trig.cl"
+}
+#undef MIDDLE
+
+#define MIDDLE 7
+namespace ultra7 {
+#include "trig.cl"
+}
+#undef MIDDLE
+
+#define MIDDLE 8
+namespace ultra8 {
+#include "trig.cl"
+}
+#undef MIDDLE
+
+#define MIDDLE 9
+namespace ultra9 {
+#include "trig.cl"
+}
+#undef MIDDLE
+
+#define MIDDLE 10
+namespace ultra10 {
+#include "trig.cl"
+}
+#undef MIDDLE
+
+#define MIDDLE 11
+namespace ultra11 {
+#include "trig.cl"
+}
+#undef MIDDLE
+
+#define MIDDLE 12
+namespace ultra12 {
+#include "trig.cl"
+}
+#undef MIDDLE
+
+#define MIDDLE 13
+namespace ultra13 {
+#include "trig.cl"
+}
+#undef MIDDLE
+
+#define MIDDLE 14
+namespace ultra14 {
+#include "trig.cl"
+}
+#undef MIDDLE
+
+#define MIDDLE 15
+namespace ultra15 {
+#include "trig.cl"
+}
+#undef MIDDLE
+
+#undef ULTRA_TRIG
+#undef TRIG_COMPUTE
+
+namespace {
+
+volatile double sink;
+
+TrigFun ultraFor(u32 middle) {
+  switch (middle) {
+    case 2:  return ultra2::slowTrig_N;
+    case 3:  return ultra3::slowTrig_N;
+    case 4:  return ultra4::slowTrig_N;
+    case 5:  return ultra5::slowTrig_N;
+    case 6:  return ultra6::slowTrig_N;
+    case 7:  return ultra7::slowTrig_N;
+    case 8:  return ultra8::slowTrig_N;
+    case 9:  return ultra9::slowTrig_N;
+    case 10: return ultra10::slowTrig_N;
+    case 11: return ultra11::slowTrig_N;
+    case 12: return ultra12::slowTrig_N;
+    case 13: return ultra13::slowTrig_N;
+    case 14: return ultra14::slowTrig_N;
+    case 15: return ultra15::slowTrig_N;
+    default: throw "no ULTRA_TRIG instance for this MIDDLE";
+  }
+}
+
+double ulp(double x) { return x == 0 ? DBL_MIN : std::ldexp(1.0, std::ilogb(x) - 52); }
+
+double ulpError(double x, long double ref) { return std::fabs(x - ref) / ulp(double(ref)); }
+
+struct Errors {
+  double max, mean;
+};
+
+Errors report(const string& name, TrigFun f, u32 n, const vector<pair<long double, long double>>& ref) {
+  double maxErr = 0, sumErr = 0;
+  for (u32 k = 0; k < n; ++k) {
+    double2 r = f(k, n);
+    double e = std::max(ulpError(r.x, ref[k].first), ulpError(r.y, ref[k].second));
+    maxErr = std::max(maxErr, e);
+    sumErr += e;
+  }
+
+  Timer timer;
+  double acc = 0;
+  for (u32 k = 0; k < n; ++k) {
+    double2 r = f(k, n);
+    acc += r.x + r.y;
+  }
+  double ns = timer.at() / n * 1e9;
+  sink = acc;
+  printf("  %-16s max %6.3f ulp, mean %5.3f ulp, %5.1f ns\n", name.c_str(), maxErr, sumErr / n, ns);
+  return {maxErr, sumErr / n};
+}
+
+// Returns the ULTRA_TRIG errors.
+Errors check(const FFTConfig& config) {
+  width = config.width;
+  smallHeight = config.height;
+  bigHeight = config.height * config.middle;
+  nd = width * bigHeight;
+
+  // The tables of Gpu, for the table based TRIG_COMPUTE.
+  auto trig2SH = makeTrig<double>(2 * smallHeight);
+  auto trigBH = makeTrig<double>(bigHeight);
+  auto trigN = makeTrig<double>(nd);
+  auto trigW = makeTinyTrig<double>(width, nd);
+  TRIG_2SH = reinterpret_cast<double2 *>(trig2SH.data());
+  TRIG_BH = reinterpret_cast<double2 *>(trigBH.data());
+  TRIG_N = reinterpret_cast<double2 *>(trigN.data());
+  TRIG_W = reinterpret_cast<double2 *>(trigW.data());
+
+  // e^(-i * tau * k / n)
+  vector<pair<long double, long double>> ref;
+  for (u32 k = 0; k < nd; ++k) { ref.push_back(root1<long double>(nd, k)); }
+  vector<pair<long double, long double>> refBH;
+  for (u32 k = 0; k < bigHeight; ++k) { refBH.push_back(root1<long double>(bigHeight, k)); }
+
+  printf("%s N=%u MIDDLE=%u\n", config.spec().c_str(), nd, config.middle);
+  report("TRIG_COMPUTE=0", tc0::slowTrig_N, nd, ref);
+  report("TRIG_COMPUTE=1", tc1::slowTrig_N, nd, ref);
+  report("TRIG_COMPUTE=2", tc2::slowTrig_N, nd, ref);
+  Errors ultra = report("ULTRA_TRIG", ultraFor(config.middle), nd, ref);
+  report("tableTrig BH", tc2::slowTrig_BH, bigHeight, refBH);
+  return ultra;
+}
+
+// The printed precision.
+constexpr double TOLERANCE = 0.0005;
+
+// Whether none of "errors" is worse than in the file saved by -save.
+bool compare(const fs::path& path, const vector<pair<string, Errors>>& errors) {
+  std::map<string, Errors> before;
+  File fi = File::openReadThrow(path);
+  for (string line; !(line = fi.readLine()).empty();) {
+    char spec[64];
+    Errors e;
+    if (sscanf(line.c_str(), "%63s %lf %lf", spec, &e.max, &e.mean) == 3) { before[spec] = e; }
+  }
+
+  bool ok = true;
+  for (const auto& [spec, e] : errors) {
+    auto it = before.find(spec);
+    if (it == before.end()) { continue; }
+    const Errors& b = it->second;
+    if (e.max > b.max + TOLERANCE || e.mean > b.mean + TOLERANCE) {
+      printf("REGRESSION %s ULTRA_TRIG max %.3f (was %.3f), mean %.4f (was %.4f)\n", spec.c_str(), e.max, b.max, e.mean, b.mean);
+      ok = false;
+    }
+  }
+  if (ok) { printf("no ULTRA_TRIG regression against '%s'\n", path.string().c_str()); }
+  return ok;
+}
+
+}
+
+int main(int argc, char **argv) {
+  static_assert(sizeof(double2) == sizeof(pair<double, double>));
+  try {
+    fs::path savePath, againstPath;
+    vector<FFTConfig> configs;
+    for (int i = 1; i < argc; ++i) {
+      string arg = argv[i];
+      if ((arg == "-save" || arg == "-against") && i + 1 < argc) {
+        (arg == "-save" ? savePath : againstPath) = argv[++i];
+      } else {
+        configs.push_back(FFTConfig::fromSpec(arg));
+      }
+    }
+    if (configs.empty()) {
+      for (u32 middle = 2; middle <= 15; ++middle) { configs.push_back(FFTConfig{1024, middle, 256}); }
+    }
+
+    vector<pair<string, Errors>> errors;
+    for (const FFTConfig& config : configs) { errors.push_back({config.spec(), check(config)}); }
+
+    if (!savePath.empty()) {
+      File fo = File::openWrite(savePath);
+      for (const auto& [spec, e] : errors) { fo.printf("%s %.6f %.6f\n", spec.c_str(), e.max, e.mean); }
+    }
+    if (!againstPath.empty() && !compare(againstPath, errors)) { return 1; }
+  } catch (const char *mes) {
+    printf("%s\n", mes);
+    return 1;
+  }
+  return 0;
+}
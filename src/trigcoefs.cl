@@ -0,0 +1,69 @@
+// Generated by trigcoefs.cpp ("make trigcoefs") for FFTs with WIDTH * SMALL_HEIGHT <= 4194304. Do not edit.
+// For each MIDDLE: SIN_COEFS and COS_COEFS of ksinpi() and kcospi() in trig.cl, the last one is the multiplier.
+
+#undef SIN_COEFS
+#undef COS_COEFS
+
+#if MIDDLE == 1
+// max error sin 0.690 ulp, cos 0.870 ulp, mean 0.3405 ulp; the hand-tuned set
+#define SIN_COEFS {0.013255665205020225,-3.8819803226819742e-07,3.4105654433606424e-12,-1.4268560139781677e-17,3.4821751757020666e-23,-5.5620764489252689e-29,6.2011635226098908e-35, 237*1}
+#define COS_COEFS {-8.7856330013791936e-05,1.2864557872487131e-09,-7.5348856128299892e-15,2.3642407019488875e-20,-4.6158547847666762e-26,6.1440808274170587e-32,-5.8714657758002626e-38, 237*1}
+#elif MIDDLE == 2
+// max error sin 0.690 ulp, cos 0.870 ulp, mean 0.3394 ulp; the hand-tuned set
+#define SIN_COEFS {0.013255665205020225,-3.8819803226819742e-07,3.4105654433606424e-12,-1.4268560139781677e-17,3.4821751757020666e-23,-5.5620764489252689e-29,6.2011635226098908e-35, 237*1}
+#define COS_COEFS {-8.7856330013791936e-05,1.2864557872487131e-09,-7.5348856128299892e-15,2.3642407019488875e-20,-4.6158547847666762e-26,6.1440808274170587e-32,-5.8714657758002626e-38, 237*1}
+#elif MIDDLE == 3
+// max error sin 0.690 ulp, cos 0.885 ulp, mean 0.3405 ulp; the hand-tuned set
+#define SIN_COEFS {0.013255665205020225,-3.8819803226819742e-07,3.4105654433606424e-12,-1.4268560139781677e-17,3.4821751757020666e-23,-5.5620764489252689e-29,6.2011635226098908e-35, 79*3}
+#define COS_COEFS {-8.7856330013791936e-05,1.2864557872487131e-09,-7.5348856128299892e-15,2.3642407019488875e-20,-4.6158547847666762e-26,6.1440808274170587e-32,-5.8714657758002626e-38, 79*3}
+#elif MIDDLE == 4
+// max error sin 0.690 ulp, cos 0.870 ulp, mean 0.3396 ulp; the hand-tuned set
+#define SIN_COEFS {0.013255665205020225,-3.8819803226819742e-07,3.4105654433606424e-12,-1.4268560139781677e-17,3.4821751757020666e-23,-5.5620764489252689e-29,6.2011635226098908e-35, 237*1}
+#define COS_COEFS {-8.7856330013791936e-05,1.2864557872487131e-09,-7.5348856128299892e-15,2.3642407019488875e-20,-4.6158547847666762e-26,6.1440808274170587e-32,-5.8714657758002626e-38, 237*1}
+#elif MIDDLE == 5
+// max error sin 0.686 ulp, cos 0.889 ulp, mean 0.3393 ulp; the hand-tuned set
+#define SIN_COEFS {0.0033599921428767842,-6.3221316482145663e-09,3.5687001824123009e-15,-9.5926212207432193e-22,1.5041156546369205e-28,-1.5436222869257443e-35,1.1057341951605355e-42, 187*5}
+#define COS_COEFS {-5.6447736000968621e-06,5.3105781660583875e-12,-1.9984674288638241e-18,4.0288914910974918e-25,-5.0538167304629085e-32,4.3221291704923216e-39,-2.6537550015407366e-46, 187*5}
+#elif MIDDLE == 6
+// max error sin 0.690 ulp, cos 0.885 ulp, mean 0.3394 ulp; the hand-tuned set
+#define SIN_COEFS {0.013255665205020225,-3.8819803226819742e-07,3.4105654433606424e-12,-1.4268560139781677e-17,3.4821751757020666e-23,-5.5620764489252689e-29,6.2011635226098908e-35, 79*3}
+#define COS_COEFS {-8.7856330013791936e-05,1.2864557872487131e-09,-7.5348856128299892e-15,2.3642407019488875e-20,-4.6158547847666762e-26,6.1440808274170587e-32,-5.8714657758002626e-38, 79*3}
+#elif MIDDLE == 7
+// max error sin 0.663 ulp, cos 0.897 ulp, mean 0.3400 ulp
+#define SIN_COEFS {0.0063211119790539099,-4.2094872796975649e-08,8.4098098008510248e-14,-8.0006238224731998e-20,4.4399515460884622e-26,-1.6126810540812932e-32,4.0885435519073659e-39, 71*7}
+#define COS_COEFS {-1.9978228325869419e-05,6.652160117342849e-11,-8.8598915789626801e-17,6.3216048875260874e-23,-2.8065433134719875e-29,8.4950656501115162e-36,-1.8483865044010861e-42, 71*7}
+#elif MIDDLE == 8
+// max error sin 0.690 ulp, cos 0.870 ulp, mean 0.3398 ulp; the hand-tuned set
+#define SIN_COEFS {0.013255665205020225,-3.8819803226819742e-07,3.4105654433606424e-12,-1.4268560139781677e-17,3.4821751757020666e-23,-5.5620764489252689e-29,6.2011635226098908e-35, 237*1}
+#define COS_COEFS {-8.7856330013791936e-05,1.2864557872487131e-09,-7.5348856128299892e-15,2.3642407019488875e-20,-4.6158547847666762e-26,6.1440808274170587e-32,-5.8714657758002626e-38, 237*1}
+#elif MIDDLE == 9
+// max error sin 0.722 ulp, cos 0.867 ulp, mean 0.3399 ulp; the hand-tuned set
+#define SIN_COEFS {0.0032024389944850084,-5.4738305054252556e-09,2.8068750524532041e-15,-6.8538645985346134e-22,9.7625812823195236e-29,-9.1014309535685973e-36,5.9224934064240749e-43, 109*9}
+#define COS_COEFS {-5.1278077566990758e-06,4.3824020649438457e-12,-1.4981410201032161e-18,2.7436354064447543e-25,-3.1264070669243379e-32,2.4288963593034543e-39,-1.3547441195887408e-46, 109*9}
+#elif MIDDLE == 10
+// max error sin 0.686 ulp, cos 0.890 ulp, mean 0.3396 ulp; the hand-tuned set
+#define SIN_COEFS {0.0033599921428767842,-6.3221316482145663e-09,3.5687001824123009e-15,-9.5926212207432193e-22,1.5041156546369205e-28,-1.5436222869257443e-35,1.1057341951605355e-42, 187*5}
+#define COS_COEFS {-5.6447736000968621e-06,5.3105781660583875e-12,-1.9984674288638241e-18,4.0288914910974918e-25,-5.0538167304629085e-32,4.3221291704923216e-39,-2.6537550015407366e-46, 187*5}
+#elif MIDDLE == 11
+// max error sin 0.727 ulp, cos 1.029 ulp, mean 0.3410 ulp; the hand-tuned set
+#define SIN_COEFS {0.0058285577988678909,-3.3001377814174114e-08,5.6056282285321817e-14,-4.5341639101320423e-20,2.1393746357239815e-26,-6.6068179928427645e-33,1.4241237670800455e-39, 49*11}
+#define COS_COEFS {-1.6986043007371857e-05,4.8087609508047477e-11,-5.4454546881584527e-17,3.3034545522108849e-23,-1.2469468591680302e-29,3.2090160573145604e-36,-5.9289892824449386e-43, 49*11}
+#elif MIDDLE == 12
+// max error sin 0.690 ulp, cos 0.885 ulp, mean 0.3396 ulp; the hand-tuned set
+#define SIN_COEFS {0.013255665205020225,-3.8819803226819742e-07,3.4105654433606424e-12,-1.4268560139781677e-17,3.4821751757020666e-23,-5.5620764489252689e-29,6.2011635226098908e-35, 79*3}
+#define COS_COEFS {-8.7856330013791936e-05,1.2864557872487131e-09,-7.5348856128299892e-15,2.3642407019488875e-20,-4.6158547847666762e-26,6.1440808274170587e-32,-5.8714657758002626e-38, 79*3}
+#elif MIDDLE == 13
+// max error sin 0.708 ulp, cos 0.878 ulp, mean 0.3395 ulp; the hand-tuned set
+#define SIN_COEFS {0.0034036756810290284,-6.5719350793639721e-09,3.8067960700283384e-15,-1.0500419865908618e-21,1.6895475541832181e-28,-1.779303563885441e-35,1.3079151443222568e-42, 71*13}
+#define COS_COEFS {-5.7925040708142102e-06,5.5921839017331711e-12,-2.1595165343644285e-18,4.4675029669254463e-25,-5.7506718639750315e-32,5.0468065746580596e-39,-3.1797982320621979e-46, 71*13}
+#elif MIDDLE == 14
+// max error sin 0.715 ulp, cos 0.897 ulp, mean 0.3400 ulp
+#define SIN_COEFS {0.0063211119790539099,-4.2094872796975649e-08,8.4098098008510248e-14,-8.0006238224731998e-20,4.4399515460884622e-26,-1.6126810540812932e-32,4.0885435519073659e-39, 71*7}
+#define COS_COEFS {-1.9978228325869419e-05,6.652160117342849e-11,-8.8598915789626801e-17,6.3216048875260874e-23,-2.8065433134719875e-29,8.4950656501115162e-36,-1.8483865044010861e-42, 71*7}
+#elif MIDDLE == 15
+// max error sin 0.737 ulp, cos 0.941 ulp, mean 0.3409 ulp; the hand-tuned set
+#define SIN_COEFS {0.0032221463113741469,-5.5755089924509359e-09,2.8943099587177684e-15,-7.1546148933480147e-22,1.0316780436916074e-28,-9.7368389615915834e-36,6.4141878934890016e-43, 65*15}
+#define COS_COEFS {-5.1911134259510105e-06,4.4912764335147829e-12,-1.5543150262419615e-18,2.8816519982635366e-25,-3.3242175693980929e-32,2.6144580878684214e-39,-1.4762460824550342e-46, 65*15}
+#else
+#error no trig coefficients for this MIDDLE
+#endif
@@ -0,0 +1,289 @@
+// Copyright Mihai Preda and George Woltman.
+
+// Generates trigcoefs.cl, the ULTRA_TRIG polynomial coefficients of ksinpi() and kcospi() in trig.cl, for every MIDDLE.
+// Replaces the hand search of qdcheb.cpp and sine_compare.cpp, in __float128 instead of libqd.
+// Build and check with "make trigcoefs"; run as "./trigcoefs [<max WIDTH*SMALL_HEIGHT> [<target ulp>]] > trigcoefs.cl".
+//
+// For a multiplier M, x = k * M / n and sin(pi * k / n) = sin(pi * x / M) is approximated on x in [0, M/4] by
+// S0*x + x^3 * (S1 + S2*x^2 + .. S6*x^10), and cos(pi * k / n) by 1 + x^2 * (C0 + C1*x^2 + .. C6*x^12), with the
+// coefficients interpolated at the Chebyshev nodes (near-minimax). As in the hand-tuned constants, M is a multiple of the
+// odd part of MIDDLE, so that k * M / n is exact. The candidates are the multiples by 1..255 and the hand-tuned sets
+// that apply, evaluated exactly as in trig.cl for every k of every FFT size. A candidate replaces the hand-tuned set of
+// a MIDDLE only if it is as good in max and in mean error at every size; of those, the one with the smallest sum of the
+// max and the mean error at the largest size is chosen.
+
+#include "FFTConfig.h"
+#include "common.h"
+
+#include <quadmath.h>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+
+namespace {
+
+constexpr u32 NCOEFS = 7;
+
+using Coefs = array<double, NCOEFS>;
+
+struct Result {
+  u32 middle, m; // the multiplier M is m * oddPart(middle)
+  Coefs sinCoefs, cosCoefs;
+  double sinErr, cosErr; // max ulp
+  double meanErr;        // mean over k of the larger of the sin and cos errors, in ulp
+  bool handTuned;
+};
+
+u32 oddPart(u32 x) { return x >> __builtin_ctz(x); }
+
+// The sets found by hand with qdcheb.cpp before this generator, with the multiplier M and the MIDDLEs they were used for.
+struct HandTuned {
+  Coefs S, C;
+  u32 M;
+  u32 middles; // bit MIDDLE
+};
+
+constexpr u32 bits(std::initializer_list<u32> middles) {
+  u32 r = 0;
+  for (u32 m : middles) { r |= 1u << m; }
+  return r;
+}
+
+const HandTuned HAND_TUNED[] = {
+  {{0.013255665205020225,-3.8819803226819742e-07,3.4105654433606424e-12,-1.4268560139781677e-17,3.4821751757020666e-23,-5.5620764489252689e-29,6.2011635226098908e-35},
+   {-8.7856330013791936e-05,1.2864557872487131e-09,-7.5348856128299892e-15,2.3642407019488875e-20,-4.6158547847666762e-26,6.1440808274170587e-32,-5.8714657758002626e-38}, 237, bits({1, 2, 3, 4, 6, 8, 12})},
+  {{0.0058285577988678909,-3.3001377814174114e-08,5.6056282285321817e-14,-4.5341639101320423e-20,2.1393746357239815e-26,-6.6068179928427645e-33,1.4241237670800455e-39},
+   {-1.6986043007371857e-05,4.8087609508047477e-11,-5.4454546881584527e-17,3.3034545522108849e-23,-1.2469468591680302e-29,3.2090160573145604e-36,-5.9289892824449386e-43}, 49*11, bits({11})},
+  {{0.0033599921428767842,-6.3221316482145663e-09,3.5687001824123009e-15,-9.5926212207432193e-22,1.5041156546369205e-28,-1.5436222869257443e-35,1.1057341951605355e-42},
+   {-5.6447736000968621e-06,5.3105781660583875e-12,-1.9984674288638241e-18,4.0288914910974918e-25,-5.0538167304629085e-32,4.3221291704923216e-39,-2.6537550015407366e-46}, 85*11, bits({5, 10})},
+  {{0.0030120734933746819,-4.5545496673734544e-09,2.066077343547647e-15,-4.4630156850662332e-22,5.6237622654854882e-29,-4.6381134477150518e-36,2.6699656391050201e-43},
+   {-4.5362933647451799e-06,3.4296595818385068e-12,-1.0371961336265129e-18,1.6803664055570525e-25,-1.6939185081650983e-32,1.1641940392856976e-39,-5.7443786570712859e-47}, 149*7, bits({7, 14})},
+  {{0.0032024389944850084,-5.4738305054252556e-09,2.8068750524532041e-15,-6.8538645985346134e-22,9.7625812823195236e-29,-9.1014309535685973e-36,5.9224934064240749e-43},
+   {-5.1278077566990758e-06,4.3824020649438457e-12,-1.4981410201032161e-18,2.7436354064447543e-25,-3.1264070669243379e-32,2.4288963593034543e-39,-1.3547441195887408e-46}, 109*9, bits({9})},
+  {{0.0034036756810290284,-6.5719350793639721e-09,3.8067960700283384e-15,-1.0500419865908618e-21,1.6895475541832181e-28,-1.779303563885441e-35,1.3079151443222568e-42},
+   {-5.7925040708142102e-06,5.5921839017331711e-12,-2.1595165343644285e-18,4.4675029669254463e-25,-5.7506718639750315e-32,5.0468065746580596e-39,-3.1797982320621979e-46}, 71*13, bits({13})},
+  {{0.0032221463113741469,-5.5755089924509359e-09,2.8943099587177684e-15,-7.1546148933480147e-22,1.0316780436916074e-28,-9.7368389615915834e-36,6.4141878934890016e-43},
+   {-5.1911134259510105e-06,4.4912764335147829e-12,-1.5543150262419615e-18,2.8816519982635366e-25,-3.3242175693980929e-32,2.6144580878684214e-39,-1.4762460824550342e-46}, 65*15, bits({15})},
+};
+
+// The coefficients of the polynomial of degree NCOEFS-1 in u that interpolates f at the Chebyshev nodes of [0, 1].
+array<f128, NCOEFS> interpolate(f128 (*f)(f128 u, f128 theta), f128 theta) {
+  const u32 n = NCOEFS;
+  f128 a[n][n + 1];
+  for (u32 j = 0; j < n; ++j) {
+    f128 u = (1 + cosq((2 * j + 1) * M_PIq / (2 * n))) / 2;
+    f128 p = 1;
+    for (u32 i = 0; i < n; ++i, p *= u) { a[j][i] = p; }
+    a[j][n] = f(u, theta);
+  }
+
+  // Gaussian elimination with partial pivoting.
+  for (u32 c = 0; c < n; ++c) {
+    u32 pivot = c;
+    for (u32 r = c + 1; r < n; ++r) { if (fabsq(a[r][c]) > fabsq(a[pivot][c])) { pivot = r; } }
+    for (u32 i = 0; i <= n; ++i) { std::swap(a[c][i], a[pivot][i]); }
+    for (u32 r = 0; r < n; ++r) {
+      if (r == c) { continue; }
+      f128 q = a[r][c] / a[c][c];
+      for (u32 i = c; i <= n; ++i) { a[r][i] -= q * a[c][i]; }
+    }
+  }
+  array<f128, NCOEFS> coefs;
+  for (u32 i = 0; i < n; ++i) { coefs[i] = a[i][n] / a[i][i]; }
+  return coefs;
+}
+
+// With t = sqrt(u) in [0, 1] mapping to the angle theta * t:
+// sin(theta * t) / t, and (cos(theta * t) - 1) / t^2 == -2 * sin(theta * t / 2)^2 / t^2 without the cancellation.
+f128 sinOverT(f128 u, f128 theta) {
+  f128 t = sqrtq(u);
+  return t == 0 ? theta : sinq(theta * t) / t;
+}
+
+f128 cosM1OverT2(f128 u, f128 theta) {
+  f128 t = sqrtq(u);
+  if (t == 0) { return -theta * theta / 2; }
+  f128 s = sinq(theta * t / 2);
+  return -2 * s * s / u;
+}
+
+// The kernels of trig.cl.
+double ksinpi(const Coefs& S, double M, u32 k, u32 n) {
+  double x = M / n * k;
+  double z = x * x;
+  double r = fma(fma(fma(fma(fma(S[6], z, S[5]), z, S[4]), z, S[3]), z, S[2]), z, S[1]) * (z * x);
+  return fma(x, S[0], r);
+}
+
+double kcospi(const Coefs& C, double M, u32 k, u32 n) {
+  double x = M / n * k;
+  double z = x * x;
+  return fma(fma(fma(fma(fma(fma(fma(C[6], z, C[5]), z, C[4]), z, C[3]), z, C[2]), z, C[1]), z, C[0]), z, 1);
+}
+
+double ulpError(double x, f128 ref) {
+  double r = double(ref);
+  double ulp = r == 0 ? 0x1p-1074 : std::ldexp(1.0, std::ilogb(r) - 52);
+  return double(fabsq(x - ref)) / ulp;
+}
+
+// The FFT sizes, from the largest (level 0) down by factors of two. The k / n of a level are those of level 0 with
+// k a multiple of 2^level, with the same rounding of x in ksinpi() and kcospi().
+constexpr u32 MAX_LEVELS = 8;
+
+struct Stats {
+  double sinErr{}, cosErr{}; // max
+  double sumErr{};           // of the larger of the two at each k
+  u32 n{};
+
+  double maxErr() const { return std::max(sinErr, cosErr); }
+  double meanErr() const { return n ? sumErr / n : 0; }
+};
+
+struct Candidate {
+  u32 m;
+  double M;
+  Coefs S, C;
+  bool handTuned{};
+  array<Stats, MAX_LEVELS> levels{};
+
+  // The max error bounds every FFT; the mean error adds up in the round-off of each one.
+  double score() const { return levels[0].maxErr() + levels[0].meanErr(); }
+
+  // As good as "o", in max and in mean error, at every level.
+  bool asGoodAs(const Candidate& o, u32 nLevels) const {
+    for (u32 i = 0; i < nLevels; ++i) {
+      if (levels[i].maxErr() > o.levels[i].maxErr() || levels[i].meanErr() > o.levels[i].meanErr()) { return false; }
+    }
+    return true;
+  }
+
+  void measure(u32 k, u32 n, f128 refSin, f128 refCos, u32 nLevels) {
+    double es = ulpError(ksinpi(S, M, k, n), refSin);
+    double ec = ulpError(kcospi(C, M, k, n), refCos);
+    for (u32 i = 0; i < nLevels && (i == 0 || k % (1u << i) == 0); ++i) {
+      Stats& st = levels[i];
+      st.sinErr = std::max(st.sinErr, es);
+      st.cosErr = std::max(st.cosErr, ec);
+      st.sumErr += std::max(es, ec);
+      ++st.n;
+    }
+  }
+};
+
+Result fitMiddle(u32 middle, u32 maxWH, u32 minWH) {
+  // ksinpi(k, n) is called by reducedCosSin() with n == ND / 2 and k <= n / 4. The k / n of the smaller FFTs with this
+  // MIDDLE are a subset of those of the largest, so checking every k of the largest covers them all.
+  u32 n = maxWH / 2 * middle;
+  u32 kMax = n / 4;
+  u32 nLevels = std::min(MAX_LEVELS, u32(__builtin_ctz(maxWH / minWH)) + 1);
+
+  // In t = 4 * x / M, in [0, 1].
+  auto a = interpolate(sinOverT, M_PIq / 4);
+  auto b = interpolate(cosM1OverT2, M_PIq / 4);
+
+  vector<Candidate> candidates;
+  for (u32 m = 1; m < 256; m += 2) {
+    Candidate c{m, double(m * oddPart(middle))};
+    f128 X = f128(c.M) / 4;
+    f128 xp = X, x2 = X * X;
+    for (u32 i = 0; i < NCOEFS; ++i, xp *= x2) {
+      c.S[i] = double(a[i] / xp);
+      c.C[i] = double(b[i] / (xp * X));
+    }
+    candidates.push_back(c);
+  }
+  vector<Candidate> hand;
+  u32 incumbent = 0;
+  for (const HandTuned& h : HAND_TUNED) {
+    if (h.M % oddPart(middle) == 0) {
+      if (h.middles & (1u << middle)) { incumbent = hand.size(); }
+      hand.push_back({h.M / oddPart(middle), double(h.M), h.S, h.C, true});
+    }
+  }
+
+  // Screen on a sample of k at the largest size, then check every k for the best few and the hand-tuned sets.
+  u32 nSamples = std::min(kMax, 1u << 14);
+  for (u32 i = 0; i <= nSamples; ++i) {
+    u32 k = u64(kMax) * i / nSamples;
+    f128 s, c;
+    sincosq(M_PIq * k / n, &s, &c);
+    for (Candidate& cand : candidates) { cand.measure(k, n, s, c, 1); }
+  }
+  auto better = [](const Candidate& x, const Candidate& y) { return x.score() < y.score(); };
+  std::sort(candidates.begin(), candidates.end(), better);
+  candidates.resize(8);
+  for (Candidate& cand : candidates) { cand.levels = {}; }
+  candidates.insert(candidates.begin(), hand.begin(), hand.end());
+  for (u32 k = 0; k <= kMax; ++k) {
+    f128 s, c;
+    sincosq(M_PIq * k / n, &s, &c);
+    for (Candidate& cand : candidates) { cand.measure(k, n, s, c, nLevels); }
+  }
+
+  const Candidate& current = candidates[incumbent];
+  const Candidate* best = &current;
+  for (const Candidate& cand : candidates) {
+    if (cand.asGoodAs(current, nLevels) && better(cand, *best)) { best = &cand; }
+  }
+  const Stats& st = best->levels[0];
+  return {middle, best->m, best->S, best->C, st.sinErr, st.cosErr, st.meanErr(), best->handTuned};
+}
+
+string coefsStr(const Coefs& c, u32 m, u32 middle) {
+  string s = "{";
+  char buf[64];
+  for (double x : c) {
+    snprintf(buf, sizeof(buf), "%.17g,", x);
+    s += buf;
+  }
+  snprintf(buf, sizeof(buf), " %u*%u}", m, oddPart(middle));
+  return s + buf;
+}
+
+}
+
+int main(int argc, char **argv) {
+  u32 maxWH = 0, minWH = u32(-1);
+  for (const FFTConfig& c : FFTConfig::genConfigs()) {
+    maxWH = std::max(maxWH, c.width * c.height);
+    minWH = std::min(minWH, c.width * c.height);
+  }
+  if (argc > 1) { maxWH = atoi(argv[1]); }
+  double target = argc > 2 ? atof(argv[2]) : 1.0;
+  if (!maxWH || (maxWH & (maxWH - 1))) {
+    fprintf(stderr, "Usage: trigcoefs [<max WIDTH*SMALL_HEIGHT, a power of two> [<target ulp>]]\n");
+    return 2;
+  }
+
+  vector<future<Result>> futures;
+  minWH = std::min(minWH, maxWH);
+  for (u32 middle = 1; middle <= 15; ++middle) { futures.push_back(async(launch::async, fitMiddle, middle, maxWH, minWH)); }
+
+  printf("// Generated by trigcoefs.cpp (\"make trigcoefs\") for FFTs with WIDTH * SMALL_HEIGHT <= %u. Do not edit.\n", maxWH);
+  printf("// For each MIDDLE: SIN_COEFS and COS_COEFS of ksinpi() and kcospi() in trig.cl, the last one is the multiplier.\n\n");
+  printf("#undef SIN_COEFS\n#undef COS_COEFS\n\n");
+
+  bool ok = true;
+  for (u32 i = 0; i < futures.size(); ++i) {
+    Result r = futures[i].get();
+    ok = ok && r.sinErr <= target && r.cosErr <= target;
+    fprintf(stderr, "MIDDLE %2u: M = %3u*%-2u, max error sin %.3f ulp, cos %.3f ulp, mean %.4f ulp%s\n",
+            r.middle, r.m, oddPart(r.middle), r.sinErr, r.cosErr, r.meanErr, r.handTuned ? ", hand-tuned" : "");
+    printf("%s MIDDLE == %u\n", i ? "#elif" : "#if", r.middle);
+    printf("// max error sin %.3f ulp, cos %.3f ulp, mean %.4f ulp%s\n",
+           r.sinErr, r.cosErr, r.meanErr, r.handTuned ? "; the hand-tuned set" : "");
+    printf("#define SIN_COEFS %s\n", coefsStr(r.sinCoefs, r.m, r.middle).c_str());
+    printf("#define COS_COEFS %s\n", coefsStr(r.cosCoefs, r.m, r.middle).c_str());
+  }
+  printf("#else\n#error no trig coefficients for this MIDDLE\n#endif\n");
+
+  if (!ok) {
+    fprintf(stderr, "the target of %.3f ulp is not met\n", target);
+    return 1;
+  }
+  return 0;
+}
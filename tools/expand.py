@@ -3,11 +3,12 @@
 import sys
 from os import path
 
-assert len(sys.argv) == 3, f'Use: f{sys.argv[0]} <input-file> <output-file>'
+assert len(sys.argv) in (3, 4), f'Use: f{sys.argv[0]} <input-file> <output-file> [<variable>]'
 sys.stdin  = open(sys.argv[1])
 sys.stdout = open(sys.argv[2], 'w')
+name = sys.argv[3] if len(sys.argv) == 4 else 'CL_SOURCE'
 
-HEAD = 'const char *CL_SOURCE = R"clsource('
+HEAD = f'const char *{name} = R"clsource('
 TAIL = ')clsource";';
     
 lineNo = 0
@@ -21,13 +22,17 @@ def err(text):
     print(f'#{lineNo}', text, file=sys.stderr)
     exit(1)
 
+# The text of an included file, with its own includes expanded.
+def include(name):
+    with open(path.join(path.dirname(sys.argv[1]), name)) as fi:
+        lines = [x.lstrip() for x in fi.readlines()]
+    return ''.join([include(x[len('#include "'):-2]) if x.startswith('#include "') else x for x in lines])
+
 for line in sys.stdin:
     lineNo += 1
     line = line.lstrip()
     if line.startswith('#include "'):
-        name = line[len('#include "'):-2]
-        with open(path.join(path.dirname(sys.argv[1]), name)) as fi:
-            line = ''.join([x.lstrip() for x in fi.readlines()])
+        line = include(line[len('#include "'):-2])
 
     if line.startswith('//{{ '):
         name = line[5:].strip()